@@ -0,0 +1,176 @@
+#include "Animation.h"
+#include "Mesh.h"
+#include "Parallel.h"
+
+#include <algorithm>
+
+namespace Helpers
+{
+	// Forward steps tried from the cached key before falling back to a binary search
+	static constexpr unsigned int KMaxCursorSteps{ 4 };
+
+	// Instances are cheap to evaluate so are only split over threads in batches this big
+	static constexpr size_t KMinInstancesPerThread{ 32 };
+
+	// Splits an affine transform into translation, rotation and scale, assuming no shear
+	static void DecomposeTransform(const glm::mat4& transform, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale)
+	{
+		translation = glm::vec3(transform[3]);
+		scale = glm::vec3(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])));
+
+		glm::mat3 rotationMatrix{ transform };
+		for (int c = 0; c < 3; c++)
+		{
+			if (scale[c] > 0)
+				rotationMatrix[c] /= scale[c];
+		}
+		rotation = glm::normalize(glm::quat_cast(rotationMatrix));
+	}
+
+	// Moves cursor to the last key at or before time, usually a step or two on from where it was
+	static unsigned int FindKey(const std::vector<float>& times, float time, unsigned int& cursor)
+	{
+		const unsigned int numKeys{ (unsigned int)times.size() };
+		if (cursor >= numKeys || times[cursor] > time)
+			cursor = 0;
+
+		for (unsigned int step = 0; step < KMaxCursorSteps; step++)
+		{
+			if (cursor + 1 >= numKeys || times[cursor + 1] > time)
+				return cursor;
+			cursor++;
+		}
+
+		// A big jump, e.g. a slow frame or a seek
+		const auto after{ std::upper_bound(times.begin() + cursor, times.end(), time) };
+		cursor = (unsigned int)(after - times.begin()) - 1;
+		return cursor;
+	}
+
+	// Fraction of the way time is from key to the next one, 0 past either end
+	static float KeyFraction(const std::vector<float>& times, unsigned int key, float time)
+	{
+		if (key + 1 >= times.size() || time <= times[key])
+			return 0;
+		const float span{ times[key + 1] - times[key] };
+		return span > 0 ? std::min(1.0f, (time - times[key]) / span) : 0;
+	}
+
+	static glm::vec3 SampleVec3(const std::vector<float>& times, const std::vector<glm::vec3>& values, float time, unsigned int& cursor)
+	{
+		const unsigned int key{ FindKey(times, time, cursor) };
+		const float t{ KeyFraction(times, key, time) };
+		return t > 0 ? glm::mix(values[key], values[key + 1], t) : values[key];
+	}
+
+	static glm::quat SampleQuat(const std::vector<float>& times, const std::vector<glm::quat>& values, float time, unsigned int& cursor)
+	{
+		const unsigned int key{ FindKey(times, time, cursor) };
+		const float t{ KeyFraction(times, key, time) };
+		return t > 0 ? glm::slerp(values[key], values[key + 1], t) : values[key];
+	}
+
+	// Copies out the keys of every animated node, the rest of the hierarchy just keeps its transforms
+	bool AnimationClip::Create(const ModelLoader& model)
+	{
+		const std::vector<Node>& nodes{ model.GetNodes() };
+
+		m_channels.clear();
+		m_parents.resize(nodes.size());
+		m_restTransforms.resize(nodes.size());
+		m_duration = model.GetAnimationDuration();
+
+		for (size_t n = 0; n < nodes.size(); n++)
+		{
+			const Node& node{ nodes[n] };
+			m_parents[n] = node.parent;
+			m_restTransforms[n] = node.transform;
+
+			if (node.translationKeys.empty() && node.rotationKeys.empty() && node.scaleKeys.empty())
+				continue;
+
+			AnimationChannel channel;
+			channel.node = (unsigned int)n;
+			channel.translationTimes = node.translationKeyTimes;
+			channel.translations = node.translationKeys;
+			channel.rotationTimes = node.rotationKeyTimes;
+			channel.rotations = node.rotationKeys;
+			channel.scaleTimes = node.scaleKeyTimes;
+			channel.scales = node.scaleKeys;
+			DecomposeTransform(node.transform, channel.restTranslation, channel.restRotation, channel.restScale);
+
+			// Files without a duration still loop over their keys
+			for (const std::vector<float>* times : { &channel.translationTimes, &channel.rotationTimes, &channel.scaleTimes })
+			{
+				if (!times->empty())
+					m_duration = std::max(m_duration, times->back());
+			}
+
+			m_channels.push_back(std::move(channel));
+		}
+
+		return !m_channels.empty();
+	}
+
+	// Nodes without keys keep their rest transform, the world transforms then follow in one pass down the array
+	void EvaluateAnimation(AnimationInstance& instance, float time)
+	{
+		const AnimationClip* clip{ instance.clip };
+		if (!clip)
+			return;
+
+		const std::vector<AnimationChannel>& channels{ clip->GetChannels() };
+		const std::vector<int>& parents{ clip->GetParents() };
+
+		if (instance.localTransforms.size() != clip->NumNodes())
+		{
+			instance.localTransforms = clip->GetRestTransforms();
+			instance.worldTransforms.resize(clip->NumNodes());
+		}
+		instance.cursors.resize(channels.size() * 3, 0);
+
+		float clipTime{ (time + instance.timeOffset) * instance.speed };
+		if (clip->Duration() > 0)
+		{
+			clipTime = std::fmod(clipTime, clip->Duration());
+			if (clipTime < 0)
+				clipTime += clip->Duration();
+		}
+
+		for (size_t c = 0; c < channels.size(); c++)
+		{
+			const AnimationChannel& channel{ channels[c] };
+			unsigned int* cursors{ &instance.cursors[c * 3] };
+
+			const glm::vec3 translation{ channel.translations.empty() ? channel.restTranslation :
+				SampleVec3(channel.translationTimes, channel.translations, clipTime, cursors[0]) };
+			const glm::quat rotation{ channel.rotations.empty() ? channel.restRotation :
+				SampleQuat(channel.rotationTimes, channel.rotations, clipTime, cursors[1]) };
+			const glm::vec3 scale{ channel.scales.empty() ? channel.restScale :
+				SampleVec3(channel.scaleTimes, channel.scales, clipTime, cursors[2]) };
+
+			glm::mat4 local{ glm::mat4_cast(rotation) };
+			local[0] *= scale.x;
+			local[1] *= scale.y;
+			local[2] *= scale.z;
+			local[3] = glm::vec4(translation, 1.0f);
+			instance.localTransforms[channel.node] = local;
+		}
+
+		for (size_t n = 0; n < parents.size(); n++)
+		{
+			instance.worldTransforms[n] = parents[n] < 0 ? instance.localTransforms[n] :
+				instance.worldTransforms[parents[n]] * instance.localTransforms[n];
+		}
+	}
+
+	// Instances share nothing they write so can be split freely
+	void EvaluateAnimations(std::vector<AnimationInstance>& instances, float time)
+	{
+		ParallelFor(instances.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				EvaluateAnimation(instances[i], time);
+		}, KMinInstancesPerThread);
+	}
+}
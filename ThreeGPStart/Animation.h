@@ -0,0 +1,78 @@
+#pragma once
+// Keyframe playback of node animations loaded by the ModelLoader
+
+#include "ExternalLibraryHeaders.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+namespace Helpers
+{
+	class ModelLoader;
+
+	// Keys of one animated node, times in seconds held apart from the values so finding a key only touches the times
+	// A node with no keys for a part, e.g. no scale keys, keeps that part of its rest transform
+	struct AnimationChannel
+	{
+		unsigned int node{ 0 };
+
+		std::vector<float> translationTimes;
+		std::vector<glm::vec3> translations;
+
+		std::vector<float> rotationTimes;
+		std::vector<glm::quat> rotations;
+
+		std::vector<float> scaleTimes;
+		std::vector<glm::vec3> scales;
+
+		// Rest transform split into parts, used for any part without keys
+		glm::vec3 restTranslation{ 0 };
+		glm::quat restRotation{ 1, 0, 0, 0 };
+		glm::vec3 restScale{ 1 };
+	};
+
+	// One model's animation along with its node hierarchy, shared by every instance playing it
+	class AnimationClip
+	{
+	private:
+		std::vector<AnimationChannel> m_channels;
+
+		// Per node, parents before children as in the ModelLoader
+		std::vector<int> m_parents;
+		std::vector<glm::mat4> m_restTransforms;
+
+		float m_duration{ 0 };
+	public:
+		// Takes the keys and hierarchy of a loaded model, returns false if it has no animated nodes
+		bool Create(const ModelLoader& model);
+
+		float Duration() const { return m_duration; }
+		size_t NumNodes() const { return m_parents.size(); }
+		const std::vector<AnimationChannel>& GetChannels() const { return m_channels; }
+		const std::vector<int>& GetParents() const { return m_parents; }
+		const std::vector<glm::mat4>& GetRestTransforms() const { return m_restTransforms; }
+	};
+
+	// Playback state of one animated object
+	// Each channel remembers the keys it used last time so steady playback finds its next keys in O(1)
+	struct AnimationInstance
+	{
+		const AnimationClip* clip{ nullptr };
+
+		// Applied to the time passed to Evaluate so instances of one clip need not play in step
+		float timeOffset{ 0 };
+		float speed{ 1.0f };
+
+		// Results, per node of the clip: transform relative to the parent and in model space
+		std::vector<glm::mat4> localTransforms;
+		std::vector<glm::mat4> worldTransforms;
+
+		// Key before the last sampled time, translation, rotation and scale for each channel
+		std::vector<unsigned int> cursors;
+	};
+
+	// Samples the instance's clip at time seconds, looping, and fills its transforms
+	void EvaluateAnimation(AnimationInstance& instance, float time);
+
+	// Evaluates every instance split over the thread pool, see EvaluateAnimation
+	void EvaluateAnimations(std::vector<AnimationInstance>& instances, float time);
+}
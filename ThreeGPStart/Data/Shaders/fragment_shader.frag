@@ -10,6 +10,7 @@ uniform sampler2D  sampler_tex;
 in vec2 varying_texcoord;
 in vec3 varying_positon;
 in vec3 varying_normal;
+in vec4 varying_tint;
 
 
 
@@ -17,7 +18,7 @@ out vec4 fragment_colour;
 
 void main(void)
 {
-	vec3 texure_colour = texture(sampler_tex,varying_texcoord).rgb;
+	vec3 texure_colour = texture(sampler_tex,varying_texcoord).rgb * varying_tint.rgb;
 	vec3 N = normalize(varying_normal);
 	vec3 P = varying_positon;
 	vec3 light_dircetion = vec3 (-0.5, -0.5,0);
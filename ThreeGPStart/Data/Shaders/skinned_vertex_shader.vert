@@ -0,0 +1,44 @@
+#version 330
+
+uniform mat4 combined_xform;
+uniform mat4 model_xform;
+
+// Skin matrices, four texels per matrix one column each
+uniform samplerBuffer bone_matrices;
+
+layout (location=0) in vec3 vertex_position;
+layout (location=1) in vec2 UV;
+layout (location=2) in vec3 vertex_Normal;
+layout (location=3) in uvec4 bone_indices;
+layout (location=4) in vec4 bone_weights;
+
+
+out vec3 varying_positon;
+out vec3 varying_normal;
+out vec2 varying_texcoord;
+out vec4 varying_tint;
+
+mat4 BoneMatrix(uint bone)
+{
+	int first = int(bone) * 4;
+	return mat4(texelFetch(bone_matrices, first), texelFetch(bone_matrices, first + 1),
+		texelFetch(bone_matrices, first + 2), texelFetch(bone_matrices, first + 3));
+}
+
+void main(void)
+{	
+	mat4 skin = mat4(0.0);
+	for (int i = 0; i < 4; i++)
+		skin += BoneMatrix(bone_indices[i]) * bone_weights[i];
+
+	// Vertices with no weights keep the bind pose
+	if (dot(bone_weights, vec4(1.0)) <= 0.0)
+		skin = mat4(1.0);
+
+	vec4 skinned_position = skin * vec4(vertex_position, 1.0);
+	varying_positon = (model_xform * skinned_position).xyz;
+	varying_texcoord = UV;
+	varying_tint = vec4(1.0);
+	varying_normal = (model_xform * vec4(mat3(skin) * vertex_Normal, 0.0)).xyz;
+	gl_Position = combined_xform * model_xform * skinned_position;
+}
@@ -0,0 +1,87 @@
+#version 330
+
+uniform mat4 combined_xform;
+uniform mat4 model_xform;
+uniform vec3 camera_position;
+uniform vec2 morph_range;
+uniform float terrain_size;
+
+// Heights as a 16 bit normalised texture, one texel per grid vertex laid out with z across and x down
+uniform sampler2D height_tex;
+uniform float height_offset;
+uniform float height_range;
+uniform float cell_size;
+uniform int grid_cells;
+uniform int patch_cells;
+
+// The node being drawn, in grid vertices
+uniform ivec2 node_origin;
+uniform int node_spacing;
+
+// Shared flat patch, just the vertex's column and row within the patch
+layout (location=0) in vec2 patch_position;
+
+
+out vec3 varying_positon;
+out vec3 varying_normal;
+out vec2 varying_texcoord;
+out vec4 varying_tint;
+
+
+float GridHeight(ivec2 grid)
+{
+	grid = clamp(grid, ivec2(0), ivec2(grid_cells));
+	return texelFetch(height_tex, ivec2(grid.y, grid.x), 0).r * height_range + height_offset;
+}
+
+// Height of the grid point on a level with cells spacing vertices wide, following the diamond pattern
+float CoarseHeight(ivec2 grid, int spacing)
+{
+	int lastCell = grid_cells / spacing - 1;
+	ivec2 cell = min(grid / spacing, ivec2(lastCell));
+	vec2 uv = vec2(grid - cell * spacing) / float(spacing);
+
+	ivec2 start = cell * spacing;
+	float h00 = GridHeight(start);
+	float h01 = GridHeight(start + ivec2(0, spacing));
+	float h10 = GridHeight(start + ivec2(spacing, 0));
+	float h11 = GridHeight(start + ivec2(spacing, spacing));
+
+	if (((cell.x + cell.y) & 1) == 0)
+	{
+		if (uv.x + uv.y <= 1.0)
+			return h00 + uv.y * (h01 - h00) + uv.x * (h10 - h00);
+		return h11 + (1.0 - uv.y) * (h10 - h11) + (1.0 - uv.x) * (h01 - h11);
+	}
+
+	if (uv.x >= uv.y)
+		return h00 + uv.x * (h10 - h00) + uv.y * (h11 - h10);
+	return h00 + uv.y * (h01 - h00) + uv.x * (h11 - h01);
+}
+
+void main(void)
+{	
+	ivec2 grid = node_origin + ivec2(patch_position) * node_spacing;
+
+	float height = GridHeight(grid);
+	// The root covers the whole grid and has no coarser level to morph towards
+	bool is_root = node_spacing * patch_cells >= grid_cells;
+	float morph_height = is_root ? height : CoarseHeight(grid, node_spacing * 2);
+	vec3 position = vec3(grid.x * cell_size, height, grid.y * cell_size);
+
+	// Blend towards the coarser level as the vertex nears the end of this level's range
+	float morph = clamp((distance(camera_position, position) - morph_range.x) / (morph_range.y - morph_range.x), 0.0, 1.0);
+	position.y = mix(position.y, morph_height, morph);
+
+	// Normal from the neighbouring full resolution heights
+	float dx = GridHeight(grid + ivec2(1, 0)) - GridHeight(grid - ivec2(1, 0));
+	float dz = GridHeight(grid + ivec2(0, 1)) - GridHeight(grid - ivec2(0, 1));
+	vec3 normal = normalize(vec3(-dx, 2.0 * cell_size, -dz));
+
+	varying_positon= (model_xform * vec4(position,1.0)).xyz;
+	varying_texcoord = vec2(position.z, position.x) / terrain_size;
+	varying_tint = vec4(1.0);
+	varying_normal=(model_xform * vec4(normal,0.0)).xyz;
+	gl_Position = combined_xform * model_xform * vec4(position, 1.0);
+
+}
@@ -0,0 +1,48 @@
+#version 330
+
+uniform mat4 combined_xform;
+uniform mat4 model_xform;
+uniform vec3 camera_position;
+uniform vec2 morph_range;
+uniform float terrain_size;
+uniform float cell_size;
+uniform float height_offset;
+uniform float height_range;
+
+// Compact vertex, grid position, normalised height and morph height, octahedral normal
+layout (location=0) in vec2 grid_position;
+layout (location=1) in vec2 vertex_heights;
+layout (location=2) in vec2 octahedral_normal;
+
+
+out vec3 varying_positon;
+out vec3 varying_normal;
+out vec2 varying_texcoord;
+out vec4 varying_tint;
+
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main(void)
+{	
+	vec2 heights = vertex_heights * height_range + height_offset;
+	float morph_height = heights.y;
+
+	// Blend towards the coarser level as the vertex nears the end of this level's range
+	vec3 position = vec3(grid_position.x * cell_size, heights.x, grid_position.y * cell_size);
+	float morph = clamp((distance(camera_position, position) - morph_range.x) / (morph_range.y - morph_range.x), 0.0, 1.0);
+	position.y = mix(position.y, morph_height, morph);
+
+	varying_positon= (model_xform * vec4(position,1.0)).xyz;
+	varying_texcoord = vec2(position.z, position.x) / terrain_size;
+	varying_tint = vec4(1.0);
+	varying_normal=(model_xform * vec4(DecodeOctahedral(octahedral_normal),0.0)).xyz;
+	gl_Position = combined_xform * model_xform * vec4(position, 1.0);
+
+}
@@ -8,17 +8,24 @@ layout (location=0) in vec3 vertex_position;
 layout (location=1) in vec2 UV;
 layout (location=2) in vec3 vertex_Normal;
 
+// Per instance, draws that are not instanced read the first
+layout (location=5) in mat4 instance_xform;
+layout (location=9) in vec4 instance_tint;
+
 
 out vec3 varying_positon;
 out vec3 varying_normal;
 out vec2 varying_texcoord;
+out vec4 varying_tint;
 
 
 void main(void)
 {	
-	varying_positon= (model_xform * vec4(vertex_position,1.0)).xyz;
+	mat4 world_xform = model_xform * instance_xform;
+	varying_positon= (world_xform * vec4(vertex_position,1.0)).xyz;
 	varying_texcoord = UV;
-	varying_normal=(model_xform * vec4(vertex_Normal,1.0)).xyz;
-	gl_Position = combined_xform * model_xform * vec4(vertex_position, 1.0);
+	varying_tint = instance_tint;
+	varying_normal=(world_xform * vec4(vertex_Normal,0.0)).xyz;
+	gl_Position = combined_xform * world_xform * vec4(vertex_position, 1.0);
 
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "Frustum.h"
+
+namespace Helpers
+{
+	// Each plane is the last row of the matrix plus or minus one of the others
+	void Frustum::Extract(const glm::mat4& combinedXform)
+	{
+		// glm is column major so build the rows first
+		const glm::mat4 rows{ glm::transpose(combinedXform) };
+		m_planes[0] = rows[3] + rows[0];	// left
+		m_planes[1] = rows[3] - rows[0];	// right
+		m_planes[2] = rows[3] + rows[1];	// bottom
+		m_planes[3] = rows[3] - rows[1];	// top
+		m_planes[4] = rows[3] + rows[2];	// near
+		m_planes[5] = rows[3] - rows[2];	// far
+
+		for (glm::vec4& plane : m_planes)
+			plane /= glm::length(glm::vec3(plane));
+	}
+
+	// Tests the box corners nearest and furthest along each plane's normal
+	Frustum::Result Frustum::ClassifyBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+	{
+		Result result{ Result::Inside };
+		for (const glm::vec4& plane : m_planes)
+		{
+			const glm::vec3 normal{ plane };
+			const glm::vec3 furthest{ glm::mix(boxMin, boxMax, glm::step(glm::vec3(0), normal)) };
+			if (glm::dot(normal, furthest) + plane.w < 0)
+				return Result::Outside;
+
+			const glm::vec3 nearest{ glm::mix(boxMax, boxMin, glm::step(glm::vec3(0), normal)) };
+			if (glm::dot(normal, nearest) + plane.w < 0)
+				result = Result::Intersecting;
+		}
+		return result;
+	}
+
+	// Signed distance of the centre from each plane against the radius
+	Frustum::Result Frustum::ClassifySphere(const glm::vec3& centre, float radius) const
+	{
+		Result result{ Result::Inside };
+		for (const glm::vec4& plane : m_planes)
+		{
+			const float distance{ glm::dot(glm::vec3(plane), centre) + plane.w };
+			if (distance < -radius)
+				return Result::Outside;
+			if (distance < radius)
+				result = Result::Intersecting;
+		}
+		return result;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+// View frustum planes for culling bounding volumes
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Six planes facing into the frustum, as (normal, distance) so a point p is inside a plane when dot(n, p) + d >= 0
+	class Frustum
+	{
+	public:
+		enum class Result
+		{
+			Outside,
+			Intersecting,
+			Inside
+		};
+	private:
+		glm::vec4 m_planes[6];
+	public:
+		// Extracts the planes from a combined projection * view (* model) matrix, planes end up in that matrix's input space
+		void Extract(const glm::mat4& combinedXform);
+
+		// Where an axis aligned box lies relative to the frustum
+		Result ClassifyBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+		// Where a sphere lies relative to the frustum
+		Result ClassifySphere(const glm::vec3& centre, float radius) const;
+	};
+}
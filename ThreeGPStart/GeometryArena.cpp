@@ -0,0 +1,250 @@
+#include "GeometryArena.h"
+#include "Mesh.h"
+
+namespace Helpers
+{
+	void RangeAllocator::Reset(size_t capacity)
+	{
+		m_free.clear();
+		m_capacity = capacity;
+		if (capacity)
+			m_free.emplace(0, capacity);
+	}
+
+	bool RangeAllocator::Allocate(size_t size, size_t& offset)
+	{
+		for (auto range = m_free.begin(); range != m_free.end(); ++range)
+		{
+			if (range->second < size)
+				continue;
+
+			offset = range->first;
+			const size_t remaining{ range->second - size };
+			m_free.erase(range);
+			if (remaining)
+				m_free.emplace(offset + size, remaining);
+			return true;
+		}
+		return false;
+	}
+
+	void RangeAllocator::Free(size_t offset, size_t size)
+	{
+		if (size == 0)
+			return;
+
+		auto next{ m_free.emplace(offset, size).first };
+
+		// Merge with the range after then the one before
+		auto after{ std::next(next) };
+		if (after != m_free.end() && next->first + next->second == after->first)
+		{
+			next->second += after->second;
+			m_free.erase(after);
+		}
+		if (next != m_free.begin())
+		{
+			auto before{ std::prev(next) };
+			if (before->first + before->second == next->first)
+			{
+				before->second += next->second;
+				m_free.erase(next);
+			}
+		}
+	}
+
+	void RangeAllocator::Grow(size_t newCapacity)
+	{
+		if (newCapacity <= m_capacity)
+			return;
+		const size_t oldCapacity{ m_capacity };
+		m_capacity = newCapacity;
+		Free(oldCapacity, newCapacity - oldCapacity);
+	}
+
+	GeometryArena::~GeometryArena()
+	{
+		DeleteBuffers();
+	}
+
+	void GeometryArena::DeleteBuffers()
+	{
+		const GLuint buffers[]{ m_positions, m_normals, m_uvCoords, m_boneIndices, m_boneWeights, m_elements };
+		glDeleteBuffers(6, buffers);
+		glDeleteVertexArrays(1, &m_vao);
+		m_vao = m_positions = m_normals = m_uvCoords = m_boneIndices = m_boneWeights = m_elements = 0;
+	}
+
+	// A buffer of the given size holding a copy of the start of an old one, which is deleted
+	static GLuint ResizeBuffer(GLuint oldBuffer, size_t oldSize, size_t newSize)
+	{
+		GLuint buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+		if (oldBuffer)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, oldBuffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glDeleteBuffers(1, &oldBuffer);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return buffer;
+	}
+
+	// Points the vertex array at the current buffers, needed again whenever they are replaced
+	static void BindAttribute(GLuint index, GLuint buffer, GLint size, GLenum type, bool integer)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glEnableVertexAttribArray(index);
+		if (integer)
+			glVertexAttribIPointer(index, size, type, 0, (void*)0);
+		else
+			glVertexAttribPointer(index, size, type, GL_FALSE, 0, (void*)0);
+	}
+
+	void GeometryArena::Create(size_t vertexCapacity, size_t indexCapacity, bool skinned)
+	{
+		DeleteBuffers();
+		m_skinned = skinned;
+		m_vertexSpace.Reset(0);
+		m_indexSpace.Reset(0);
+
+		glGenVertexArrays(1, &m_vao);
+		GrowVertices(std::max<size_t>(1, vertexCapacity));
+		GrowIndices(std::max<size_t>(1, indexCapacity));
+	}
+
+	void GeometryArena::GrowVertices(size_t newCapacity)
+	{
+		const size_t oldCapacity{ m_vertexSpace.Capacity() };
+		m_positions = ResizeBuffer(m_positions, oldCapacity * sizeof(glm::vec3), newCapacity * sizeof(glm::vec3));
+		m_normals = ResizeBuffer(m_normals, oldCapacity * sizeof(glm::vec3), newCapacity * sizeof(glm::vec3));
+		m_uvCoords = ResizeBuffer(m_uvCoords, oldCapacity * sizeof(glm::vec2), newCapacity * sizeof(glm::vec2));
+		if (m_skinned)
+		{
+			m_boneIndices = ResizeBuffer(m_boneIndices, oldCapacity * sizeof(glm::uvec4), newCapacity * sizeof(glm::uvec4));
+			m_boneWeights = ResizeBuffer(m_boneWeights, oldCapacity * sizeof(glm::vec4), newCapacity * sizeof(glm::vec4));
+		}
+		m_vertexSpace.Grow(newCapacity);
+		m_generation++;
+		AttachBuffers(m_vao);
+	}
+
+	void GeometryArena::GrowIndices(size_t newCapacity)
+	{
+		m_elements = ResizeBuffer(m_elements, m_indexSpace.Capacity() * sizeof(GLuint), newCapacity * sizeof(GLuint));
+		m_indexSpace.Grow(newCapacity);
+		m_generation++;
+		AttachBuffers(m_vao);
+	}
+
+	// The element buffer binding is part of the vertex array's state too
+	void GeometryArena::AttachBuffers(GLuint vao) const
+	{
+		glBindVertexArray(vao);
+		BindAttribute(0, m_positions, 3, GL_FLOAT, false);
+		BindAttribute(1, m_uvCoords, 2, GL_FLOAT, false);
+		BindAttribute(2, m_normals, 3, GL_FLOAT, false);
+		if (m_skinned)
+		{
+			BindAttribute(3, m_boneIndices, 4, GL_UNSIGNED_INT, true);
+			BindAttribute(4, m_boneWeights, 4, GL_FLOAT, false);
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_elements);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void GeometryArena::Reserve(size_t vertexCapacity, size_t indexCapacity)
+	{
+		if (vertexCapacity > m_vertexSpace.Capacity())
+			GrowVertices(vertexCapacity);
+		if (indexCapacity > m_indexSpace.Capacity())
+			GrowIndices(indexCapacity);
+	}
+
+	// Doubles until the request fits, freed space is reused first
+	ArenaAllocation GeometryArena::Allocate(size_t numVertices, size_t numIndices)
+	{
+		ArenaAllocation allocation;
+		size_t vertexOffset{ 0 };
+		while (!m_vertexSpace.Allocate(numVertices, vertexOffset))
+			GrowVertices(std::max(m_vertexSpace.Capacity() * 2, m_vertexSpace.Capacity() + numVertices));
+
+		size_t indexOffset{ 0 };
+		while (!m_indexSpace.Allocate(numIndices, indexOffset))
+			GrowIndices(std::max(m_indexSpace.Capacity() * 2, m_indexSpace.Capacity() + numIndices));
+
+		allocation.baseVertex = (GLint)vertexOffset;
+		allocation.numVertices = (GLuint)numVertices;
+		allocation.firstIndex = (GLuint)indexOffset;
+		allocation.numIndices = (GLuint)numIndices;
+		return allocation;
+	}
+
+	void GeometryArena::Free(const ArenaAllocation& allocation)
+	{
+		m_vertexSpace.Free(allocation.baseVertex, allocation.numVertices);
+		m_indexSpace.Free(allocation.firstIndex, allocation.numIndices);
+	}
+
+	// Writes one attribute's part of the allocation, or zeros if the mesh does not have it
+	template<typename T>
+	static void WriteAttribute(GLuint buffer, const ArenaAllocation& allocation, const T* values)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		const GLintptr offset{ (GLintptr)allocation.baseVertex * (GLintptr)sizeof(T) };
+		if (values)
+		{
+			glBufferSubData(GL_ARRAY_BUFFER, offset, allocation.numVertices * sizeof(T), values);
+		}
+		else
+		{
+			const std::vector<T> zeros(allocation.numVertices, T(0));
+			glBufferSubData(GL_ARRAY_BUFFER, offset, allocation.numVertices * sizeof(T), zeros.data());
+		}
+	}
+
+	void GeometryArena::WriteVertices(const ArenaAllocation& allocation, const VertexStreams& streams, GLuint boneBase)
+	{
+		if (streams.numVertices < allocation.numVertices)
+			return;
+
+		WriteAttribute(m_positions, allocation, streams.vertices);
+		WriteAttribute(m_normals, allocation, streams.normals);
+		WriteAttribute(m_uvCoords, allocation, streams.uvCoords);
+		if (m_skinned)
+		{
+			if (boneBase == 0 || !streams.boneIndices)
+			{
+				WriteAttribute(m_boneIndices, allocation, streams.boneIndices);
+			}
+			else
+			{
+				std::vector<glm::uvec4> boneIndices(streams.boneIndices, streams.boneIndices + allocation.numVertices);
+				for (glm::uvec4& indices : boneIndices)
+					indices += boneBase;
+				WriteAttribute(m_boneIndices, allocation, boneIndices.data());
+			}
+			WriteAttribute(m_boneWeights, allocation, streams.boneWeights);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void GeometryArena::WriteVertices(const ArenaAllocation& allocation, const Mesh& mesh, GLuint boneBase)
+	{
+		WriteVertices(allocation, mesh.GetVertexStreams(), boneBase);
+	}
+
+	void GeometryArena::WriteIndices(const ArenaAllocation& allocation, size_t offset, const unsigned int* indices, size_t count)
+	{
+		if (count == 0 || offset + count > allocation.numIndices)
+			return;
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_elements);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (allocation.firstIndex + offset) * sizeof(GLuint), count * sizeof(GLuint), indices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+// One set of vertex and index buffers shared by many mesh so they can all be drawn from one vertex array
+
+#include "ExternalLibraryHeaders.h"
+
+#include <map>
+
+namespace Helpers
+{
+	struct Mesh;
+	struct VertexStreams;
+
+	// Hands out ranges of a fixed size space, first fit, merging neighbours back together when freed
+	class RangeAllocator
+	{
+	private:
+		// Free ranges by offset
+		std::map<size_t, size_t> m_free;
+		size_t m_capacity{ 0 };
+	public:
+		void Reset(size_t capacity);
+
+		// Returns false if no free range is big enough
+		bool Allocate(size_t size, size_t& offset);
+		void Free(size_t offset, size_t size);
+
+		// Adds the space between the old capacity and the new to the end
+		void Grow(size_t newCapacity);
+
+		size_t Capacity() const { return m_capacity; }
+	};
+
+	// Where a mesh lives in the arena, its elements index from baseVertex
+	struct ArenaAllocation
+	{
+		GLint baseVertex{ 0 };
+		GLuint numVertices{ 0 };
+		GLuint firstIndex{ 0 };
+		GLuint numIndices{ 0 };
+	};
+
+	// Position, uv and normal buffers at attributes 0, 1 and 2 as the shaders expect, plus bone indices and weights
+	// at 3 and 4 for a skinned arena, and one element buffer, all under one vertex array
+	// Buffers double in size when full, copying on the GPU, so allocations keep their offsets
+	class GeometryArena
+	{
+	private:
+		bool m_skinned{ false };
+
+		GLuint m_vao{ 0 };
+		GLuint m_positions{ 0 };
+		GLuint m_normals{ 0 };
+		GLuint m_uvCoords{ 0 };
+		GLuint m_boneIndices{ 0 };
+		GLuint m_boneWeights{ 0 };
+		GLuint m_elements{ 0 };
+
+		RangeAllocator m_vertexSpace;
+		RangeAllocator m_indexSpace;
+
+		// Counts buffer replacements, so other vertex arrays over the buffers know to attach them again
+		size_t m_generation{ 0 };
+
+		void GrowVertices(size_t newCapacity);
+		void GrowIndices(size_t newCapacity);
+		void DeleteBuffers();
+	public:
+		GeometryArena() = default;
+		~GeometryArena();
+		GeometryArena(const GeometryArena&) = delete;
+		GeometryArena& operator=(const GeometryArena&) = delete;
+
+		// Starting size in vertices and indices, skinned arenas also hold bone indices and weights
+		void Create(size_t vertexCapacity, size_t indexCapacity, bool skinned = false);
+
+		// Grows the buffers once to at least these capacities, so a model whose size is known can go in without repeated doubling
+		void Reserve(size_t vertexCapacity, size_t indexCapacity);
+
+		// Reserves room for numVertices vertices and numIndices elements, growing if needed
+		ArenaAllocation Allocate(size_t numVertices, size_t numIndices);
+		void Free(const ArenaAllocation& allocation);
+
+		// Fills the allocation's vertices straight from the streams, which may point into a mapped file, missing attributes are zeroed
+		// boneBase is added to the bone indices so several mesh can share one bone matrix buffer
+		void WriteVertices(const ArenaAllocation& allocation, const VertexStreams& streams, GLuint boneBase = 0);
+		void WriteVertices(const ArenaAllocation& allocation, const Mesh& mesh, GLuint boneBase = 0);
+
+		// Writes count elements starting offset elements into the allocation's range
+		void WriteIndices(const ArenaAllocation& allocation, size_t offset, const unsigned int* indices, size_t count);
+		void WriteIndices(const ArenaAllocation& allocation, size_t offset, const std::vector<unsigned int>& indices)
+		{
+			WriteIndices(allocation, offset, indices.data(), indices.size());
+		}
+
+		// Points another vertex array's vertex attributes and element buffer at the arena's current buffers
+		// Must be called again whenever Generation changes
+		void AttachBuffers(GLuint vao) const;
+		size_t Generation() const { return m_generation; }
+
+		GLuint GetVAO() const { return m_vao; }
+		bool IsSkinned() const { return m_skinned; }
+		size_t VertexCapacity() const { return m_vertexSpace.Capacity(); }
+		size_t IndexCapacity() const { return m_indexSpace.Capacity(); }
+	};
+}
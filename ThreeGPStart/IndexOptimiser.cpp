@@ -0,0 +1,291 @@
+#include "IndexOptimiser.h"
+#include "Mesh.h"
+
+#include <cmath>
+
+namespace Helpers
+{
+	// Forsyth's scoring, tuned for a 32 entry LRU cache
+	static constexpr int KForsythCacheSize{ 32 };
+	static constexpr float KCacheDecayPower{ 1.5f };
+	static constexpr float KLastTriangleScore{ 0.75f };
+	static constexpr float KValenceBoostScale{ 2.0f };
+	static constexpr float KValenceBoostPower{ 0.5f };
+
+	// Score of a vertex at cachePosition (-1 if not cached) with activeTriangles still to draw
+	static float VertexScore(int cachePosition, unsigned int activeTriangles)
+	{
+		if (activeTriangles == 0)
+			return -1.0f;
+
+		float score{ 0 };
+		if (cachePosition >= 0)
+		{
+			// The three vertices of the last triangle get a fixed score so it is not simply repeated
+			if (cachePosition < 3)
+				score = KLastTriangleScore;
+			else
+			{
+				const float scaler{ 1.0f / (KForsythCacheSize - 3) };
+				score = std::pow(1.0f - (cachePosition - 3) * scaler, KCacheDecayPower);
+			}
+		}
+
+		// Favour vertices with few triangles left so they are finished off rather than left stranded
+		return score + KValenceBoostScale * std::pow((float)activeTriangles, -KValenceBoostPower);
+	}
+
+	// Runs indices through a FIFO cache of cacheSize entries, as most hardware is modelled
+	VertexCacheStats AnalyseVertexCache(const std::vector<unsigned int>& indices, size_t numVertices, size_t cacheSize)
+	{
+		VertexCacheStats stats;
+		if (indices.size() < 3 || numVertices == 0)
+			return stats;
+
+		// A vertex is in the cache if it was added within the last cacheSize misses
+		std::vector<size_t> addedAt(numVertices, 0);
+		std::vector<bool> used(numVertices, false);
+		size_t misses{ 0 };
+		for (unsigned int index : indices)
+		{
+			used[index] = true;
+			if (addedAt[index] == 0 || misses + 1 - addedAt[index] > cacheSize)
+			{
+				misses++;
+				addedAt[index] = misses;
+			}
+		}
+
+		const size_t numUsed{ (size_t)std::count(used.begin(), used.end(), true) };
+		stats.acmr = misses / (float)(indices.size() / 3);
+		stats.atvr = misses / (float)std::max<size_t>(1, numUsed);
+		return stats;
+	}
+
+	// Reorders triangles so recently used vertices are reused while still in the cache
+	void OptimiseVertexCache(std::vector<unsigned int>& indices, size_t numVertices)
+	{
+		const size_t numTriangles{ indices.size() / 3 };
+		if (numTriangles == 0)
+			return;
+
+		// Triangles using each vertex, as offsets into one shared array
+		std::vector<unsigned int> activeTriangles(numVertices, 0);
+		for (unsigned int index : indices)
+			activeTriangles[index]++;
+
+		std::vector<unsigned int> triangleOffsets(numVertices + 1, 0);
+		for (size_t v = 0; v < numVertices; v++)
+			triangleOffsets[v + 1] = triangleOffsets[v] + activeTriangles[v];
+
+		std::vector<unsigned int> vertexTriangles(indices.size());
+		std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			vertexTriangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+		std::vector<int> cachePosition(numVertices, -1);
+		std::vector<float> vertexScore(numVertices);
+		for (size_t v = 0; v < numVertices; v++)
+			vertexScore[v] = VertexScore(-1, activeTriangles[v]);
+
+		std::vector<float> triangleScore(numTriangles);
+		for (size_t t = 0; t < numTriangles; t++)
+			triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+		std::vector<bool> emitted(numTriangles, false);
+		std::vector<unsigned int> output;
+		output.reserve(indices.size());
+
+		// Three extra slots hold the vertices pushed out by the latest triangle while scores are updated
+		std::vector<unsigned int> cache;
+		cache.reserve(KForsythCacheSize + 3);
+
+		size_t scanCursor{ 0 };
+		int bestTriangle{ -1 };
+		float bestScore{ -1.0f };
+		for (size_t emittedCount = 0; emittedCount < numTriangles; emittedCount++)
+		{
+			// Nothing good in the cache, take the best remaining triangle
+			if (bestTriangle < 0)
+			{
+				bestScore = -1.0f;
+				for (size_t t = scanCursor; t < numTriangles; t++)
+				{
+					if (!emitted[t] && triangleScore[t] > bestScore)
+					{
+						bestScore = triangleScore[t];
+						bestTriangle = (int)t;
+					}
+				}
+				while (scanCursor < numTriangles && emitted[scanCursor])
+					scanCursor++;
+			}
+
+			emitted[bestTriangle] = true;
+			const unsigned int* triangle{ &indices[(size_t)bestTriangle * 3] };
+			output.insert(output.end(), triangle, triangle + 3);
+
+			// Remove the triangle from its vertices' lists and move them to the front of the cache
+			for (int c = 0; c < 3; c++)
+			{
+				const unsigned int vertex{ triangle[c] };
+				unsigned int* begin{ &vertexTriangles[triangleOffsets[vertex]] };
+				unsigned int* end{ begin + activeTriangles[vertex] };
+				std::iter_swap(std::find(begin, end, (unsigned int)bestTriangle), end - 1);
+				activeTriangles[vertex]--;
+
+				auto cached{ std::find(cache.begin(), cache.end(), vertex) };
+				if (cached != cache.end())
+					cache.erase(cached);
+			}
+			cache.insert(cache.begin(), triangle, triangle + 3);
+
+			// Rescore everything in the cache and pick the next triangle from theirs
+			for (size_t c = 0; c < cache.size(); c++)
+			{
+				const unsigned int vertex{ cache[c] };
+				cachePosition[vertex] = c < KForsythCacheSize ? (int)c : -1;
+				vertexScore[vertex] = VertexScore(cachePosition[vertex], activeTriangles[vertex]);
+			}
+
+			bestTriangle = -1;
+			bestScore = -1.0f;
+			for (const unsigned int vertex : cache)
+			{
+				const unsigned int* vertexTriangle{ &vertexTriangles[triangleOffsets[vertex]] };
+				for (unsigned int i = 0; i < activeTriangles[vertex]; i++)
+				{
+					const unsigned int t{ vertexTriangle[i] };
+					const float score{ vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]] };
+					triangleScore[t] = score;
+					if (score > bestScore)
+					{
+						bestScore = score;
+						bestTriangle = (int)t;
+					}
+				}
+			}
+
+			if (cache.size() > KForsythCacheSize)
+				cache.resize(KForsythCacheSize);
+		}
+
+		indices.swap(output);
+	}
+
+	// Reorders runs of triangles so those facing out from the mesh centre draw first
+	void OptimiseOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions)
+	{
+		const size_t numTriangles{ indices.size() / 3 };
+		if (numTriangles == 0)
+			return;
+
+		// Split wherever a triangle misses the cache on all three vertices, nothing is lost by reordering there
+		struct Cluster
+		{
+			size_t firstTriangle;
+			size_t numTriangles;
+			float sortKey;
+		};
+		std::vector<Cluster> clusters;
+
+		const size_t cacheSize{ 16 };
+		std::vector<size_t> addedAt(positions.size(), 0);
+		size_t misses{ 0 };
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			int triangleMisses{ 0 };
+			for (int c = 0; c < 3; c++)
+			{
+				const unsigned int index{ indices[t * 3 + c] };
+				if (addedAt[index] == 0 || misses + 1 - addedAt[index] > cacheSize)
+				{
+					misses++;
+					addedAt[index] = misses;
+					triangleMisses++;
+				}
+			}
+
+			if (clusters.empty() || triangleMisses == 3)
+				clusters.push_back(Cluster{ t, 0, 0 });
+			clusters.back().numTriangles++;
+		}
+
+		if (clusters.size() < 2)
+			return;
+
+		glm::vec3 meshCentre{ 0 };
+		for (const glm::vec3& position : positions)
+			meshCentre += position;
+		meshCentre /= (float)positions.size();
+
+		// Area weighted centre and normal of each cluster, outward facing clusters get the higher key
+		for (Cluster& cluster : clusters)
+		{
+			glm::vec3 centre{ 0 };
+			glm::vec3 normal{ 0 };
+			float area{ 0 };
+			for (size_t t = cluster.firstTriangle; t < cluster.firstTriangle + cluster.numTriangles; t++)
+			{
+				const glm::vec3& a{ positions[indices[t * 3]] };
+				const glm::vec3& b{ positions[indices[t * 3 + 1]] };
+				const glm::vec3& c{ positions[indices[t * 3 + 2]] };
+				const glm::vec3 weightedNormal{ glm::cross(b - a, c - a) };
+				const float triangleArea{ glm::length(weightedNormal) };
+				centre += (a + b + c) * (triangleArea / 3.0f);
+				normal += weightedNormal;
+				area += triangleArea;
+			}
+
+			if (area > 0)
+				centre /= area;
+			const float normalLength{ glm::length(normal) };
+			cluster.sortKey = normalLength > 0 ? glm::dot(centre - meshCentre, normal / normalLength) : 0;
+		}
+
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+		std::vector<unsigned int> output;
+		output.reserve(indices.size());
+		for (const Cluster& cluster : clusters)
+			output.insert(output.end(), indices.begin() + cluster.firstTriangle * 3, indices.begin() + (cluster.firstTriangle + cluster.numTriangles) * 3);
+		indices.swap(output);
+	}
+
+	// Renumbers vertices in the order the indices first use them
+	size_t OptimiseVertexFetch(std::vector<unsigned int>& indices, size_t numVertices, std::vector<unsigned int>& remap)
+	{
+		remap.assign(numVertices, ~0u);
+		unsigned int nextVertex{ 0 };
+		for (unsigned int& index : indices)
+		{
+			if (remap[index] == ~0u)
+				remap[index] = nextVertex++;
+			index = remap[index];
+		}
+		return nextVertex;
+	}
+
+	// All three passes on a loaded mesh, reordering its elements and vertex attributes
+	IndexOptimisationReport OptimiseMesh(Mesh& mesh)
+	{
+		IndexOptimisationReport report;
+		report.verticesBefore = mesh.vertices.size();
+		report.before = AnalyseVertexCache(mesh.elements, mesh.vertices.size());
+
+		OptimiseVertexCache(mesh.elements, mesh.vertices.size());
+		OptimiseOverdraw(mesh.elements, mesh.vertices);
+
+		std::vector<unsigned int> remap;
+		const size_t numUsed{ OptimiseVertexFetch(mesh.elements, mesh.vertices.size(), remap) };
+		RemapVertexAttribute(mesh.vertices, remap, numUsed);
+		RemapVertexAttribute(mesh.normals, remap, numUsed);
+		RemapVertexAttribute(mesh.uvCoords, remap, numUsed);
+		RemapVertexAttribute(mesh.boneIndices, remap, numUsed);
+		RemapVertexAttribute(mesh.boneWeights, remap, numUsed);
+
+		report.verticesAfter = mesh.vertices.size();
+		report.after = AnalyseVertexCache(mesh.elements, mesh.vertices.size());
+		return report;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+// Reorders triangle lists for the GPU's post transform vertex cache, overdraw and vertex fetch
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	struct Mesh;
+
+	// Simulated post transform cache behaviour of a triangle list
+	// acmr is vertices transformed per triangle (0.5 to 3, lower is better)
+	// atvr is vertices transformed per vertex used (1 is ideal)
+	struct VertexCacheStats
+	{
+		float acmr{ 0 };
+		float atvr{ 0 };
+	};
+
+	// Before and after figures from OptimiseMesh
+	struct IndexOptimisationReport
+	{
+		VertexCacheStats before;
+		VertexCacheStats after;
+		size_t verticesBefore{ 0 };
+		size_t verticesAfter{ 0 };
+	};
+
+	// Runs indices through a FIFO cache of cacheSize entries, as most hardware is modelled
+	VertexCacheStats AnalyseVertexCache(const std::vector<unsigned int>& indices, size_t numVertices, size_t cacheSize = 16);
+
+	// Reorders triangles so recently used vertices are reused while still in the cache, Forsyth's linear speed method
+	void OptimiseVertexCache(std::vector<unsigned int>& indices, size_t numVertices);
+
+	// Reorders runs of triangles so those facing out from the mesh centre draw first and hide what is behind them
+	// Runs are split where the cache would have been flushed anyway, so the cache order inside each run is kept
+	void OptimiseOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions);
+
+	// Renumbers vertices in the order the indices first use them, so vertex fetches walk memory forwards
+	// remap[old] is the new index, or ~0u for vertices no triangle uses. Returns the number of vertices still used.
+	size_t OptimiseVertexFetch(std::vector<unsigned int>& indices, size_t numVertices, std::vector<unsigned int>& remap);
+
+	// Moves each attribute to its remapped slot, dropping unused ones
+	template<typename T>
+	void RemapVertexAttribute(std::vector<T>& attribute, const std::vector<unsigned int>& remap, size_t numUsedVertices)
+	{
+		if (attribute.empty())
+			return;
+
+		std::vector<T> remapped(numUsedVertices);
+		for (size_t v = 0; v < attribute.size() && v < remap.size(); v++)
+		{
+			if (remap[v] != ~0u)
+				remapped[remap[v]] = attribute[v];
+		}
+		attribute.swap(remapped);
+	}
+
+	// All three passes on a loaded mesh, reordering its elements and vertex attributes
+	IndexOptimisationReport OptimiseMesh(Mesh& mesh);
+}
@@ -0,0 +1,57 @@
+#include "InstanceBuffer.h"
+
+namespace Helpers
+{
+	InstanceBuffer::~InstanceBuffer()
+	{
+		glDeleteBuffers(1, &m_buffer);
+	}
+
+	void InstanceBuffer::Create(size_t capacity)
+	{
+		if (!m_buffer)
+			glGenBuffers(1, &m_buffer);
+
+		m_capacity = std::max<size_t>(1, capacity);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+		glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// A mat4 attribute takes four locations, one column each
+	void InstanceBuffer::Attach(GLuint vao) const
+	{
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			const GLuint index{ KTransformAttribute + column };
+			glEnableVertexAttribArray(index);
+			glVertexAttribPointer(index, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(void*)(offsetof(InstanceData, transform) + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(index, 1);
+		}
+		glEnableVertexAttribArray(KTintAttribute);
+		glVertexAttribPointer(KTintAttribute, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, tint));
+		glVertexAttribDivisor(KTintAttribute, 1);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Growing reallocates the same buffer name, a smaller upload orphans the old contents so the driver need not wait on them
+	void InstanceBuffer::Upload()
+	{
+		if (m_instances.empty())
+			return;
+
+		if (!m_buffer)
+			glGenBuffers(1, &m_buffer);
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+		if (m_instances.size() > m_capacity)
+			m_capacity = std::max(m_instances.size(), m_capacity * 2);
+		glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, m_instances.size() * sizeof(InstanceData), m_instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
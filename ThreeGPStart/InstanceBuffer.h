@@ -0,0 +1,50 @@
+#pragma once
+// Per instance data for drawing many copies of a model with one instanced draw call per part
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Model matrix and tint of one instance, read by the vertex shader from attributes 5 to 8 and 9
+	struct InstanceData
+	{
+		glm::mat4 transform{ 1 };
+		glm::vec4 tint{ 1 };
+	};
+
+	// Instances are pushed on the CPU then copied up in one go, the buffer keeps its name when it grows
+	// so vertex arrays it is attached to stay valid
+	class InstanceBuffer
+	{
+	private:
+		GLuint m_buffer{ 0 };
+		size_t m_capacity{ 0 };
+		std::vector<InstanceData> m_instances;
+	public:
+		static constexpr GLuint KTransformAttribute{ 5 };
+		static constexpr GLuint KTintAttribute{ 9 };
+
+		InstanceBuffer() = default;
+		~InstanceBuffer();
+		InstanceBuffer(const InstanceBuffer&) = delete;
+		InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+		// Starting size in instances
+		void Create(size_t capacity);
+
+		// Points the instance attributes of the vertex array at this buffer, advancing once per instance
+		// Draws that are not instanced read the first instance
+		void Attach(GLuint vao) const;
+
+		void Clear() { m_instances.clear(); }
+		void Resize(size_t count) { m_instances.resize(count); }
+		void Add(const glm::mat4& transform, const glm::vec4& tint = glm::vec4(1)) { m_instances.push_back(InstanceData{ transform, tint }); }
+		InstanceData& operator[](size_t index) { return m_instances[index]; }
+		const InstanceData& operator[](size_t index) const { return m_instances[index]; }
+
+		// Copies every instance to the GPU, growing the buffer if needed
+		void Upload();
+
+		size_t Size() const { return m_instances.size(); }
+	};
+}
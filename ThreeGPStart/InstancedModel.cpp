@@ -0,0 +1,164 @@
+#include "InstancedModel.h"
+#include "Frustum.h"
+#include "MeshSimplifier.h"
+#include "Parallel.h"
+
+namespace Helpers
+{
+	// Culling and level choice per instance is cheap, so only big crowds are split across threads
+	static constexpr size_t KMinInstancesPerThread{ 4096 };
+
+	InstancedModel::~InstancedModel()
+	{
+		glDeleteVertexArrays(1, &m_vao);
+	}
+
+	// The instance attributes stay attached, only the arena's buffers are replaced when it grows
+	void InstancedModel::Create(const GeometryArena& arena)
+	{
+		m_arena = &arena;
+		m_parts.clear();
+		m_levelErrors.clear();
+		m_instances.clear();
+
+		if (!m_vao)
+			glGenVertexArrays(1, &m_vao);
+		m_arena->AttachBuffers(m_vao);
+		m_arenaGeneration = m_arena->Generation();
+		m_drawInstances.Create(1);
+		m_drawInstances.Attach(m_vao);
+	}
+
+	// A part with fewer levels than another draws its coarsest for the rest
+	void InstancedModel::AddPart(const InstancedModelPart& part)
+	{
+		if (part.lodCount.empty() || part.lodFirst.size() != part.lodCount.size())
+			return;
+		m_parts.push_back(part);
+
+		size_t numLevels{ 0 };
+		for (const InstancedModelPart& existing : m_parts)
+			numLevels = std::max(numLevels, existing.lodCount.size());
+		m_levelErrors.assign(std::min(numLevels, (size_t)KCulled), 0.0f);
+		for (size_t level = 0; level < m_levelErrors.size(); level++)
+		{
+			for (const InstancedModelPart& existing : m_parts)
+			{
+				if (!existing.lodErrors.empty())
+					m_levelErrors[level] = std::max(m_levelErrors[level], existing.lodErrors[std::min(level, existing.lodErrors.size() - 1)]);
+			}
+		}
+	}
+
+	// Counting sort of the visible instances by level into the instance buffer
+	void InstancedModel::SelectInstances(const glm::mat4& combined_xform, const glm::vec3& viewer, float pixelsPerUnit, float pixelError)
+	{
+		Frustum frustum;
+		frustum.Extract(combined_xform);
+
+		m_instanceLevels.resize(m_instances.size());
+		ParallelFor(m_instances.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				if (!m_bounds.valid)
+				{
+					m_instanceLevels[i] = 0;
+					continue;
+				}
+
+				// The sphere grows with the largest scale of the transform
+				const glm::mat4& transform{ m_instances[i].transform };
+				const glm::vec3 centre{ transform * glm::vec4(m_bounds.centre, 1.0f) };
+				const float scale{ std::max(glm::length(glm::vec3(transform[0])),
+					std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])))) };
+				const float radius{ m_bounds.radius * scale };
+				if (frustum.ClassifySphere(centre, radius) == Frustum::Result::Outside)
+				{
+					m_instanceLevels[i] = KCulled;
+					continue;
+				}
+
+				const float distance{ std::max(0.0f, glm::distance(viewer, centre) - radius) };
+				m_instanceLevels[i] = (uint8_t)SelectLod(m_levelErrors, distance, pixelsPerUnit, pixelError);
+			}
+		}, KMinInstancesPerThread);
+
+		m_levelCount.assign(m_levelErrors.size(), 0);
+		for (uint8_t level : m_instanceLevels)
+		{
+			if (level != KCulled)
+				m_levelCount[level]++;
+		}
+		m_levelFirst.assign(m_levelErrors.size(), 0);
+		for (size_t level = 1; level < m_levelFirst.size(); level++)
+			m_levelFirst[level] = m_levelFirst[level - 1] + m_levelCount[level - 1];
+
+		const size_t numVisible{ m_levelErrors.empty() ? 0 : (size_t)m_levelFirst.back() + m_levelCount.back() };
+		m_drawInstances.Resize(numVisible);
+		std::vector<GLuint> next{ m_levelFirst };
+		for (size_t i = 0; i < m_instances.size(); i++)
+		{
+			if (m_instanceLevels[i] != KCulled)
+				m_drawInstances[next[m_instanceLevels[i]]++] = m_instances[i];
+		}
+		m_drawInstances.Upload();
+		m_instancesDrawn = (int)numVisible;
+	}
+
+	// Non instanced draws still go through the instance attributes, one instance at a time, so both ways draw the same
+	int InstancedModel::Draw(GLuint program, const glm::mat4& combined_xform, const glm::vec3& viewer, float pixelsPerUnit,
+		float pixelError, bool instanced)
+	{
+		m_instancesDrawn = 0;
+		if (!m_arena || Empty())
+			return 0;
+
+		if (m_arenaGeneration != m_arena->Generation())
+		{
+			m_arena->AttachBuffers(m_vao);
+			m_arenaGeneration = m_arena->Generation();
+		}
+
+		SelectInstances(combined_xform, viewer, pixelsPerUnit, pixelError);
+		if (m_instancesDrawn == 0)
+			return 0;
+
+		glUseProgram(program);
+		glUniformMatrix4fv(glGetUniformLocation(program, "combined_xform"), 1, GL_FALSE, glm::value_ptr(combined_xform));
+		const glm::mat4 identity{ 1 };
+		glUniformMatrix4fv(glGetUniformLocation(program, "model_xform"), 1, GL_FALSE, glm::value_ptr(identity));
+		glUniform1i(glGetUniformLocation(program, "sampler_tex"), 0);
+		glBindVertexArray(m_vao);
+
+		int drawCalls{ 0 };
+		for (size_t level = 0; level < m_levelCount.size(); level++)
+		{
+			if (m_levelCount[level] == 0)
+				continue;
+
+			for (const InstancedModelPart& part : m_parts)
+			{
+				const size_t lod{ std::min(level, part.lodCount.size() - 1) };
+				const void* firstIndex{ (void*)((part.allocation.firstIndex + part.lodFirst[lod]) * sizeof(GLuint)) };
+				glBindTexture(GL_TEXTURE_2D, part.texture);
+				if (instanced)
+				{
+					glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, part.lodCount[lod], GL_UNSIGNED_INT, firstIndex,
+						m_levelCount[level], part.allocation.baseVertex, m_levelFirst[level]);
+					drawCalls++;
+					continue;
+				}
+
+				for (GLuint instance = m_levelFirst[level]; instance < m_levelFirst[level] + m_levelCount[level]; instance++)
+				{
+					glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, part.lodCount[lod], GL_UNSIGNED_INT, firstIndex,
+						1, part.allocation.baseVertex, instance);
+					drawCalls++;
+				}
+			}
+		}
+		glBindVertexArray(0);
+		return drawCalls;
+	}
+}
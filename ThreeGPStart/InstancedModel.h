@@ -0,0 +1,83 @@
+#pragma once
+// A model registered once in a geometry arena and drawn as many instances, each culled and given its own level of detail
+
+#include "ExternalLibraryHeaders.h"
+#include "GeometryArena.h"
+#include "InstanceBuffer.h"
+#include "MeshBounds.h"
+
+namespace Helpers
+{
+	// One mesh of the model, its levels of detail most detailed first with elements relative to the allocation's first index
+	struct InstancedModelPart
+	{
+		ArenaAllocation allocation;
+		GLuint texture{ 0 };
+		std::vector<GLuint> lodFirst;
+		std::vector<GLuint> lodCount;
+		std::vector<float> lodErrors;
+	};
+
+	// Instances are placed on the CPU and kept there. Each draw culls them against the view, picks each one's level of detail
+	// and copies the visible ones into the instance buffer grouped by level, so each part takes one draw per level in use.
+	// The model has its own vertex array over the arena's buffers so its instances do not disturb other draws from the arena.
+	class InstancedModel
+	{
+	private:
+		const GeometryArena* m_arena{ nullptr };
+		GLuint m_vao{ 0 };
+		size_t m_arenaGeneration{ 0 };
+
+		std::vector<InstancedModelPart> m_parts;
+
+		// Model space bounds of every part, and the worst error of any part at each level
+		MeshBounds m_bounds;
+		std::vector<float> m_levelErrors;
+
+		std::vector<InstanceData> m_instances;
+
+		// Level of each instance this draw, or KCulled, then where each level's instances start in the instance buffer
+		static constexpr uint8_t KCulled{ 0xff };
+		std::vector<uint8_t> m_instanceLevels;
+		std::vector<GLuint> m_levelFirst;
+		std::vector<GLuint> m_levelCount;
+		InstanceBuffer m_drawInstances;
+
+		int m_instancesDrawn{ 0 };
+
+		void SelectInstances(const glm::mat4& combined_xform, const glm::vec3& viewer, float pixelsPerUnit, float pixelError);
+	public:
+		InstancedModel() = default;
+		~InstancedModel();
+		InstancedModel(const InstancedModel&) = delete;
+		InstancedModel& operator=(const InstancedModel&) = delete;
+
+		// Parts are drawn from the arena's buffers, so it must outlive the model
+		void Create(const GeometryArena& arena);
+
+		// The part's texture is not owned, whoever registers it keeps it alive
+		void AddPart(const InstancedModelPart& part);
+
+		// Model space bounds, used to cull and to judge distance. Without them nothing is culled and every level is full detail.
+		void SetBounds(const MeshBounds& bounds) { m_bounds = bounds; }
+
+		void ClearInstances() { m_instances.clear(); }
+		void ResizeInstances(size_t count) { m_instances.resize(count); }
+		void AddInstance(const glm::mat4& transform, const glm::vec4& tint = glm::vec4(1)) { m_instances.push_back(InstanceData{ transform, tint }); }
+		InstanceData& operator[](size_t index) { return m_instances[index]; }
+		const InstanceData& operator[](size_t index) const { return m_instances[index]; }
+		size_t NumInstances() const { return m_instances.size(); }
+		size_t NumParts() const { return m_parts.size(); }
+		bool Empty() const { return m_parts.empty() || m_instances.empty(); }
+
+		// Draws the instances seen through combined_xform with program, which must read the instance attributes
+		// Levels are chosen as SelectLod does, from the nearest each instance's bounding sphere gets to the viewer
+		// Instanced draws take one call per part per level, otherwise there is a call per part per instance as a comparison
+		// Returns the number of draw calls
+		int Draw(GLuint program, const glm::mat4& combined_xform, const glm::vec3& viewer, float pixelsPerUnit, float pixelError,
+			bool instanced = true);
+
+		// Instances that passed culling in the last draw
+		int InstancesDrawn() const { return m_instancesDrawn; }
+	};
+}
@@ -0,0 +1,60 @@
+#include "MappedFile.h"
+
+namespace Helpers
+{
+	// Maps the whole file, returns false on error
+	bool MappedFile::Open(const std::string& filepath, bool randomAccess)
+	{
+		Close();
+
+		const DWORD flags{ (DWORD)FILE_ATTRIBUTE_NORMAL | (randomAccess ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN) };
+		m_file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE)
+		{
+			std::cout << "MappedFile could not open: " << filepath << std::endl;
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_mapping)
+		{
+			std::cout << "MappedFile could not map: " << filepath << std::endl;
+			Close();
+			return false;
+		}
+
+		m_data = (const BYTE*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!m_data)
+		{
+			std::cout << "MappedFile could not view: " << filepath << std::endl;
+			Close();
+			return false;
+		}
+
+		m_size = (size_t)size.QuadPart;
+		return true;
+	}
+
+	// Unmaps the file, safe to call when not open
+	void MappedFile::Close()
+	{
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+
+		m_data = nullptr;
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+		m_size = 0;
+	}
+}
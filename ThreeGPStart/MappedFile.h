@@ -0,0 +1,35 @@
+#pragma once
+// Read only memory mapping of a whole file
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Maps a file into the address space so it can be read like memory, pages are only read from disk when touched
+	class MappedFile
+	{
+	private:
+		HANDLE m_file{ INVALID_HANDLE_VALUE };
+		HANDLE m_mapping{ nullptr };
+		const BYTE* m_data{ nullptr };
+		size_t m_size{ 0 };
+	public:
+		MappedFile() = default;
+		~MappedFile() { Close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Maps the whole file, returns false on error. randomAccess hints that reads will jump around the file.
+		bool Open(const std::string& filepath, bool randomAccess = false);
+
+		// Unmaps the file, safe to call when not open
+		void Close();
+
+		bool IsOpen() const { return m_data != nullptr; }
+
+		// Start of the mapped bytes and how many there are
+		const BYTE* GetData() const { return m_data; }
+		size_t Size() const { return m_size; }
+	};
+}
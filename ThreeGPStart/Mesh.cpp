@@ -1,10 +1,17 @@
 #include "Mesh.h"
+#include "MeshSimplifier.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <chrono>
 //#include <math.h>
 //#define VERBOSE
 
-#define M_PI 3.14159265358979323846264338327950288
 #define EsAssert assert
 
+// Meshes with fewer faces than this are not worth splitting over threads
+static constexpr size_t KMinFacesPerThread{ 65536 };
+
 namespace Helpers
 {
 	// Conversions from ASSIMP types
@@ -25,81 +32,194 @@ namespace Helpers
 		return to;
 	}
 
-	// x is roll, y is pitch, z is yaw
-	glm::vec3 aiQuaternionToEulerAngles(aiQuaternion q) {
-		glm::vec3 angles;
-
-		// roll (x-axis rotation)
-		double sinr_cosp = 2 * (double)(q.w * (double)q.x + q.y * (double)q.z);
-		double cosr_cosp = 1 - 2 * (double)((double)q.x * q.x + (double)q.y * q.y);
-		angles.x = (float)std::atan2(sinr_cosp, cosr_cosp);
-
-		// pitch (y-axis rotation)
-		double sinp = 2 * (double)((double)q.w * q.y - (double)q.z * q.x);
-		if (std::abs(sinp) >= 1)
-			angles.y = (float)std::copysign(M_PI / 2, sinp); // use 90 degrees if out of range
-		else
-			angles.y = (float)std::asin(sinp);
-
-		// yaw (z-axis rotation)
-		double siny_cosp = 2 * (double)((double)q.w * q.z + (double)q.x * q.y);
-		double cosy_cosp = 1 - 2 * (double)((double)q.y * q.y + (double)q.z * q.z);
-		angles.z = (float)std::atan2(siny_cosp, cosy_cosp);
-
-		return angles;
+	// Attributes not held for every vertex are left out
+	VertexStreams Mesh::GetVertexStreams() const
+	{
+		VertexStreams streams;
+		streams.numVertices = vertices.size();
+		streams.vertices = vertices.data();
+		streams.normals = normals.size() == vertices.size() ? normals.data() : nullptr;
+		streams.uvCoords = uvCoords.size() == vertices.size() ? uvCoords.data() : nullptr;
+		if (boneIndices.size() == vertices.size() && boneWeights.size() == vertices.size())
+		{
+			streams.boneIndices = boneIndices.data();
+			streams.boneWeights = boneWeights.data();
+		}
+		return streams;
 	}
 
 	// Retrieve the dimensions of this mesh in local coordinates
+	// Mesh built by hand rather than loaded may not have bounds yet so are scanned
 	void Mesh::GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const
 	{
-		if (vertices.empty())
+		if (!bounds.valid)
+		{
+			ComputeBox(vertices.data(), vertices.size(), minExtents, maxExtents);
 			return;
+		}
 
-		minExtents.x = maxExtents.x = vertices[0].x;
-		minExtents.y = maxExtents.y = vertices[0].y;
-		minExtents.z = maxExtents.z = vertices[0].z;
+		minExtents = bounds.boxMin;
+		maxExtents = bounds.boxMax;
+	}
 
-		for (size_t i = 1; i < vertices.size(); i++)
+	// Steps every profile needs: a face is always a 3 vertex triangle, there are normals and FBX is in metres
+	static constexpr unsigned int KPreviewSteps{ aiProcess_Triangulate |	// triangulate polygons with more than 3 edges
+		aiProcess_SortByPType |				// make 'clean' meshes which consist of a single typ of primitives
+		aiProcess_GenSmoothNormals |		// if no normals then create them
+		aiProcess_GlobalScale };			// KD: Needed for FBX which uses cm rather than metres
+
+	// Commom post processing steps - may slow load but make mesh better optimised
+	// Tangents are not used by any shader so are not calculated
+	static constexpr unsigned int KFullQualitySteps{ KPreviewSteps |
+		aiProcess_JoinIdenticalVertices |				// join identical vertices/ optimize indexing
+		aiProcess_ImproveCacheLocality |				// improve the cache locality of the output vertices
+		aiProcess_RemoveRedundantMaterials |			// remove redundant materials
+		aiProcess_FindDegenerates |						// remove degenerated polygons from the import
+		aiProcess_FindInvalidData |						// detect invalid model data, such as invalid normal vectors
+		aiProcess_GenUVCoords |							// convert spherical, cylindrical, box and planar mapping to proper UVs
+		aiProcess_TransformUVCoords |					// preprocess UV transformations (scaling, translation ...)
+		aiProcess_FindInstances |						// search for instanced meshes and remove them by references to one master
+		aiProcess_LimitBoneWeights |					// limit bone weights to 4 per vertex
+		aiProcess_OptimizeMeshes |						// join small meshes, if possible;
+		aiProcess_SplitByBoneCount |					// split meshes with too many bones.
+		aiProcess_SplitLargeMeshes };					// split large, unrenderable meshes into submeshes
+
+	static constexpr unsigned int KCookSteps{ KFullQualitySteps |
+		aiProcess_ValidateDataStructure };				// perform a full validation of the loader's output
+
+	// Post processing flags of a profile
+	unsigned int ImportProfileFlags(ImportProfile profile)
+	{
+		switch (profile)
 		{
-			minExtents.x = std::min(minExtents.x, vertices[i].x);
-			minExtents.y = std::min(minExtents.y, vertices[i].y);
-			minExtents.z = std::min(minExtents.z, vertices[i].z);
+		case ImportProfile::FastPreview:
+			return KPreviewSteps;
+		case ImportProfile::CookForCache:
+			return KCookSteps;
+		default:
+			return KFullQualitySteps;
+		}
+	}
 
-			maxExtents.x = std::max(maxExtents.x, vertices[i].x);
-			maxExtents.y = std::max(maxExtents.y, vertices[i].y);
-			maxExtents.z = std::max(maxExtents.z, vertices[i].z);
+	const char* ImportProfileName(ImportProfile profile)
+	{
+		switch (profile)
+		{
+		case ImportProfile::FastPreview:
+			return "Fast preview";
+		case ImportProfile::CookForCache:
+			return "Cook for cache";
+		default:
+			return "Full quality";
 		}
 	}
 
+	// Post processing steps in the order ASSIMP runs them when they are all passed to ReadFile
+	static const struct
+	{
+		unsigned int flag;
+		const char* name;
+	} KPostProcessOrder[] =
+	{
+		{ aiProcess_ValidateDataStructure, "Validate data structure" },
+		{ aiProcess_RemoveRedundantMaterials, "Remove redundant materials" },
+		{ aiProcess_FindInstances, "Find instances" },
+		{ aiProcess_OptimizeMeshes, "Optimize meshes" },
+		{ aiProcess_FindDegenerates, "Find degenerates" },
+		{ aiProcess_GenUVCoords, "Generate UV coords" },
+		{ aiProcess_TransformUVCoords, "Transform UV coords" },
+		{ aiProcess_GlobalScale, "Global scale" },
+		{ aiProcess_Triangulate, "Triangulate" },
+		{ aiProcess_SortByPType, "Sort by primitive type" },
+		{ aiProcess_FindInvalidData, "Find invalid data" },
+		{ aiProcess_SplitByBoneCount, "Split by bone count" },
+		{ aiProcess_GenSmoothNormals, "Generate smooth normals" },
+		{ aiProcess_CalcTangentSpace, "Calculate tangent space" },
+		{ aiProcess_JoinIdenticalVertices, "Join identical vertices" },
+		{ aiProcess_SplitLargeMeshes, "Split large meshes" },
+		{ aiProcess_LimitBoneWeights, "Limit bone weights" },
+		{ aiProcess_ImproveCacheLocality, "Improve cache locality" },
+	};
+
+	static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Runs the steps one at a time so each can be timed, nullptr if one fails
+	const aiScene* ModelLoader::ApplyPostProcessSteps(Assimp::Importer& importer, unsigned int ppsteps)
+	{
+		const aiScene* scene{ importer.GetScene() };
+		for (const auto& step : KPostProcessOrder)
+		{
+			if (!scene || !(ppsteps & step.flag))
+				continue;
+
+			const auto start{ std::chrono::high_resolution_clock::now() };
+			scene = importer.ApplyPostProcessing(step.flag);
+			m_importReport.steps.push_back(ImportStepTiming{ step.name, MillisecondsSince(start) });
+			ppsteps &= ~step.flag;
+		}
+
+		// Anything not in the table is run together at the end
+		if (scene && ppsteps)
+		{
+			const auto start{ std::chrono::high_resolution_clock::now() };
+			scene = importer.ApplyPostProcessing(ppsteps);
+			m_importReport.steps.push_back(ImportStepTiming{ "Other steps", MillisecondsSince(start) });
+		}
+
+		return scene;
+	}
+
 	// Load a 3D model form a provided file and path, return false on error
-	bool ModelLoader::LoadFromFile(const std::string& objFilename)
+	bool ModelLoader::LoadFromFile(const std::string& objFilename, ImportProfile profile, bool cook)
 	{
 		m_filename = objFilename;
 
 #if defined(VERBOSE)
 		std::cout << "\nUsing assimp to load: " << objFilename << std::endl;
 #endif
-		// Commom post processing steps - may slow load but make mesh better optimised
-		unsigned int ppsteps = aiProcess_CalcTangentSpace | // calculate tangents and bitangents if possible
-			aiProcess_JoinIdenticalVertices |				// join identical vertices/ optimize indexing
-			aiProcess_ValidateDataStructure |				// perform a full validation of the loader's output
-			aiProcess_ImproveCacheLocality |				// improve the cache locality of the output vertices
-			aiProcess_RemoveRedundantMaterials |			// remove redundant materials
-			aiProcess_FindDegenerates |						// remove degenerated polygons from the import
-			aiProcess_FindInvalidData |						// detect invalid model data, such as invalid normal vectors
-			aiProcess_GenUVCoords |							// convert spherical, cylindrical, box and planar mapping to proper UVs
-			aiProcess_TransformUVCoords |					// preprocess UV transformations (scaling, translation ...)
-			aiProcess_FindInstances |						// search for instanced meshes and remove them by references to one master
-			aiProcess_LimitBoneWeights |					// limit bone weights to 4 per vertex
-			aiProcess_OptimizeMeshes |						// join small meshes, if possible;
-			aiProcess_SplitByBoneCount |					// split meshes with too many bones.
-			aiProcess_GenSmoothNormals |					// generate smooth normal vectors if not existing
-			aiProcess_SplitLargeMeshes |					// split large, unrenderable meshes into submeshes
-			aiProcess_Triangulate |							// triangulate polygons with more than 3 edges
-			aiProcess_SortByPType |							// make 'clean' meshes which consist of a single typ of primitives
-			aiProcess_GenSmoothNormals |					// if no normals then create them
-			aiProcess_GlobalScale |							// KD: Needed for FBX which uses cm rather than metres
-			0;
+		const unsigned int ppsteps{ ImportProfileFlags(profile) };
+
+		const auto loadStart{ std::chrono::high_resolution_clock::now() };
+		m_importReport = ImportReport();
+		m_importReport.profile = profile;
+
+		// Warm start straight from the cache when it was made from this exact file with at least these steps
+		m_nodes.clear();
+		m_nodeLookup.clear();
+		m_meshVector.clear();
+		m_materials.clear();
+		m_animationDuration = 0;
+		m_nodeBounds.clear();
+		m_indexReports.clear();
+
+		auto stepStart{ std::chrono::high_resolution_clock::now() };
+		uint64_t sourceHash{ 0 };
+		if (!HashFile(objFilename, sourceHash))
+		{
+			std::cout << "Could not read: " << objFilename << std::endl;
+			return false;
+		}
+		m_importReport.steps.push_back(ImportStepTiming{ "Hash source", MillisecondsSince(stepStart) });
+
+		const std::string cachePath{ MeshCache::CachePath(objFilename) };
+		stepStart = std::chrono::high_resolution_clock::now();
+		if (m_cache.Open(cachePath, sourceHash, ppsteps, cook))
+		{
+			if (PopulateFromCache(cook))
+			{
+				m_importReport.steps.push_back(ImportStepTiming{ "Read cache", MillisecondsSince(stepStart) });
+				stepStart = std::chrono::high_resolution_clock::now();
+				ComputeNodeBounds();
+				m_importReport.steps.push_back(ImportStepTiming{ "Bounds", MillisecondsSince(stepStart) });
+				m_importReport.fromCache = true;
+				m_importReport.totalMilliseconds = MillisecondsSince(loadStart);
+				return true;
+			}
+			m_cache.Close();
+		}
 
 		// Create an instance of the Importer class
 		Assimp::Importer importer;
@@ -110,13 +230,21 @@ namespace Helpers
 
 		// By removing all points and lines we guarantee a face will describe a 3 vertex triangle
 		importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_LINE | aiPrimitiveType_POINT);
-		importer.SetPropertyInteger(AI_CONFIG_GLOB_MEASURE_TIME, 1);
+
+		// Degenerate triangles are dropped outright rather than left as lines and points for the step above
+		if (profile == ImportProfile::CookForCache)
+			importer.SetPropertyBool(AI_CONFIG_PP_FD_REMOVE, true);
 
 		// KD: Need to scale down FBX which uses cm rather than metres
 		if (objFilename.find(".fbx")!=std::string::npos)
 			importer.SetPropertyFloat(AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, 0.01f);
 
-		const aiScene* scene = importer.ReadFile(objFilename.c_str(), ppsteps);
+		stepStart = std::chrono::high_resolution_clock::now();
+		const aiScene* scene = importer.ReadFile(objFilename.c_str(), 0);
+		m_importReport.steps.push_back(ImportStepTiming{ "Read file", MillisecondsSince(stepStart) });
+
+		if (scene)
+			scene = ApplyPostProcessSteps(importer, ppsteps);
 
 		if (!scene)
 		{
@@ -124,7 +252,148 @@ namespace Helpers
 			return false;
 		}
 
-		return PopulateFromAssimpScene(scene);
+		stepStart = std::chrono::high_resolution_clock::now();
+		if (!PopulateFromAssimpScene(scene))
+			return false;
+		m_importReport.steps.push_back(ImportStepTiming{ "Convert", MillisecondsSince(stepStart) });
+
+		// Optimising drops unused vertices, so bounds come after
+		if (cook)
+			Cook();
+
+		stepStart = std::chrono::high_resolution_clock::now();
+		ComputeAllBounds();
+		m_importReport.steps.push_back(ImportStepTiming{ "Bounds", MillisecondsSince(stepStart) });
+
+		// Failing to write the cache only costs the next start its speed up
+		stepStart = std::chrono::high_resolution_clock::now();
+		MeshCache::Write(cachePath, sourceHash, ppsteps, m_meshVector, m_materials, m_nodes, m_animationDuration, cook, m_indexReports);
+		m_importReport.steps.push_back(ImportStepTiming{ "Write cache", MillisecondsSince(stepStart) });
+
+		m_importReport.totalMilliseconds = MillisecondsSince(loadStart);
+		return true;
+	}
+
+	// Runs the whole load, and any extra processing, on a worker thread
+	std::future<bool> ModelLoader::LoadFromFileAsync(const std::string& objFilename, ImportProfile profile, bool cook,
+		std::function<void(ModelLoader&)> onLoaded)
+	{
+		return std::async(std::launch::async, [this, objFilename, profile, cook, onLoaded]()
+		{
+			if (!LoadFromFile(objFilename, profile, cook))
+				return false;
+			if (onLoaded)
+				onLoaded(*this);
+			return true;
+		});
+	}
+
+	// Reports are kept so they can be read once the load has been handed back
+	void ModelLoader::OptimiseMeshes()
+	{
+		m_indexReports.resize(m_meshVector.size());
+		ParallelFor(m_meshVector.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				m_indexReports[i] = OptimiseMesh(m_meshVector[i]);
+		});
+	}
+
+	// Everything a renderer works out before drawing, timed into the import report
+	void ModelLoader::Cook()
+	{
+		auto stepStart{ std::chrono::high_resolution_clock::now() };
+		OptimiseMeshes();
+		m_importReport.steps.push_back(ImportStepTiming{ "Optimise", MillisecondsSince(stepStart) });
+
+		stepStart = std::chrono::high_resolution_clock::now();
+		ParallelFor(m_meshVector.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				GenerateMeshLods(m_meshVector[i]);
+		});
+		m_importReport.steps.push_back(ImportStepTiming{ "Levels of detail", MillisecondsSince(stepStart) });
+
+		stepStart = std::chrono::high_resolution_clock::now();
+		GenerateClusters();
+		m_importReport.steps.push_back(ImportStepTiming{ "Clusters", MillisecondsSince(stepStart) });
+
+		stepStart = std::chrono::high_resolution_clock::now();
+		BuildBvhs();
+		m_importReport.steps.push_back(ImportStepTiming{ "BVHs", MillisecondsSince(stepStart) });
+	}
+
+	VertexStreams ModelLoader::GetVertexStreams(size_t mesh) const
+	{
+		return IsFromCache() ? m_cache.GetVertexStreams(mesh) : m_meshVector[mesh].GetVertexStreams();
+	}
+
+	const unsigned int* ModelLoader::GetElements(size_t mesh, size_t level, size_t& count) const
+	{
+		if (IsFromCache())
+		{
+			if (level == 0)
+			{
+				count = m_cache.GetEntry(mesh).numElements;
+				return m_cache.GetElements(mesh);
+			}
+			count = m_cache.GetLod(mesh, level - 1).numElements;
+			return m_cache.GetLodElements(mesh, level - 1);
+		}
+
+		const std::vector<unsigned int>& elements{ level == 0 ? m_meshVector[mesh].elements : m_meshVector[mesh].lods[level - 1].elements };
+		count = elements.size();
+		return elements.data();
+	}
+
+	// Meshes are independent so are split in parallel
+	void ModelLoader::GenerateClusters(size_t maxVertices, size_t maxTriangles)
+	{
+		ParallelFor(m_meshVector.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				BuildMeshClusters(m_meshVector[i], maxVertices, maxTriangles);
+		});
+	}
+
+	// Each build splits itself over the pool too, which this thread helps with while it waits
+	void ModelLoader::BuildBvhs()
+	{
+		ParallelFor(m_meshVector.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				m_meshVector[i].bvh.Build(m_meshVector[i].vertices, m_meshVector[i].elements);
+		});
+	}
+
+	// Fills the meshes, materials and nodes from the open cache, false if its records are bad
+	// A cooked cache keeps the vertex data mapped, otherwise it is copied out and the cache closed
+	bool ModelLoader::PopulateFromCache(bool cooked)
+	{
+		m_cache.ReadMeshes(m_meshVector, !cooked);
+		if (!m_cache.ReadMaterials(m_materials) || !m_cache.ReadNodes(m_nodes) || !BonesInRange())
+		{
+			std::cout << "Mesh cache is corrupt, reloading: " << m_filename << std::endl;
+			m_nodes.clear();
+			m_meshVector.clear();
+			m_materials.clear();
+			return false;
+		}
+		IndexNodeNames();
+		m_animationDuration = m_cache.AnimationDuration();
+
+		if (cooked)
+		{
+			for (size_t i = 0; i < m_meshVector.size(); i++)
+				m_indexReports.push_back(m_cache.GetEntry(i).indexReport);
+		}
+		else
+		{
+			m_cache.Close();
+		}
+
+		std::cout << "Loaded OK from cache" << std::endl;
+		return true;
 	}
 
 	// Parse the ASSIMP data into our format
@@ -196,79 +465,89 @@ namespace Helpers
 #endif
 		}
 
-		int hasBones{ 0 };
 		int hasTangents{ 0 };
 		int hasColourChannels{ 0 };
 		int hasMMoreThanOneUVChannel{ 0 };
 
 		//std::cout << "Scene contains " + std::to_string(scene->mNumMeshes) + " mesh");
 
-		// ASSIMP mesh
-		// http://assimp.sourceforge.net/lib_html/structai_mesh.html
 		for (unsigned int i = 0; i < scene->mNumMeshes; i++)
 		{
-			aiMesh* aimesh = scene->mMeshes[i];
+			const aiMesh* aimesh = scene->mMeshes[i];
 
-			if (aimesh->HasBones())
-				hasBones++;
 			if (aimesh->GetNumColorChannels())
 				hasColourChannels++;
 			if (aimesh->GetNumUVChannels() > 1)
 				hasMMoreThanOneUVChannel++;
 			if (aimesh->HasTangentsAndBitangents())
 				hasTangents++;
+		}
 
-			// Create my mesh part
-			m_meshVector.push_back(Mesh());
-			Mesh& newMesh = m_meshVector.back();
-
-			newMesh.name = aimesh->mName.C_Str();
+		// ai format of a vertex is same as mine so whole arrays can be copied
+		static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "ASSIMP must be built with single precision floats");
 
-			//		std::cout << "Processing mesh with name: " + newMesh->name);
+		// Hierarchy, ASSIMP calls these nodes. Built first so bones can find their node.
+		CreateNodes(scene->mRootNode);
 
-					// Copy over all the vertices, ai format of a vertex is same as mine
-					// Probably be able to speed this all up at some point
-			for (size_t v = 0; v < aimesh->mNumVertices; v++)
+		// ASSIMP mesh
+		// http://assimp.sourceforge.net/lib_html/structai_mesh.html
+		// Each mesh only touches its own part so they are converted in parallel
+		m_meshVector.resize(scene->mNumMeshes);
+		std::atomic<int> missingBoneNodes{ 0 };
+		ParallelFor(scene->mNumMeshes, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
 			{
-				glm::vec3 newV = *(glm::vec3*) & aimesh->mVertices[v];
-				newMesh.vertices.push_back(newV);
-			}
+				const aiMesh* aimesh = scene->mMeshes[i];
+				Mesh& newMesh = m_meshVector[i];
+				const size_t numVertices{ aimesh->mNumVertices };
 
-			// And the normals if there are any
-			if (aimesh->HasNormals())
-			{
-				for (size_t v = 0; v < aimesh->mNumVertices; v++)
+				newMesh.name = aimesh->mName.C_Str();
+
+				newMesh.vertices.resize(numVertices);
+				memcpy(newMesh.vertices.data(), aimesh->mVertices, numVertices * sizeof(glm::vec3));
+
+				// And the normals if there are any
+				if (aimesh->HasNormals())
 				{
-					glm::vec3 newN = *(glm::vec3*) & aimesh->mNormals[v];
-					newMesh.normals.push_back(newN);
+					newMesh.normals.resize(numVertices);
+					memcpy(newMesh.normals.data(), aimesh->mNormals, numVertices * sizeof(glm::vec3));
 				}
-			}
 
-			// And texture coordinates
-			if (aimesh->HasTextureCoords(0))
-			{
-				for (size_t v = 0; v < aimesh->mNumVertices; v++)
+				// Texture coordinates are 3D in ASSIMP so need a strided copy
+				if (aimesh->HasTextureCoords(0))
 				{
-					glm::vec2 newN = *(glm::vec2*) &aimesh->mTextureCoords[0][v];
-					
-					newMesh.uvCoords.push_back(newN);
+					newMesh.uvCoords.resize(numVertices);
+					const aiVector3D* uvs{ aimesh->mTextureCoords[0] };
+					for (size_t v = 0; v < numVertices; v++)
+						newMesh.uvCoords[v] = glm::vec2(uvs[v].x, uvs[v].y);
 				}
-			}
 
-			// Faces contain the vertex indices and due to the flags I set before are always triangles
-			for (unsigned int face = 0; face < aimesh->mNumFaces; face++)
-			{
-				EsAssert(aimesh->mFaces[face].mNumIndices == 3);
-				for (int triInd = 0; triInd < 3; triInd++)
-					newMesh.elements.push_back(aimesh->mFaces[face].mIndices[triInd]);
+				// Faces contain the vertex indices and due to the flags I set before are always triangles
+				// Each face has its own index array, big meshes split them over threads too
+				newMesh.elements.resize((size_t)aimesh->mNumFaces * 3);
+				ParallelFor(aimesh->mNumFaces, [&](size_t faceBegin, size_t faceEnd)
+				{
+					unsigned int* elements{ &newMesh.elements[faceBegin * 3] };
+					for (size_t face = faceBegin; face < faceEnd; face++)
+					{
+						EsAssert(aimesh->mFaces[face].mNumIndices == 3);
+						const unsigned int* indices{ aimesh->mFaces[face].mIndices };
+						elements[0] = indices[0];
+						elements[1] = indices[1];
+						elements[2] = indices[2];
+						elements += 3;
+					}
+				}, KMinFacesPerThread);
+
+				if (aimesh->HasBones())
+					missingBoneNodes += ConvertBones(aimesh, (unsigned int)i, newMesh);
+
+				// Material index
+				newMesh.materialIndex = aimesh->mMaterialIndex;
 			}
-
-			// Material index
-			newMesh.materialIndex = aimesh->mMaterialIndex;
-		}
+		});
 #if defined(VERBOSE)
-		if (hasBones)
-			std::cout << "Ignoring: One or more mesh have bones" << std::endl;
 		if (hasColourChannels)
 			std::cout << "Ignoring: One or more mesh has colour channels" << std::endl;
 		if (hasMMoreThanOneUVChannel)
@@ -276,30 +555,38 @@ namespace Helpers
 		if (hasTangents)
 			std::cout << "Ignoring: One or more mesh has tangents" << std::endl;
 #endif
-		// Hierarchy, ASSIMP calls these nodes
-		m_rootNode = RecurseCreateNode(scene->mRootNode, nullptr);
+		if (missingBoneNodes)
+			std::cout << "Failed to find internal node for " << missingBoneNodes << " bones, they follow the root" << std::endl;
 
-		for (size_t i = 0; i < scene->mNumAnimations; i++)
+		// Nodes hold one set of keys so only the first animation is kept
+		if (scene->mNumAnimations)
 		{
+			const aiAnimation* animation{ scene->mAnimations[0] };
 #if defined(VERBOSE)
+			if (scene->mNumAnimations > 1)
+				std::cout << "Ignoring: all but the first animation" << std::endl;
+
 			// Only supporting node animation			
-			if (scene->mAnimations[i]->mNumMeshChannels)
+			if (animation->mNumMeshChannels)
 				std::cout << "Ignoring: mesh animations" << std::endl;
 
-			if (scene->mAnimations[i]->mNumChannels)
-				std::cout << "Animation has " + std::to_string(scene->mAnimations[i]->mNumChannels) + " Channels" << std::endl;
+			if (animation->mNumChannels)
+				std::cout << "Animation has " + std::to_string(animation->mNumChannels) + " Channels" << std::endl;
 #endif
+			// Key times are in ticks, files that leave the rate out are taken to use 25 a second as ASSIMP suggests
+			const double ticksPerSecond{ animation->mTicksPerSecond > 0 ? animation->mTicksPerSecond : 25.0 };
+			m_animationDuration = (float)(animation->mDuration / ticksPerSecond);
 
 			// Load the channel data
-			for (unsigned int k = 0; k < scene->mAnimations[i]->mNumChannels; k++)
+			for (unsigned int k = 0; k < animation->mNumChannels; k++)
 			{
-				aiNodeAnim* node = scene->mAnimations[i]->mChannels[k];
+				const aiNodeAnim* node = animation->mChannels[k];
 
 #if defined(VERBOSE)
 				std::cout << "Node: " + aiStringToString(node->mNodeName) << std::endl;
 #endif
 
-				Node* internalNode{ RecurseFindNode(m_rootNode,aiStringToString(node->mNodeName)) };
+				Node* internalNode{ FindNode(aiStringToString(node->mNodeName)) };
 				if (!internalNode)
 				{
 					std::cout << "Failed to find internal node for channel animation" << std::endl;
@@ -314,34 +601,30 @@ namespace Helpers
 
 				for (unsigned int j = 0; j < node->mNumPositionKeys; j++)
 				{
-					double time = node->mPositionKeys[j].mTime;
-					aiVector3D val=node->mPositionKeys[j].mValue;
-
-					internalNode->translationAnimationKeys.push_back(AnimationData{ (float)time, aiVector3DToGlmVec3(val) });
+					internalNode->translationKeyTimes.push_back((float)(node->mPositionKeys[j].mTime / ticksPerSecond));
+					internalNode->translationKeys.push_back(aiVector3DToGlmVec3(node->mPositionKeys[j].mValue));
 				}
 
+				// Kept as quaternions so they can be slerped
 				for (unsigned int j = 0; j < node->mNumRotationKeys; j++)
 				{
-					double time = node->mRotationKeys[j].mTime;
-					aiQuaternion val = node->mRotationKeys[j].mValue;
-
-					internalNode->translationAnimationKeys.push_back(AnimationData{ (float)time, aiQuaternionToEulerAngles(val) });					
+					const aiQuaternion& val{ node->mRotationKeys[j].mValue };
+					internalNode->rotationKeyTimes.push_back((float)(node->mRotationKeys[j].mTime / ticksPerSecond));
+					internalNode->rotationKeys.push_back(glm::quat(val.w, val.x, val.y, val.z));
 				}
 
 				for (unsigned int j = 0; j < node->mNumScalingKeys; j++)
 				{
-					double time = node->mScalingKeys[j].mTime;
-					aiVector3D val = node->mScalingKeys[j].mValue;
-
-					internalNode->translationAnimationKeys.push_back(AnimationData{ (float)time, aiVector3DToGlmVec3(val) });
-				}				
+					internalNode->scaleKeyTimes.push_back((float)(node->mScalingKeys[j].mTime / ticksPerSecond));
+					internalNode->scaleKeys.push_back(aiVector3DToGlmVec3(node->mScalingKeys[j].mValue));
+				}
 			}
 		}
 
 		std::cout << "Loaded OK" << std::endl;
 
 #if defined(VERBOSE)
-		RecurseOutputHierarchy(m_rootNode, 0);
+		OutputHierarchy();
 #endif
 
 #if defined(VERBOSE)
@@ -390,93 +673,197 @@ namespace Helpers
 		return true;
 	}
 
-	void ModelLoader::RecurseOutputHierarchy(Node* node, int depth)
+	void ModelLoader::OutputHierarchy() const
 	{
-		for (int i=0;i<depth;i++)
-			std::cout << " ";
+		// Parents come first so each depth is known by the time a child needs it
+		std::vector<int> depths(m_nodes.size(), 0);
+		for (size_t n = 0; n < m_nodes.size(); n++)
+		{
+			const Node& node{ m_nodes[n] };
+			if (node.parent >= 0)
+				depths[n] = depths[node.parent] + 1;
 
-		glm::vec3 tran = glm::vec3(node->transform[3]);
+			for (int i = 0; i < depths[n]; i++)
+				std::cout << " ";
 
-		std::cout << "Node name: " << node->name << " Trans: " << tran.x << "," << tran.y << "," << tran.z << " Mesh: ";
-		for (unsigned int m : node->meshIndices)
-			std::cout << m << " ";
-		std::cout << std::endl;
+			glm::vec3 tran = glm::vec3(node.transform[3]);
 
-		for (auto n : node->childNodes)
-			RecurseOutputHierarchy(n, depth + 1);
+			std::cout << "Node name: " << node.name << " Trans: " << tran.x << "," << tran.y << "," << tran.z << " Mesh: ";
+			for (unsigned int m : node.meshIndices)
+				std::cout << m << " ";
+			std::cout << std::endl;
+		}
 	}
 
-	Node* ModelLoader::RecurseFindNode(Node* node, const std::string& nodeName)
+	// Breadth first so parents come before children and siblings end up next to each other
+	void ModelLoader::CreateNodes(const aiNode* rootNode)
 	{
-		if (!node)
-			return nullptr;
-
-		if (node->name == nodeName)
-			return node;
+		m_nodes.clear();
 
-		Node* retVal{ nullptr };
-		for (auto child : node->childNodes)
+		std::vector<const aiNode*> sources{ rootNode };
+		m_nodes.emplace_back();
+		for (size_t n = 0; n < sources.size(); n++)
 		{
-			retVal=RecurseFindNode(child, nodeName);
-			if (retVal)
-				break;
+			const aiNode* source{ sources[n] };
+
+			// Children are appended after everything already queued so are contiguous
+			if (source->mNumChildren)
+				m_nodes[n].firstChild = (unsigned int)m_nodes.size();
+			m_nodes[n].numChildren = source->mNumChildren;
+			for (unsigned int i = 0; i < source->mNumChildren; i++)
+			{
+				sources.push_back(source->mChildren[i]);
+				m_nodes.emplace_back();
+				m_nodes.back().parent = (int)n;
+			}
+
+			Node& newNode{ m_nodes[n] };
+			newNode.name = source->mName.C_Str();
+
+			for (size_t i = 0; i < source->mNumMeshes; i++)
+				newNode.meshIndices.push_back(source->mMeshes[i]);
+
+			newNode.transform = aiMatrix4x4ToGlm(&source->mTransformation);
 		}
 
-		return retVal;
+		IndexNodeNames();
 	}
 
-	// Recursive node creation
-	Node* ModelLoader::RecurseCreateNode(aiNode* node, Node* parent)
+	// Bone weights are held per bone in ASSIMP, these go into per vertex slots keeping the strongest
+	// Returns how many bones had no node, these are left on the root
+	int ModelLoader::ConvertBones(const aiMesh* aimesh, unsigned int meshIndex, Mesh& mesh) const
 	{
-		Node* newNode = new Node;
+		const size_t numVertices{ aimesh->mNumVertices };
+		mesh.boneIndices.assign(numVertices, glm::uvec4(0));
+		mesh.boneWeights.assign(numVertices, glm::vec4(0));
+		mesh.bones.resize(aimesh->mNumBones);
+
+		// Nodes are breadth first so the first listing the mesh is the one nearest the root
+		unsigned int meshNode{ 0 };
+		for (size_t n = 0; n < m_nodes.size(); n++)
+		{
+			const std::vector<unsigned int>& meshIndices{ m_nodes[n].meshIndices };
+			if (std::find(meshIndices.begin(), meshIndices.end(), meshIndex) != meshIndices.end())
+			{
+				meshNode = (unsigned int)n;
+				break;
+			}
+		}
 
-		newNode->name = node->mName.C_Str();
-		newNode->parentNode = parent;
+		int missingNodes{ 0 };
+		for (unsigned int b = 0; b < aimesh->mNumBones; b++)
+		{
+			const aiBone* bone{ aimesh->mBones[b] };
+			const int node{ FindNodeIndex(aiStringToString(bone->mName)) };
+			if (node < 0)
+				missingNodes++;
+			mesh.bones[b].node = node < 0 ? 0 : (unsigned int)node;
+			mesh.bones[b].meshNode = meshNode;
+			mesh.bones[b].offset = aiMatrix4x4ToGlm(&bone->mOffsetMatrix);
+
+			for (unsigned int w = 0; w < bone->mNumWeights; w++)
+			{
+				const aiVertexWeight& weight{ bone->mWeights[w] };
+				if (weight.mVertexId >= numVertices)
+					continue;
 
-		for (size_t i = 0; i < node->mNumMeshes; i++)
-			newNode->meshIndices.push_back(node->mMeshes[i]);
+				// Replaces the weakest influence so far, profiles without LimitBoneWeights can have more than fit
+				glm::vec4& weights{ mesh.boneWeights[weight.mVertexId] };
+				int weakest{ 0 };
+				for (int i = 1; i < KMaxBoneInfluences; i++)
+				{
+					if (weights[i] < weights[weakest])
+						weakest = i;
+				}
+				if (weight.mWeight > weights[weakest])
+				{
+					weights[weakest] = weight.mWeight;
+					mesh.boneIndices[weight.mVertexId][weakest] = b;
+				}
+			}
+		}
 
-		newNode->transform = aiMatrix4x4ToGlm(&node->mTransformation);
-		
-		for (size_t i = 0; i < node->mNumChildren; i++)
-			newNode->childNodes.emplace_back(RecurseCreateNode(node->mChildren[i], newNode));
+		for (glm::vec4& weights : mesh.boneWeights)
+		{
+			const float total{ weights.x + weights.y + weights.z + weights.w };
+			if (total > 0)
+				weights /= total;
+		}
+		return missingNodes;
+	}
 
-		return newNode;
+	// Every mesh once, then the hierarchy from those so nothing walks the vertices again
+	void ModelLoader::ComputeAllBounds()
+	{
+		ParallelFor(m_meshVector.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				m_meshVector[i].UpdateBounds();
+		});
+		ComputeNodeBounds();
 	}
 
-	// Recursive deletion of nodes
-	void ModelLoader::RecurseDeleteNode(Node* node)
+	// Mesh bounds must already be set, only the node transforms are walked
+	void ModelLoader::ComputeNodeBounds()
 	{
-		if (!node)
-			return;
+		std::vector<glm::mat4> worldTransforms;
+		ComputeWorldTransforms(worldTransforms);
+		BuildNodeBounds(m_nodes, m_meshVector, worldTransforms, m_nodeBounds);
+	}
+
+	// Skinning indexes bones and nodes directly so a bad cache must not get through
+	bool ModelLoader::BonesInRange() const
+	{
+		for (size_t i = 0; i < m_meshVector.size(); i++)
+		{
+			const Mesh& mesh{ m_meshVector[i] };
+			for (const MeshBone& bone : mesh.bones)
+			{
+				if (bone.node >= m_nodes.size() || bone.meshNode >= m_nodes.size())
+					return false;
+			}
 
-		for (Node* n : node->childNodes)
-			RecurseDeleteNode(n);
+			const VertexStreams streams{ GetVertexStreams(i) };
+			for (size_t v = 0; streams.boneIndices && v < streams.numVertices; v++)
+			{
+				if (glm::any(glm::greaterThanEqual(streams.boneIndices[v], glm::uvec4((unsigned int)mesh.bones.size()))))
+					return false;
+			}
+		}
+		return true;
+	}
 
-		delete node;
+	// When names repeat the first node, the one nearest the root, is the one found
+	void ModelLoader::IndexNodeNames()
+	{
+		m_nodeLookup.clear();
+		m_nodeLookup.reserve(m_nodes.size());
+		for (size_t n = 0; n < m_nodes.size(); n++)
+			m_nodeLookup.emplace(m_nodes[n].name, (unsigned int)n);
+	}
+
+	// One pass as every parent's transform is ready before its children need it
+	void ModelLoader::ComputeWorldTransforms(std::vector<glm::mat4>& worldTransforms) const
+	{
+		worldTransforms.resize(m_nodes.size());
+		for (size_t n = 0; n < m_nodes.size(); n++)
+		{
+			const Node& node{ m_nodes[n] };
+			worldTransforms[n] = node.parent < 0 ? node.transform : worldTransforms[node.parent] * node.transform;
+		}
 	}
 
 	// Retrieve the dimensions of this model in local coordinates
 	void ModelLoader::GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const
 	{
-		if (m_meshVector.empty())
-			return;
+		MeshBounds combined;
+		for (const Mesh& mesh : m_meshVector)
+			combined = MergeBounds(combined, mesh.bounds);
 
-		m_meshVector[0].GetLocalExtents(minExtents, maxExtents);
-
-		for (size_t i = 1; i < m_meshVector.size(); i++)
-		{
-			glm::vec3 newMin;
-			glm::vec3 newMax;
-			m_meshVector[0].GetLocalExtents(newMin, newMax);
-
-			minExtents.x = std::min(minExtents.x, newMin.x);
-			minExtents.y = std::min(minExtents.y, newMin.y);
-			minExtents.z = std::min(minExtents.z, newMin.z);
+		if (!combined.valid)
+			return;
 
-			maxExtents.x = std::max(maxExtents.x, newMax.x);
-			maxExtents.y = std::max(maxExtents.y, newMax.y);
-			maxExtents.z = std::max(maxExtents.z, newMax.z);
-		}
+		minExtents = combined.boxMin;
+		maxExtents = combined.boxMax;
 	}
-}
\ No newline at end of file
+}
@@ -3,16 +3,20 @@
 
 #include "ExternalLibraryHeaders.h"
 #include "Helper.h"
+#include "MeshCache.h"
+#include "IndexOptimiser.h"
+#include "MeshClusters.h"
+#include "MeshBounds.h"
+#include "MeshBvh.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <functional>
+#include <future>
+#include <unordered_map>
 
 namespace Helpers
 {
-	// Per node animation data
-	struct AnimationData
-	{
-		float time;
-		glm::vec3 value;
-	};
-
 	// Materials work with lights and shaders to produce the final render
 	struct Material
 	{
@@ -49,6 +53,44 @@ namespace Helpers
 		}
 	};
 
+	// A coarser version of a mesh indexing the same vertices, see GenerateMeshLods
+	// After a cooked warm start the elements stay in the cache, see ModelLoader::GetElements
+	struct MeshLod
+	{
+		std::vector<unsigned int> elements;
+
+		// Roughly how far the simplified surface strays from the original, in model units
+		float error{ 0 };
+	};
+
+	// Most bones that can move one vertex, as ASSIMP's LimitBoneWeights step leaves them
+	constexpr int KMaxBoneInfluences{ 4 };
+
+	// A node that deforms a skinned mesh
+	struct MeshBone
+	{
+		// Index into the ModelLoader's nodes of the node that moves the bone
+		unsigned int node{ 0 };
+
+		// Node the skinned mesh hangs from, the root if none lists it. The pose is taken relative to this node
+		// so skinned vertices stay in the mesh's own space, the same space unskinned mesh are drawn in.
+		unsigned int meshNode{ 0 };
+
+		// Takes a vertex from mesh space into the bone's space in the bind pose
+		glm::mat4 offset{ 1 };
+	};
+
+	// Pointers to one mesh's vertex data, wherever it is held. Missing attributes are nullptr.
+	struct VertexStreams
+	{
+		size_t numVertices{ 0 };
+		const glm::vec3* vertices{ nullptr };
+		const glm::vec3* normals{ nullptr };
+		const glm::vec2* uvCoords{ nullptr };
+		const glm::uvec4* boneIndices{ nullptr };
+		const glm::vec4* boneWeights{ nullptr };
+	};
+
 	// Data container for a mesh
 	// A model can be made up of a number of mesh
 	struct Mesh
@@ -57,6 +99,7 @@ namespace Helpers
 		std::string name;
 
 		// Data in the mesh, vertices are guaranteed but normals and uvCoords depend on the model creator
+		// After a cooked warm start these, the skinning data and the elements stay in the cache, see ModelLoader::GetVertexStreams
 		std::vector<glm::vec3> vertices;
 		std::vector<glm::vec3> normals;
 		std::vector<glm::vec2> uvCoords;
@@ -64,10 +107,34 @@ namespace Helpers
 		// Elements
 		std::vector<unsigned int> elements;
 
+		// Skinning, empty unless the mesh has bones. Per vertex up to KMaxBoneInfluences indices into bones
+		// with weights summing to 1, unused influences have a weight of 0. See SkinMesh.
+		std::vector<glm::uvec4> boneIndices;
+		std::vector<glm::vec4> boneWeights;
+		std::vector<MeshBone> bones;
+
+		// Coarser levels of detail, most detailed first. Empty unless generated.
+		std::vector<MeshLod> lods;
+
+		// Runs of elements that can be culled on their own. Empty unless built, see BuildMeshClusters.
+		std::vector<MeshCluster> clusters;
+
 		// Index into the material vector held by the ModelLoader
 		size_t materialIndex{ 0 };
 
-		// Retrieve the dimensions of this mesh in local model coordinates
+		// Box and sphere of the vertices, of the bind pose for skinned mesh. Worked out by the ModelLoader at load.
+		MeshBounds bounds;
+
+		// Call after changing the vertices
+		void UpdateBounds() { bounds = ComputeBounds(vertices); }
+
+		// Views of the vectors above
+		VertexStreams GetVertexStreams() const;
+
+		// Triangles for ray casts, of the bind pose for skinned mesh. Empty unless built, see ModelLoader::BuildBvhs.
+		MeshBvh bvh;
+
+		// Retrieve the dimensions of this mesh in local model coordinates, from the cached bounds
 		void GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const;
 
 		// Helper
@@ -78,25 +145,78 @@ namespace Helpers
 				" Num verts: " + std::to_string(vertices.size()) + "\n" +
 				" Num normals: " + std::to_string(normals.size()) + "\n" +
 				" Num uv coords: " + std::to_string(uvCoords.size()) + "\n" +
+				" Num bones: " + std::to_string(bones.size()) + "\n" +
 				" Num indices: " + std::to_string(elements.size());
 		}
 	};	
 
 	// A mesh can contain a hierarchy in a tree structure
-	// Each entry is a Node
+	// Each entry is a Node, held by the ModelLoader in one array breadth first
+	// so every parent comes before its children and each node's children are next to each other
 	struct Node
 	{
 		std::string name;
 		glm::mat4 transform{ 1 };
 		std::vector<unsigned int> meshIndices;
 
-		Node* parentNode{ nullptr };
-		std::vector<Node*> childNodes;
+		// Array index of the parent, -1 for the root
+		int parent{ -1 };
+
+		// Array index of the first child and how many there are
+		unsigned int firstChild{ 0 };
+		unsigned int numChildren{ 0 };
+
+		// Animation keys with times in seconds, kept apart from the values. Empty when the node is not animated.
+		// See AnimationClip for playing them back.
+		std::vector<float> translationKeyTimes;
+		std::vector<glm::vec3> translationKeys;
+		std::vector<float> rotationKeyTimes;
+		std::vector<glm::quat> rotationKeys;
+		std::vector<float> scaleKeyTimes;
+		std::vector<glm::vec3> scaleKeys;
+	};
+
+	// ASSIMP post processing presets. Each has every step of the one before it,
+	// so a cache made with a later profile can be used for an earlier one.
+	enum class ImportProfile
+	{
+		// Just enough for the renderer: triangles, normals and the FBX scale
+		FastPreview,
+
+		// Cleans and optimises the mesh as well
+		FullQuality,
 
-		// Animations
-		std::vector<AnimationData> translationAnimationKeys;
-		std::vector<AnimationData> rotationAnimationKeys;
-		std::vector<AnimationData> scaleAnimationKeys;
+		// Full quality plus validation and degenerate removal, worth the cost when the result is cached
+		CookForCache
+	};
+
+	// Post processing flags and display name of a profile
+	unsigned int ImportProfileFlags(ImportProfile profile);
+	const char* ImportProfileName(ImportProfile profile);
+
+	// Time taken by one stage of a model load
+	struct ImportStepTiming
+	{
+		std::string name;
+		double milliseconds{ 0 };
+	};
+
+	// How the last model load went, stages are in the order they ran
+	struct ImportReport
+	{
+		ImportProfile profile{ ImportProfile::FullQuality };
+		bool fromCache{ false };
+		std::vector<ImportStepTiming> steps;
+		double totalMilliseconds{ 0 };
+
+		// Helper to output the timings for debugging purposes
+		std::string ToString() const {
+			std::string report = std::string("Import profile: ") + ImportProfileName(profile) +
+				(fromCache ? " (from cache)" : "") + " Total: " + std::to_string(totalMilliseconds) + " ms\n";
+			for (const ImportStepTiming& step : steps)
+				report += " " + step.name + ": " + std::to_string(step.milliseconds) + " ms\n";
+			return report;
+		}
 	};
 
 	// Helper to load model data into mesh and material structures
@@ -107,21 +227,76 @@ namespace Helpers
 		std::vector<Mesh> m_meshVector;
 		std::vector<Material> m_materials;
 
-		Node* m_rootNode{ nullptr };
+		// Root first, see Node. Names map to their index for lookups.
+		std::vector<Node> m_nodes;
+		std::unordered_map<std::string, unsigned int> m_nodeLookup;
+
+		// Kept mapped after a cooked warm start so the mesh blobs can be uploaded from it directly
+		MeshCache m_cache;
+
+		ImportReport m_importReport;
+
+		// Vertex cache figures of each mesh from the last OptimiseMeshes
+		std::vector<IndexOptimisationReport> m_indexReports;
+
+		// Length in seconds of the animation held in the node keys, 0 if there is none
+		float m_animationDuration{ 0 };
+
+		// Model space bounds of each node's subtree in the rest pose, see BuildNodeBounds
+		std::vector<MeshBounds> m_nodeBounds;
+
+		const aiScene* ApplyPostProcessSteps(Assimp::Importer& importer, unsigned int ppsteps);
 
 		bool PopulateFromAssimpScene(const aiScene* scene);
+		bool PopulateFromCache(bool cooked);
+		void Cook();
 
-		// Recursive
-		Node* RecurseCreateNode(aiNode* node, Node* parent);
-		void RecurseDeleteNode(Node* node);
-		Node* RecurseFindNode(Node* node, const std::string& nodeName);
-		void RecurseOutputHierarchy(Node* node, int depth);
+		void CreateNodes(const aiNode* rootNode);
+		int ConvertBones(const aiMesh* aimesh, unsigned int meshIndex, Mesh& mesh) const;
+		bool BonesInRange() const;
+		void ComputeAllBounds();
+		void ComputeNodeBounds();
+		void IndexNodeNames();
+		void OutputHierarchy() const;
 	public:
 		ModelLoader() = default;
-		~ModelLoader() { RecurseDeleteNode(m_rootNode); }
 
 		// Load a 3D model form a provided file and path, return false on error
-		bool LoadFromFile(const std::string& objFilename);
+		// Uses the binary cache next to the file when it has at least the profile's steps,
+		// otherwise loads with ASSIMP and writes the cache
+		// cook also optimises the meshes, generates their levels of detail, clusters and BVHs and stores the result in the
+		// cache, so a warm start does none of it and leaves the vertex data mapped for GetVertexStreams and GetElements
+		bool LoadFromFile(const std::string& objFilename, ImportProfile profile = ImportProfile::FullQuality, bool cook = false);
+
+		// Loads on a worker thread so the caller can carry on, the loader must be left alone until the future is ready
+		// onLoaded, if given, runs on the worker after a successful load for any further CPU side processing
+		std::future<bool> LoadFromFileAsync(const std::string& objFilename, ImportProfile profile = ImportProfile::FullQuality,
+			bool cook = false, std::function<void(ModelLoader&)> onLoaded = nullptr);
+
+		// Reorders every mesh for the vertex cache, overdraw and fetch order, see OptimiseMesh
+		void OptimiseMeshes();
+
+		// Splits every mesh into clusters for culling, see BuildMeshClusters
+		// Call after anything that reorders the elements
+		void GenerateClusters(size_t maxVertices = 64, size_t maxTriangles = 124);
+
+		// Builds every mesh's BVH for ray casts, call after anything that changes the vertices or elements
+		void BuildBvhs();
+
+		// Per stage timings of the last load
+		const ImportReport& GetImportReport() const { return m_importReport; }
+
+		// Before and after figures of each mesh from OptimiseMeshes, empty if it has not run
+		const std::vector<IndexOptimisationReport>& GetIndexReports() const { return m_indexReports; }
+
+		// True if the last load was a cooked warm start, whose vertex data is still in the mapped cache
+		bool IsFromCache() const { return m_cache.IsOpen(); }
+
+		// A mesh's vertex data, from the mapped cache after a cooked warm start or otherwise the mesh's vectors
+		VertexStreams GetVertexStreams(size_t mesh) const;
+
+		// Elements of level 0, the full detail, or of lods[level - 1], found the same way, with their count
+		const unsigned int* GetElements(size_t mesh, size_t level, size_t& count) const;
 
 		// Retrieves the collection of mesh loaded from the 3D model
 		std::vector<Mesh>& GetMeshVector() { return m_meshVector; }
@@ -130,14 +305,37 @@ namespace Helpers
 		const std::vector<Material>& GetMaterialVector() const { return m_materials; }
 
 		// For a mesh heirarchy this is the root.
-		Node* GetRootNode() { return m_rootNode; }
+		Node* GetRootNode() { return m_nodes.empty() ? nullptr : &m_nodes[0]; }
+
+		// Every node, parents before children
+		std::vector<Node>& GetNodes() { return m_nodes; }
+		const std::vector<Node>& GetNodes() const { return m_nodes; }
 
-		// Retrieve a specific node by name
+		// Retrieve a specific node by name, nullptr if there is none
 		Node* FindNode(const std::string& nodeName) {
-			return RecurseFindNode(m_rootNode, nodeName);
+			const int index{ FindNodeIndex(nodeName) };
+			return index < 0 ? nullptr : &m_nodes[index];
+		}
+
+		// Array index of a node by name, -1 if there is none
+		int FindNodeIndex(const std::string& nodeName) const {
+			const auto found{ m_nodeLookup.find(nodeName) };
+			return found == m_nodeLookup.end() ? -1 : (int)found->second;
 		}
 
-		// Retrieve the dimensions of this model in local model coordinates
+		// Length in seconds of the model's animation, 0 if it is not animated
+		float GetAnimationDuration() const { return m_animationDuration; }
+
+		// Model space transform of every node in one pass down the array, worldTransforms[i] is for node i
+		void ComputeWorldTransforms(std::vector<glm::mat4>& worldTransforms) const;
+
+		// Bounds of each node with everything below it, GetNodeBounds()[i] is for node i
+		const std::vector<MeshBounds>& GetNodeBounds() const { return m_nodeBounds; }
+
+		// Bounds of the whole model in model space, placed by the node transforms
+		MeshBounds GetBounds() const { return m_nodeBounds.empty() ? MeshBounds() : m_nodeBounds[0]; }
+
+		// Retrieve the dimensions of this model in local model coordinates, the union of each mesh's own extents
 		void GetLocalExtents(glm::vec3& minExtents, glm::vec3& maxExtents) const;
 
 		// Helper to output the main info. of this loaded model
@@ -0,0 +1,174 @@
+#include "MeshBounds.h"
+#include "Mesh.h"
+
+#include <emmintrin.h>
+
+namespace Helpers
+{
+	// Sphere at the box centre holding the sphere given, no bigger than the box's own
+	static float EnclosingRadius(const MeshBounds& box, const glm::vec3& centre, float radius)
+	{
+		const float halfDiagonal{ glm::length(box.boxMax - box.boxMin) * 0.5f };
+		return std::min(halfDiagonal, glm::distance(box.centre, centre) + radius);
+	}
+
+	bool MeshBounds::IntersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const
+	{
+		if (!valid)
+			return false;
+
+		// Slab test. A ray parallel to an axis never crosses that axis's planes, so it is inside the slab throughout
+		// or misses outright. Such axes are tested apart because a zero or tiny component inverts to infinity,
+		// and 0 * infinity is NaN when the origin lies on a plane.
+		float enter{ 0 };
+		float exit{ maxDistance };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (std::abs(direction[axis]) < 1e-20f)
+			{
+				if (origin[axis] < boxMin[axis] || origin[axis] > boxMax[axis])
+					return false;
+				continue;
+			}
+
+			const float inverse{ 1.0f / direction[axis] };
+			float t0{ (boxMin[axis] - origin[axis]) * inverse };
+			float t1{ (boxMax[axis] - origin[axis]) * inverse };
+			if (t0 > t1)
+				std::swap(t0, t1);
+			enter = std::max(enter, t0);
+			exit = std::min(exit, t1);
+			if (enter > exit)
+				return false;
+		}
+		distance = enter;
+		return true;
+	}
+
+	// Four packed vec3 are three registers, lanes x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3, gathered back by axis at the end
+	void ComputeBox(const glm::vec3* positions, size_t count, glm::vec3& boxMin, glm::vec3& boxMax)
+	{
+		if (count == 0)
+			return;
+
+		boxMin = boxMax = positions[0];
+		const float* floats{ (const float*)positions };
+		size_t i{ 0 };
+		if (count >= 4)
+		{
+			__m128 min0{ _mm_loadu_ps(floats) }, min1{ _mm_loadu_ps(floats + 4) }, min2{ _mm_loadu_ps(floats + 8) };
+			__m128 max0{ min0 }, max1{ min1 }, max2{ min2 };
+			for (i = 4; i + 4 <= count; i += 4)
+			{
+				const float* block{ floats + i * 3 };
+				const __m128 v0{ _mm_loadu_ps(block) }, v1{ _mm_loadu_ps(block + 4) }, v2{ _mm_loadu_ps(block + 8) };
+				min0 = _mm_min_ps(min0, v0);
+				min1 = _mm_min_ps(min1, v1);
+				min2 = _mm_min_ps(min2, v2);
+				max0 = _mm_max_ps(max0, v0);
+				max1 = _mm_max_ps(max1, v1);
+				max2 = _mm_max_ps(max2, v2);
+			}
+
+			alignas(16) float lanes[3][4];
+			_mm_store_ps(lanes[0], min0);
+			_mm_store_ps(lanes[1], min1);
+			_mm_store_ps(lanes[2], min2);
+			boxMin = glm::vec3(std::min({ lanes[0][0], lanes[0][3], lanes[1][2], lanes[2][1] }),
+				std::min({ lanes[0][1], lanes[1][0], lanes[1][3], lanes[2][2] }),
+				std::min({ lanes[0][2], lanes[1][1], lanes[2][0], lanes[2][3] }));
+
+			_mm_store_ps(lanes[0], max0);
+			_mm_store_ps(lanes[1], max1);
+			_mm_store_ps(lanes[2], max2);
+			boxMax = glm::vec3(std::max({ lanes[0][0], lanes[0][3], lanes[1][2], lanes[2][1] }),
+				std::max({ lanes[0][1], lanes[1][0], lanes[1][3], lanes[2][2] }),
+				std::max({ lanes[0][2], lanes[1][1], lanes[2][0], lanes[2][3] }));
+		}
+
+		for (; i < count; i++)
+		{
+			boxMin = glm::min(boxMin, positions[i]);
+			boxMax = glm::max(boxMax, positions[i]);
+		}
+	}
+
+	MeshBounds ComputeBounds(const std::vector<glm::vec3>& positions)
+	{
+		MeshBounds bounds;
+		if (positions.empty())
+			return bounds;
+
+		ComputeBox(positions.data(), positions.size(), bounds.boxMin, bounds.boxMax);
+		bounds.centre = (bounds.boxMin + bounds.boxMax) * 0.5f;
+
+		float radiusSq{ 0 };
+		for (const glm::vec3& position : positions)
+		{
+			const glm::vec3 offset{ position - bounds.centre };
+			radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+		}
+		bounds.radius = std::sqrt(radiusSq);
+		bounds.valid = true;
+		return bounds;
+	}
+
+	// The box's half size spreads over the new axes by the absolute rotation and scale
+	MeshBounds TransformBounds(const MeshBounds& bounds, const glm::mat4& transform)
+	{
+		if (!bounds.valid)
+			return bounds;
+
+		const glm::vec3 halfSize{ (bounds.boxMax - bounds.boxMin) * 0.5f };
+		const glm::vec3 boxCentre{ transform * glm::vec4((bounds.boxMin + bounds.boxMax) * 0.5f, 1.0f) };
+		glm::vec3 newHalfSize{ 0 };
+		for (int c = 0; c < 3; c++)
+			newHalfSize += glm::abs(glm::vec3(transform[c])) * halfSize[c];
+
+		MeshBounds result;
+		result.boxMin = boxCentre - newHalfSize;
+		result.boxMax = boxCentre + newHalfSize;
+		result.centre = boxCentre;
+		result.valid = true;
+
+		const float maxScale{ std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+			glm::length(glm::vec3(transform[2])) }) };
+		result.radius = EnclosingRadius(result, glm::vec3(transform * glm::vec4(bounds.centre, 1.0f)), bounds.radius * maxScale);
+		return result;
+	}
+
+	MeshBounds MergeBounds(const MeshBounds& a, const MeshBounds& b)
+	{
+		if (!a.valid)
+			return b;
+		if (!b.valid)
+			return a;
+
+		MeshBounds result;
+		result.boxMin = glm::min(a.boxMin, b.boxMin);
+		result.boxMax = glm::max(a.boxMax, b.boxMax);
+		result.centre = (result.boxMin + result.boxMax) * 0.5f;
+		result.valid = true;
+		result.radius = std::max(EnclosingRadius(result, a.centre, a.radius), EnclosingRadius(result, b.centre, b.radius));
+		return result;
+	}
+
+	void BuildNodeBounds(const std::vector<Node>& nodes, const std::vector<Mesh>& meshes,
+		const std::vector<glm::mat4>& worldTransforms, std::vector<MeshBounds>& nodeBounds)
+	{
+		nodeBounds.assign(nodes.size(), MeshBounds());
+		for (size_t n = nodes.size(); n-- > 0;)
+		{
+			const Node& node{ nodes[n] };
+			for (unsigned int meshIndex : node.meshIndices)
+			{
+				if (meshIndex < meshes.size())
+					nodeBounds[n] = MergeBounds(nodeBounds[n], TransformBounds(meshes[meshIndex].bounds, worldTransforms[n]));
+			}
+
+			// Every child is after its parent so is finished by the time the parent is reached
+			if (node.parent >= 0)
+				nodeBounds[node.parent] = MergeBounds(nodeBounds[node.parent], nodeBounds[n]);
+		}
+	}
+}
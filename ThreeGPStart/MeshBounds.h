@@ -0,0 +1,43 @@
+#pragma once
+// Bounding boxes and spheres of meshes and of the node hierarchy, worked out once at load
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	struct Mesh;
+	struct Node;
+
+	// Axis aligned box with a sphere around it, the sphere is centred on the box but only as big as the contents need
+	struct MeshBounds
+	{
+		glm::vec3 boxMin{ 0 };
+		glm::vec3 boxMax{ 0 };
+		glm::vec3 centre{ 0 };
+		float radius{ 0 };
+
+		// False for bounds of nothing, e.g. a node with no mesh below it
+		bool valid{ false };
+
+		// Distance along the ray to where it enters the box, false if it misses or is further than maxDistance
+		// direction need not be normalised, distance is in multiples of it
+		bool IntersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const;
+	};
+
+	// Min and max of a run of positions, four at a time with SSE
+	void ComputeBox(const glm::vec3* positions, size_t count, glm::vec3& boxMin, glm::vec3& boxMax);
+
+	// Box and sphere of a set of positions, invalid if there are none
+	MeshBounds ComputeBounds(const std::vector<glm::vec3>& positions);
+
+	// Bounds of a box once transformed, so still axis aligned but looser for any rotation
+	MeshBounds TransformBounds(const MeshBounds& bounds, const glm::mat4& transform);
+
+	// Smallest box holding both, with a sphere around it
+	MeshBounds MergeBounds(const MeshBounds& a, const MeshBounds& b);
+
+	// Model space bounds of every node's meshes and all its children's, nodeBounds[i] for nodes[i]
+	// Nodes are in the ModelLoader's order, parents first, so children fold into their parents in one backwards pass
+	void BuildNodeBounds(const std::vector<Node>& nodes, const std::vector<Mesh>& meshes,
+		const std::vector<glm::mat4>& worldTransforms, std::vector<MeshBounds>& nodeBounds);
+}
@@ -0,0 +1,582 @@
+#include "MeshBvh.h"
+#include "Parallel.h"
+
+#include <cfloat>
+#include <emmintrin.h>
+
+namespace Helpers
+{
+	// Centroid bins per axis when looking for a split
+	static constexpr int KBins{ 12 };
+
+	// Deeper nodes become leaves, however many triangles they hold, so traversal stacks can be fixed size
+	static constexpr uint32_t KMaxDepth{ 64 };
+
+	// The first levels are built on one thread until there are this many subtrees, which are then built in parallel
+	static constexpr size_t KParallelSubtrees{ 64 };
+	static constexpr uint32_t KMinParallelTriangles{ 4096 };
+
+	struct BuildTriangle
+	{
+		glm::vec3 boxMin;
+		glm::vec3 boxMax;
+		glm::vec3 centroid;
+	};
+
+	struct BuildTask
+	{
+		uint32_t node;
+		uint32_t first;
+		uint32_t count;
+		uint32_t depth;
+	};
+
+	// Half the surface area, only ever compared
+	static float HalfArea(const glm::vec3& boxMin, const glm::vec3& boxMax)
+	{
+		const glm::vec3 extent{ boxMax - boxMin };
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	struct BvhBin
+	{
+		glm::vec3 boxMin{ FLT_MAX };
+		glm::vec3 boxMax{ -FLT_MAX };
+		uint32_t count{ 0 };
+	};
+
+	// Bounds the task's triangles then either leaves it a leaf or splits it in two by the binned surface area heuristic,
+	// appending the children to nodes. Returns false for a leaf.
+	static bool SplitNode(const std::vector<BuildTriangle>& triangles, std::vector<uint32_t>& order, std::vector<BvhNode>& nodes,
+		const BuildTask& task, BuildTask& left, BuildTask& right)
+	{
+		glm::vec3 boxMin{ FLT_MAX }, boxMax{ -FLT_MAX };
+		glm::vec3 centroidMin{ FLT_MAX }, centroidMax{ -FLT_MAX };
+		for (uint32_t i = task.first; i < task.first + task.count; i++)
+		{
+			const BuildTriangle& triangle{ triangles[order[i]] };
+			boxMin = glm::min(boxMin, triangle.boxMin);
+			boxMax = glm::max(boxMax, triangle.boxMax);
+			centroidMin = glm::min(centroidMin, triangle.centroid);
+			centroidMax = glm::max(centroidMax, triangle.centroid);
+		}
+
+		BvhNode& node{ nodes[task.node] };
+		node.boxMin = boxMin;
+		node.boxMax = boxMax;
+		node.leftOrFirst = task.first;
+		node.count = task.count;
+		if (task.count <= 1 || task.depth >= KMaxDepth)
+			return false;
+
+		// Cost in triangle tests, a node visit counting as one
+		int bestAxis{ -1 };
+		int bestSplit{ 0 };
+		float bestCost{ FLT_MAX };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float extent{ centroidMax[axis] - centroidMin[axis] };
+			if (extent <= 0)
+				continue;
+
+			const float scale{ KBins / extent };
+			BvhBin bins[KBins];
+			for (uint32_t i = task.first; i < task.first + task.count; i++)
+			{
+				const BuildTriangle& triangle{ triangles[order[i]] };
+				BvhBin& bin{ bins[std::min(KBins - 1, (int)((triangle.centroid[axis] - centroidMin[axis]) * scale))] };
+				bin.boxMin = glm::min(bin.boxMin, triangle.boxMin);
+				bin.boxMax = glm::max(bin.boxMax, triangle.boxMax);
+				bin.count++;
+			}
+
+			// Sweep from the right to get the cost of everything after each plane, then from the left
+			float rightCost[KBins];
+			glm::vec3 sweepMin{ FLT_MAX }, sweepMax{ -FLT_MAX };
+			uint32_t sweepCount{ 0 };
+			for (int b = KBins - 1; b > 0; b--)
+			{
+				sweepMin = glm::min(sweepMin, bins[b].boxMin);
+				sweepMax = glm::max(sweepMax, bins[b].boxMax);
+				sweepCount += bins[b].count;
+				rightCost[b] = sweepCount ? HalfArea(sweepMin, sweepMax) * sweepCount : 0;
+			}
+
+			sweepMin = glm::vec3(FLT_MAX);
+			sweepMax = glm::vec3(-FLT_MAX);
+			sweepCount = 0;
+			for (int b = 0; b < KBins - 1; b++)
+			{
+				sweepMin = glm::min(sweepMin, bins[b].boxMin);
+				sweepMax = glm::max(sweepMax, bins[b].boxMax);
+				sweepCount += bins[b].count;
+				if (sweepCount == 0 || sweepCount == task.count)
+					continue;
+
+				const float cost{ HalfArea(sweepMin, sweepMax) * sweepCount + rightCost[b + 1] };
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b + 1;
+				}
+			}
+		}
+
+		const float parentArea{ std::max(HalfArea(boxMin, boxMax), FLT_MIN) };
+		bestCost = 1.0f + bestCost / parentArea;
+		if (task.count <= MeshBvh::KMaxLeafTriangles && (bestAxis < 0 || bestCost >= (float)task.count))
+			return false;
+
+		uint32_t leftCount{ task.count / 2 };
+		if (bestAxis >= 0)
+		{
+			const float scale{ KBins / (centroidMax[bestAxis] - centroidMin[bestAxis]) };
+			const auto middle{ std::partition(order.begin() + task.first, order.begin() + task.first + task.count, [&](uint32_t t)
+			{
+				return std::min(KBins - 1, (int)((triangles[t].centroid[bestAxis] - centroidMin[bestAxis]) * scale)) < bestSplit;
+			}) };
+			leftCount = (uint32_t)(middle - (order.begin() + task.first));
+		}
+
+		// Every centroid in the same place, any split is as good as another
+		if (leftCount == 0 || leftCount == task.count)
+			leftCount = task.count / 2;
+
+		const uint32_t leftIndex{ (uint32_t)nodes.size() };
+		nodes.emplace_back();
+		nodes.emplace_back();
+		nodes[task.node].leftOrFirst = leftIndex;
+		nodes[task.node].count = 0;
+
+		left = BuildTask{ leftIndex, task.first, leftCount, task.depth + 1 };
+		right = BuildTask{ leftIndex + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 };
+		return true;
+	}
+
+	void MeshBvh::Clear()
+	{
+		m_nodes.clear();
+		m_triangles.clear();
+		m_triangleIndices.clear();
+	}
+
+	void MeshBvh::Build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& elements)
+	{
+		Clear();
+		const uint32_t numTriangles{ (uint32_t)(elements.size() / 3) };
+		if (numTriangles == 0)
+			return;
+
+		std::vector<BuildTriangle> triangles(numTriangles);
+		ParallelFor(numTriangles, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; t++)
+			{
+				const glm::vec3& a{ positions[elements[t * 3]] };
+				const glm::vec3& b{ positions[elements[t * 3 + 1]] };
+				const glm::vec3& c{ positions[elements[t * 3 + 2]] };
+				triangles[t].boxMin = glm::min(a, glm::min(b, c));
+				triangles[t].boxMax = glm::max(a, glm::max(b, c));
+				triangles[t].centroid = (a + b + c) * (1.0f / 3.0f);
+			}
+		}, 4096);
+
+		std::vector<uint32_t> order(numTriangles);
+		for (uint32_t t = 0; t < numTriangles; t++)
+			order[t] = t;
+
+		// Top levels breadth first until there is enough work to share out
+		m_nodes.reserve(2 * (numTriangles / KMaxLeafTriangles + 1));
+		m_nodes.emplace_back();
+		std::vector<BuildTask> pending{ BuildTask{ 0, 0, numTriangles, 0 } };
+		std::vector<BuildTask> subtrees;
+		size_t next{ 0 };
+		while (next < pending.size() && pending.size() - next + subtrees.size() < KParallelSubtrees)
+		{
+			const BuildTask task{ pending[next++] };
+			if (task.count < KMinParallelTriangles)
+			{
+				subtrees.push_back(task);
+				continue;
+			}
+
+			BuildTask left, right;
+			if (SplitNode(triangles, order, m_nodes, task, left, right))
+			{
+				pending.push_back(left);
+				pending.push_back(right);
+			}
+		}
+		subtrees.insert(subtrees.end(), pending.begin() + next, pending.end());
+
+		// Each subtree owns its own range of order and builds into its own node list, root first
+		std::vector<std::vector<BvhNode>> subtreeNodes(subtrees.size());
+		ParallelFor(subtrees.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t s = begin; s < end; s++)
+			{
+				std::vector<BvhNode>& nodes{ subtreeNodes[s] };
+				nodes.emplace_back();
+				std::vector<BuildTask> stack{ BuildTask{ 0, subtrees[s].first, subtrees[s].count, subtrees[s].depth } };
+				while (!stack.empty())
+				{
+					const BuildTask task{ stack.back() };
+					stack.pop_back();
+					BuildTask left, right;
+					if (SplitNode(triangles, order, nodes, task, left, right))
+					{
+						stack.push_back(right);
+						stack.push_back(left);
+					}
+				}
+			}
+		});
+
+		// Subtree roots go where their task's node was reserved, the rest are appended with their child links moved
+		for (size_t s = 0; s < subtrees.size(); s++)
+		{
+			const std::vector<BvhNode>& nodes{ subtreeNodes[s] };
+			const uint32_t base{ (uint32_t)m_nodes.size() - 1 };
+			for (size_t n = 0; n < nodes.size(); n++)
+			{
+				BvhNode node{ nodes[n] };
+				if (node.count == 0)
+					node.leftOrFirst += base;
+				if (n == 0)
+					m_nodes[subtrees[s].node] = node;
+				else
+					m_nodes.push_back(node);
+			}
+		}
+
+		m_triangles.resize(numTriangles);
+		m_triangleIndices = std::move(order);
+		ParallelFor(numTriangles, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const size_t t{ m_triangleIndices[i] };
+				const glm::vec3& a{ positions[elements[t * 3]] };
+				m_triangles[i] = BvhTriangle{ a, positions[elements[t * 3 + 1]] - a, positions[elements[t * 3 + 2]] - a };
+			}
+		}, 4096);
+	}
+
+	// Zero components would make 0 * infinity in the slab test, a huge number gives the same answer without the NaN
+	static glm::vec3 SafeInverse(const glm::vec3& direction)
+	{
+		glm::vec3 inverse;
+		for (int axis = 0; axis < 3; axis++)
+			inverse[axis] = std::abs(direction[axis]) > 1e-20f ? 1.0f / direction[axis] : (direction[axis] < 0 ? -1e30f : 1e30f);
+		return inverse;
+	}
+
+	// Entry distance of the ray into the box, FLT_MAX if it misses or enters beyond maxDistance
+	static float IntersectBox(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverse, float maxDistance)
+	{
+		const glm::vec3 t0{ (node.boxMin - origin) * inverse };
+		const glm::vec3 t1{ (node.boxMax - origin) * inverse };
+		const glm::vec3 tNear{ glm::min(t0, t1) };
+		const glm::vec3 tFar{ glm::max(t0, t1) };
+		const float enter{ std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f)) };
+		const float exit{ std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance)) };
+		return enter <= exit ? enter : FLT_MAX;
+	}
+
+	// Nearest first with each pushed node's entry distance, so nodes beyond a closer hit are skipped when popped
+	template<bool anyHit>
+	bool MeshBvh::Traverse(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit) const
+	{
+		hit = BvhHit();
+		hit.distance = maxDistance;
+		const glm::vec3 inverse{ SafeInverse(direction) };
+		if (m_nodes.empty() || IntersectBox(m_nodes[0], origin, inverse, maxDistance) == FLT_MAX)
+			return false;
+
+		struct StackEntry
+		{
+			uint32_t node;
+			float enter;
+		};
+		StackEntry stack[KMaxDepth + 1];
+		int stackSize{ 0 };
+		uint32_t slot{ BvhHit::KNoTriangle };
+
+		uint32_t nodeIndex{ 0 };
+		for (;;)
+		{
+			const BvhNode& node{ m_nodes[nodeIndex] };
+			if (node.count > 0)
+			{
+				for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+				{
+					// Moller-Trumbore, either winding
+					const BvhTriangle& triangle{ m_triangles[i] };
+					const glm::vec3 p{ glm::cross(direction, triangle.edge2) };
+					const float det{ glm::dot(triangle.edge1, p) };
+					if (std::abs(det) < 1e-20f)
+						continue;
+					const float inverseDet{ 1.0f / det };
+					const glm::vec3 s{ origin - triangle.v0 };
+					const float u{ glm::dot(s, p) * inverseDet };
+					if (u < 0 || u > 1)
+						continue;
+					const glm::vec3 q{ glm::cross(s, triangle.edge1) };
+					const float v{ glm::dot(direction, q) * inverseDet };
+					if (v < 0 || u + v > 1)
+						continue;
+					const float t{ glm::dot(triangle.edge2, q) * inverseDet };
+					if (t < 0 || t >= hit.distance)
+						continue;
+
+					hit.distance = t;
+					hit.u = u;
+					hit.v = v;
+					slot = i;
+					if (anyHit)
+						break;
+				}
+				if (anyHit && slot != BvhHit::KNoTriangle)
+					break;
+			}
+			else
+			{
+				uint32_t nearChild{ node.leftOrFirst };
+				uint32_t farChild{ node.leftOrFirst + 1 };
+				float nearEnter{ IntersectBox(m_nodes[nearChild], origin, inverse, hit.distance) };
+				float farEnter{ IntersectBox(m_nodes[farChild], origin, inverse, hit.distance) };
+				if (farEnter < nearEnter)
+				{
+					std::swap(nearChild, farChild);
+					std::swap(nearEnter, farEnter);
+				}
+				if (nearEnter != FLT_MAX)
+				{
+					if (farEnter != FLT_MAX)
+						stack[stackSize++] = StackEntry{ farChild, farEnter };
+					nodeIndex = nearChild;
+					continue;
+				}
+			}
+
+			// Next node still in front of the nearest hit
+			while (stackSize > 0 && stack[stackSize - 1].enter >= hit.distance)
+				stackSize--;
+			if (stackSize == 0)
+				break;
+			nodeIndex = stack[--stackSize].node;
+		}
+
+		if (slot == BvhHit::KNoTriangle)
+			return false;
+		hit.triangle = m_triangleIndices[slot];
+		return true;
+	}
+
+	bool MeshBvh::IntersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit) const
+	{
+		return Traverse<false>(origin, direction, maxDistance, hit);
+	}
+
+	bool MeshBvh::IsOccluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+	{
+		BvhHit hit;
+		return Traverse<true>(origin, direction, maxDistance, hit);
+	}
+
+	// The four rays in structure of arrays form, one lane each
+	struct RayPacket
+	{
+		__m128 origin[3];
+		__m128 direction[3];
+		__m128 inverse[3];
+	};
+
+	// Lanes whose ray enters the box before its current nearest hit, and the smallest entry distance of those
+	static int IntersectBox4(const BvhNode& node, const RayPacket& packet, __m128 maxDistance, float& enter)
+	{
+		const __m128 zero{ _mm_setzero_ps() };
+		__m128 tEnter{ zero };
+		__m128 tExit{ maxDistance };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const __m128 t0{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boxMin[axis]), packet.origin[axis]), packet.inverse[axis]) };
+			const __m128 t1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boxMax[axis]), packet.origin[axis]), packet.inverse[axis]) };
+			tEnter = _mm_max_ps(tEnter, _mm_min_ps(t0, t1));
+			tExit = _mm_min_ps(tExit, _mm_max_ps(t0, t1));
+		}
+		const __m128 inside{ _mm_cmple_ps(tEnter, tExit) };
+		const int mask{ _mm_movemask_ps(inside) };
+		if (mask)
+		{
+			// Misses become FLT_MAX so the horizontal minimum is of the hits only
+			__m128 entries{ _mm_or_ps(_mm_and_ps(inside, tEnter), _mm_andnot_ps(inside, _mm_set1_ps(FLT_MAX))) };
+			entries = _mm_min_ps(entries, _mm_shuffle_ps(entries, entries, _MM_SHUFFLE(2, 3, 0, 1)));
+			entries = _mm_min_ps(entries, _mm_shuffle_ps(entries, entries, _MM_SHUFFLE(1, 0, 3, 2)));
+			enter = _mm_cvtss_f32(entries);
+		}
+		return mask;
+	}
+
+	static __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	int MeshBvh::IntersectPacket(const BvhRay rays[4], BvhHit hits[4]) const
+	{
+		for (int r = 0; r < 4; r++)
+		{
+			hits[r] = BvhHit();
+			hits[r].distance = rays[r].maxDistance;
+		}
+		if (m_nodes.empty())
+			return 0;
+
+		RayPacket packet;
+		glm::vec3 inverse[4];
+		for (int r = 0; r < 4; r++)
+			inverse[r] = SafeInverse(rays[r].direction);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			packet.origin[axis] = _mm_setr_ps(rays[0].origin[axis], rays[1].origin[axis], rays[2].origin[axis], rays[3].origin[axis]);
+			packet.direction[axis] = _mm_setr_ps(rays[0].direction[axis], rays[1].direction[axis], rays[2].direction[axis], rays[3].direction[axis]);
+			packet.inverse[axis] = _mm_setr_ps(inverse[0][axis], inverse[1][axis], inverse[2][axis], inverse[3][axis]);
+		}
+
+		__m128 distance{ _mm_setr_ps(rays[0].maxDistance, rays[1].maxDistance, rays[2].maxDistance, rays[3].maxDistance) };
+		__m128 bestU{ _mm_setzero_ps() };
+		__m128 bestV{ _mm_setzero_ps() };
+		__m128i bestSlot{ _mm_set1_epi32(-1) };
+
+		const __m128 zero{ _mm_setzero_ps() };
+		const __m128 one{ _mm_set1_ps(1.0f) };
+		const __m128 epsilon{ _mm_set1_ps(1e-20f) };
+		const __m128 signMask{ _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)) };
+
+		uint32_t stack[KMaxDepth + 1];
+		int stackSize{ 0 };
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			// Re-tested as the rays may have hit something nearer since it was pushed
+			const BvhNode& node{ m_nodes[stack[--stackSize]] };
+			float enter;
+			if (!IntersectBox4(node, packet, distance, enter))
+				continue;
+
+			if (node.count == 0)
+			{
+				float leftEnter{ FLT_MAX }, rightEnter{ FLT_MAX };
+				const int leftMask{ IntersectBox4(m_nodes[node.leftOrFirst], packet, distance, leftEnter) };
+				const int rightMask{ IntersectBox4(m_nodes[node.leftOrFirst + 1], packet, distance, rightEnter) };
+				const bool leftFirst{ leftEnter <= rightEnter };
+				if (leftFirst)
+				{
+					if (rightMask)
+						stack[stackSize++] = node.leftOrFirst + 1;
+					if (leftMask)
+						stack[stackSize++] = node.leftOrFirst;
+				}
+				else
+				{
+					if (leftMask)
+						stack[stackSize++] = node.leftOrFirst;
+					if (rightMask)
+						stack[stackSize++] = node.leftOrFirst + 1;
+				}
+				continue;
+			}
+
+			// One triangle against all four rays at once, Moller-Trumbore as in the single ray path
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				const BvhTriangle& triangle{ m_triangles[i] };
+				const __m128 e1x{ _mm_set1_ps(triangle.edge1.x) }, e1y{ _mm_set1_ps(triangle.edge1.y) }, e1z{ _mm_set1_ps(triangle.edge1.z) };
+				const __m128 e2x{ _mm_set1_ps(triangle.edge2.x) }, e2y{ _mm_set1_ps(triangle.edge2.y) }, e2z{ _mm_set1_ps(triangle.edge2.z) };
+				const __m128& dx{ packet.direction[0] };
+				const __m128& dy{ packet.direction[1] };
+				const __m128& dz{ packet.direction[2] };
+
+				const __m128 px{ _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y)) };
+				const __m128 py{ _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z)) };
+				const __m128 pz{ _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x)) };
+				const __m128 det{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz)) };
+				const __m128 inverseDet{ _mm_div_ps(one, det) };
+
+				const __m128 sx{ _mm_sub_ps(packet.origin[0], _mm_set1_ps(triangle.v0.x)) };
+				const __m128 sy{ _mm_sub_ps(packet.origin[1], _mm_set1_ps(triangle.v0.y)) };
+				const __m128 sz{ _mm_sub_ps(packet.origin[2], _mm_set1_ps(triangle.v0.z)) };
+				const __m128 u{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDet) };
+
+				const __m128 qx{ _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y)) };
+				const __m128 qy{ _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z)) };
+				const __m128 qz{ _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x)) };
+				const __m128 v{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDet) };
+				const __m128 t{ _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet) };
+
+				__m128 mask{ _mm_cmpge_ps(_mm_and_ps(det, signMask), epsilon) };
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+				mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(t, distance));
+				if (!_mm_movemask_ps(mask))
+					continue;
+
+				distance = Select(mask, t, distance);
+				bestU = Select(mask, u, bestU);
+				bestV = Select(mask, v, bestV);
+				bestSlot = _mm_castps_si128(Select(mask, _mm_castsi128_ps(_mm_set1_epi32((int)i)), _mm_castsi128_ps(bestSlot)));
+			}
+		}
+
+		alignas(16) float distances[4], us[4], vs[4];
+		alignas(16) int32_t slots[4];
+		_mm_store_ps(distances, distance);
+		_mm_store_ps(us, bestU);
+		_mm_store_ps(vs, bestV);
+		_mm_store_si128((__m128i*)slots, bestSlot);
+
+		int hitMask{ 0 };
+		for (int r = 0; r < 4; r++)
+		{
+			if (slots[r] < 0)
+				continue;
+			hits[r].distance = distances[r];
+			hits[r].triangle = m_triangleIndices[slots[r]];
+			hits[r].u = us[r];
+			hits[r].v = vs[r];
+			hitMask |= 1 << r;
+		}
+		return hitMask;
+	}
+
+	// A short last packet is padded with rays that cannot hit anything
+	void MeshBvh::IntersectRays(const std::vector<BvhRay>& rays, std::vector<BvhHit>& hits) const
+	{
+		hits.resize(rays.size());
+		const size_t numPackets{ (rays.size() + 3) / 4 };
+		ParallelFor(numPackets, [&](size_t begin, size_t end)
+		{
+			for (size_t p = begin; p < end; p++)
+			{
+				BvhRay packetRays[4];
+				BvhHit packetHits[4];
+				const size_t first{ p * 4 };
+				for (size_t r = 0; r < 4; r++)
+				{
+					if (first + r < rays.size())
+						packetRays[r] = rays[first + r];
+					else
+						packetRays[r].maxDistance = -1.0f;
+				}
+
+				IntersectPacket(packetRays, packetHits);
+				for (size_t r = 0; r < 4 && first + r < rays.size(); r++)
+					hits[first + r] = packetHits[r];
+			}
+		}, 64);
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+// Bounding volume hierarchy over a mesh's triangles for ray casts, picking and line of sight
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// 32 bytes so two fit a cache line, children of a node are always next to each other
+	// An interior node has count 0 and its children at leftOrFirst and leftOrFirst + 1,
+	// a leaf holds count triangles from leftOrFirst in the BVH's triangle order
+	struct BvhNode
+	{
+		glm::vec3 boxMin{ 0 };
+		uint32_t leftOrFirst{ 0 };
+		glm::vec3 boxMax{ 0 };
+		uint32_t count{ 0 };
+	};
+
+	struct BvhRay
+	{
+		glm::vec3 origin{ 0 };
+		glm::vec3 direction{ 0, 0, 1 };
+		float maxDistance{ 1e30f };
+	};
+
+	// Nearest hit along a ray, triangle is the index into the mesh's elements / 3 and u, v its barycentrics
+	struct BvhHit
+	{
+		static constexpr uint32_t KNoTriangle{ 0xffffffffu };
+
+		float distance{ 0 };
+		uint32_t triangle{ KNoTriangle };
+		float u{ 0 };
+		float v{ 0 };
+
+		bool Hit() const { return triangle != KNoTriangle; }
+	};
+
+	// Binned surface area heuristic build, split over the thread pool below the first few levels
+	// Triangles are copied in leaf order with their edges precomputed so a leaf's triangles are read in one run
+	class MeshBvh
+	{
+	private:
+		// First vertex and the two edges from it, as the intersection test wants them
+		struct BvhTriangle
+		{
+			glm::vec3 v0;
+			glm::vec3 edge1;
+			glm::vec3 edge2;
+		};
+
+		std::vector<BvhNode> m_nodes;
+		std::vector<BvhTriangle> m_triangles;
+
+		// Mesh triangle of each entry in m_triangles
+		std::vector<uint32_t> m_triangleIndices;
+
+		// Cooked into the mesh cache and read back as they are
+		friend class MeshCache;
+
+		template<bool anyHit>
+		bool Traverse(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit) const;
+	public:
+		// Leaves hold no more than this, fewer when splitting is cheaper by the heuristic
+		static constexpr uint32_t KMaxLeafTriangles{ 8 };
+
+		// Builds over the triangles of elements, replacing any previous tree
+		void Build(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& elements);
+		void Clear();
+
+		// Nearest hit within maxDistance, direction need not be normalised, distances are in units of its length
+		bool IntersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, BvhHit& hit) const;
+
+		// True if anything is hit within maxDistance, stops at the first hit found so is cheaper for line of sight
+		bool IsOccluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+
+		// Four rays traced together with SSE, sharing each node visit. Best for coherent rays such as neighbouring pixels.
+		// Returns a mask with bit i set if rays[i] hit.
+		int IntersectPacket(const BvhRay rays[4], BvhHit hits[4]) const;
+
+		// Any number of rays, four at a time split over the thread pool
+		void IntersectRays(const std::vector<BvhRay>& rays, std::vector<BvhHit>& hits) const;
+
+		bool Empty() const { return m_nodes.empty(); }
+		size_t NumNodes() const { return m_nodes.size(); }
+		size_t NumTriangles() const { return m_triangles.size(); }
+		size_t MemoryBytes() const
+		{
+			return m_nodes.size() * sizeof(BvhNode) + m_triangles.size() * sizeof(BvhTriangle) + m_triangleIndices.size() * sizeof(uint32_t);
+		}
+		const std::vector<BvhNode>& GetNodes() const { return m_nodes; }
+	};
+}
@@ -0,0 +1,457 @@
+#include "MeshCache.h"
+#include "Mesh.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace Helpers
+{
+	// Blobs start on this boundary so they can be handed to SIMD code or the GPU as they are
+	static constexpr size_t KBlobAlignment{ 16 };
+
+	// FNV-1a hash of a whole file
+	bool HashFile(const std::string& filepath, uint64_t& hash)
+	{
+		MappedFile file;
+		if (!file.Open(filepath))
+			return false;
+
+		hash = 14695981039346656037ull;
+		const BYTE* data{ file.GetData() };
+		for (size_t i = 0; i < file.Size(); i++)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return true;
+	}
+
+	// Appends to the file image being built
+	class CacheWriter
+	{
+	private:
+		std::vector<BYTE> m_bytes;
+	public:
+		std::vector<BYTE>& Bytes() { return m_bytes; }
+		uint64_t Offset() const { return m_bytes.size(); }
+
+		void Align() { m_bytes.resize((m_bytes.size() + KBlobAlignment - 1) & ~(KBlobAlignment - 1)); }
+
+		void Write(const void* data, size_t size)
+		{
+			if (size)
+				m_bytes.insert(m_bytes.end(), (const BYTE*)data, (const BYTE*)data + size);
+		}
+
+		template<typename T> void Write(const T& value) { Write(&value, sizeof(T)); }
+
+		// Aligned blob, returns its offset
+		template<typename T> uint64_t WriteBlob(const std::vector<T>& values)
+		{
+			Align();
+			const uint64_t offset{ Offset() };
+			Write(values.data(), values.size() * sizeof(T));
+			return offset;
+		}
+
+		void WriteString(const std::string& str)
+		{
+			Write((uint32_t)str.size());
+			Write(str.data(), str.size());
+		}
+
+		template<typename T> void WriteArray(const std::vector<T>& values)
+		{
+			Write((uint32_t)values.size());
+			Write(values.data(), values.size() * sizeof(T));
+		}
+	};
+
+	// Reads records back out of the mapping, failing rather than reading past the end
+	class CacheReader
+	{
+	private:
+		const BYTE* m_data;
+		size_t m_size;
+		size_t m_offset;
+	public:
+		CacheReader(const BYTE* data, size_t size, size_t offset) : m_data(data), m_size(size), m_offset(offset) {}
+
+		bool Read(void* data, size_t size)
+		{
+			if (size > m_size || m_offset > m_size - size)
+				return false;
+			if (size)
+				memcpy(data, m_data + m_offset, size);
+			m_offset += size;
+			return true;
+		}
+
+		template<typename T> bool Read(T& value) { return Read(&value, sizeof(T)); }
+
+		bool ReadString(std::string& str)
+		{
+			uint32_t length;
+			if (!Read(length) || length > m_size - m_offset)
+				return false;
+			str.assign((const char*)m_data + m_offset, length);
+			m_offset += length;
+			return true;
+		}
+
+		template<typename T> bool ReadArray(std::vector<T>& values)
+		{
+			uint32_t count;
+			if (!Read(count) || count > (m_size - m_offset) / sizeof(T))
+				return false;
+			values.resize(count);
+			return Read(values.data(), count * sizeof(T));
+		}
+	};
+
+	// Writes the meshes, materials and node hierarchy
+	bool MeshCache::Write(const std::string& filepath, uint64_t sourceHash, uint32_t postProcessFlags,
+		const std::vector<Mesh>& meshes, const std::vector<Material>& materials, const std::vector<Node>& nodes,
+		float animationDuration, bool cooked, const std::vector<IndexOptimisationReport>& indexReports)
+	{
+		MeshCacheHeader header;
+		header.cooked = cooked ? 1 : 0;
+		header.sourceHash = sourceHash;
+		header.postProcessFlags = postProcessFlags;
+		header.numMeshes = (uint32_t)meshes.size();
+		header.numMaterials = (uint32_t)materials.size();
+		header.animationDuration = animationDuration;
+
+		CacheWriter writer;
+		writer.Write(header);
+
+		// The table is filled in once the blobs have been placed
+		std::vector<MeshCacheEntry> entries(meshes.size());
+		writer.Write(entries.data(), entries.size() * sizeof(MeshCacheEntry));
+
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const Mesh& mesh{ meshes[i] };
+			MeshCacheEntry& entry{ entries[i] };
+
+			entry.nameOffset = writer.Offset();
+			entry.nameLength = (uint32_t)mesh.name.size();
+			writer.Write(mesh.name.data(), mesh.name.size());
+
+			entry.materialIndex = (uint32_t)mesh.materialIndex;
+			entry.numVertices = (uint32_t)mesh.vertices.size();
+			entry.numNormals = (uint32_t)mesh.normals.size();
+			entry.numUVCoords = (uint32_t)mesh.uvCoords.size();
+			entry.numElements = (uint32_t)mesh.elements.size();
+			entry.numSkinnedVertices = (uint32_t)mesh.boneIndices.size();
+			entry.numBones = (uint32_t)mesh.bones.size();
+
+			entry.verticesOffset = writer.WriteBlob(mesh.vertices);
+			entry.normalsOffset = writer.WriteBlob(mesh.normals);
+			entry.uvCoordsOffset = writer.WriteBlob(mesh.uvCoords);
+			entry.elementsOffset = writer.WriteBlob(mesh.elements);
+			entry.boneIndicesOffset = writer.WriteBlob(mesh.boneIndices);
+			entry.boneWeightsOffset = writer.WriteBlob(mesh.boneWeights);
+			entry.bonesOffset = writer.WriteBlob(mesh.bones);
+			entry.bounds = mesh.bounds;
+			if (!cooked)
+				continue;
+
+			if (i < indexReports.size())
+				entry.indexReport = indexReports[i];
+
+			std::vector<MeshCacheLod> lods(mesh.lods.size());
+			for (size_t l = 0; l < lods.size(); l++)
+			{
+				lods[l].elementsOffset = writer.WriteBlob(mesh.lods[l].elements);
+				lods[l].numElements = (uint32_t)mesh.lods[l].elements.size();
+				lods[l].error = mesh.lods[l].error;
+			}
+			entry.numLods = (uint32_t)lods.size();
+			entry.lodsOffset = writer.WriteBlob(lods);
+
+			entry.numClusters = (uint32_t)mesh.clusters.size();
+			entry.clustersOffset = writer.WriteBlob(mesh.clusters);
+
+			entry.numBvhNodes = (uint32_t)mesh.bvh.m_nodes.size();
+			entry.numBvhTriangles = (uint32_t)mesh.bvh.m_triangles.size();
+			entry.bvhNodesOffset = writer.WriteBlob(mesh.bvh.m_nodes);
+			entry.bvhTrianglesOffset = writer.WriteBlob(mesh.bvh.m_triangles);
+			entry.bvhTriangleIndicesOffset = writer.WriteBlob(mesh.bvh.m_triangleIndices);
+		}
+
+		header.materialsOffset = writer.Offset();
+		for (const Material& material : materials)
+		{
+			writer.WriteString(material.diffuseTextureFilename);
+			writer.WriteString(material.specularTextureFilename);
+			writer.Write(material.diffuseColour);
+			writer.Write(material.ambientColour);
+			writer.Write(material.emissiveColour);
+			writer.Write(material.specularColour);
+			writer.Write(material.specularFactor);
+		}
+
+		// Children are rebuilt from the parents on reading
+		header.nodesOffset = writer.Offset();
+		header.numNodes = (uint32_t)nodes.size();
+		for (const Node& node : nodes)
+		{
+			writer.Write((int32_t)node.parent);
+			writer.WriteString(node.name);
+			writer.Write(node.transform);
+			writer.WriteArray(node.meshIndices);
+			writer.WriteArray(node.translationKeyTimes);
+			writer.WriteArray(node.translationKeys);
+			writer.WriteArray(node.rotationKeyTimes);
+			writer.WriteArray(node.rotationKeys);
+			writer.WriteArray(node.scaleKeyTimes);
+			writer.WriteArray(node.scaleKeys);
+		}
+
+		header.fileSize = writer.Offset();
+		memcpy(writer.Bytes().data(), &header, sizeof(header));
+		memcpy(writer.Bytes().data() + sizeof(header), entries.data(), entries.size() * sizeof(MeshCacheEntry));
+
+		std::ofstream file(filepath, std::ios::binary);
+		if (!file)
+		{
+			std::cout << "Could not create mesh cache: " << filepath << std::endl;
+			return false;
+		}
+		file.write((const char*)writer.Bytes().data(), writer.Bytes().size());
+
+		return (bool)file;
+	}
+
+	// Maps the file and checks it matches the source, returns false if not usable
+	bool MeshCache::Open(const std::string& filepath, uint64_t sourceHash, uint32_t postProcessFlags, bool requireCooked)
+	{
+		Close();
+
+		// A missing cache is the normal cold start case so stays quiet
+		if (GetFileAttributesA(filepath.c_str()) == INVALID_FILE_ATTRIBUTES || !m_file.Open(filepath))
+			return false;
+
+		if (m_file.Size() < sizeof(MeshCacheHeader))
+		{
+			Close();
+			return false;
+		}
+		memcpy(&m_header, m_file.GetData(), sizeof(m_header));
+
+		const MeshCacheHeader expected;
+		if (memcmp(m_header.magic, expected.magic, sizeof(expected.magic)) != 0 || m_header.version != expected.version ||
+			m_header.fileSize != m_file.Size() ||
+			sizeof(MeshCacheHeader) + (uint64_t)m_header.numMeshes * sizeof(MeshCacheEntry) > m_header.fileSize)
+		{
+			std::cout << "Not a valid mesh cache: " << filepath << std::endl;
+			Close();
+			return false;
+		}
+
+		if (m_header.sourceHash != sourceHash || (m_header.postProcessFlags & postProcessFlags) != postProcessFlags ||
+			(requireCooked && !m_header.cooked))
+		{
+			Close();
+			return false;
+		}
+
+		// Every blob must lie inside the file before anyone is handed a pointer to it
+		const auto inFile = [this](uint64_t offset, uint64_t count, uint64_t size)
+		{
+			return offset <= m_header.fileSize && count <= (m_header.fileSize - offset) / size;
+		};
+		for (size_t i = 0; i < m_header.numMeshes; i++)
+		{
+			const MeshCacheEntry& entry{ Entry(i) };
+			if (!inFile(entry.nameOffset, entry.nameLength, 1) ||
+				!inFile(entry.verticesOffset, entry.numVertices, sizeof(glm::vec3)) ||
+				!inFile(entry.normalsOffset, entry.numNormals, sizeof(glm::vec3)) ||
+				!inFile(entry.uvCoordsOffset, entry.numUVCoords, sizeof(glm::vec2)) ||
+				!inFile(entry.elementsOffset, entry.numElements, sizeof(unsigned int)) ||
+				!inFile(entry.boneIndicesOffset, entry.numSkinnedVertices, sizeof(glm::uvec4)) ||
+				!inFile(entry.boneWeightsOffset, entry.numSkinnedVertices, sizeof(glm::vec4)) ||
+				!inFile(entry.bonesOffset, entry.numBones, sizeof(MeshBone)) ||
+				!inFile(entry.lodsOffset, entry.numLods, sizeof(MeshCacheLod)) ||
+				!inFile(entry.clustersOffset, entry.numClusters, sizeof(MeshCluster)) ||
+				!inFile(entry.bvhNodesOffset, entry.numBvhNodes, sizeof(BvhNode)) ||
+				!inFile(entry.bvhTrianglesOffset, entry.numBvhTriangles, sizeof(MeshBvh::BvhTriangle)) ||
+				!inFile(entry.bvhTriangleIndicesOffset, entry.numBvhTriangles, sizeof(uint32_t)) ||
+				!CookedInRange(i))
+			{
+				std::cout << "Mesh cache is corrupt: " << filepath << std::endl;
+				Close();
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Levels of detail must lie in the file, and clusters and BVH nodes only refer to what the mesh has,
+	// so nothing read later walks off the end. A check per record, not per vertex.
+	bool MeshCache::CookedInRange(size_t mesh) const
+	{
+		const MeshCacheEntry& entry{ Entry(mesh) };
+		for (uint32_t l = 0; l < entry.numLods; l++)
+		{
+			const MeshCacheLod& lod{ GetLod(mesh, l) };
+			if (lod.elementsOffset > m_header.fileSize || lod.numElements > (m_header.fileSize - lod.elementsOffset) / sizeof(unsigned int))
+				return false;
+		}
+
+		const MeshCluster* clusters{ At<MeshCluster>(entry.clustersOffset) };
+		for (uint32_t c = 0; c < entry.numClusters; c++)
+		{
+			if (clusters[c].firstElement > entry.numElements || clusters[c].numElements > entry.numElements - clusters[c].firstElement)
+				return false;
+		}
+
+		const BvhNode* nodes{ At<BvhNode>(entry.bvhNodesOffset) };
+		for (uint32_t n = 0; n < entry.numBvhNodes; n++)
+		{
+			const BvhNode& node{ nodes[n] };
+			// Children always come after their parent, so a walk down the tree ends
+			if (node.count == 0 ? node.leftOrFirst <= n || node.leftOrFirst + 1 >= entry.numBvhNodes :
+				node.leftOrFirst > entry.numBvhTriangles || node.count > entry.numBvhTriangles - node.leftOrFirst)
+				return false;
+		}
+		return true;
+	}
+
+	VertexStreams MeshCache::GetVertexStreams(size_t mesh) const
+	{
+		const MeshCacheEntry& entry{ Entry(mesh) };
+		VertexStreams streams;
+		streams.numVertices = entry.numVertices;
+		streams.vertices = At<glm::vec3>(entry.verticesOffset);
+		streams.normals = entry.numNormals == entry.numVertices ? At<glm::vec3>(entry.normalsOffset) : nullptr;
+		streams.uvCoords = entry.numUVCoords == entry.numVertices ? At<glm::vec2>(entry.uvCoordsOffset) : nullptr;
+		if (entry.numSkinnedVertices == entry.numVertices)
+		{
+			streams.boneIndices = At<glm::uvec4>(entry.boneIndicesOffset);
+			streams.boneWeights = At<glm::vec4>(entry.boneWeightsOffset);
+		}
+		return streams;
+	}
+
+	// Copies every mesh out in whole blobs
+	void MeshCache::ReadMeshes(std::vector<Mesh>& meshes, bool copyVertexData) const
+	{
+		meshes.resize(m_header.numMeshes);
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			const MeshCacheEntry& entry{ Entry(i) };
+			Mesh& mesh{ meshes[i] };
+
+			mesh.name.assign(At<char>(entry.nameOffset), entry.nameLength);
+			const MeshBone* bones{ At<MeshBone>(entry.bonesOffset) };
+			mesh.bones.assign(bones, bones + entry.numBones);
+			mesh.materialIndex = entry.materialIndex;
+			mesh.bounds = entry.bounds;
+
+			const MeshCluster* clusters{ At<MeshCluster>(entry.clustersOffset) };
+			mesh.clusters.assign(clusters, clusters + entry.numClusters);
+
+			const BvhNode* bvhNodes{ At<BvhNode>(entry.bvhNodesOffset) };
+			const MeshBvh::BvhTriangle* bvhTriangles{ At<MeshBvh::BvhTriangle>(entry.bvhTrianglesOffset) };
+			const uint32_t* bvhTriangleIndices{ At<uint32_t>(entry.bvhTriangleIndicesOffset) };
+			mesh.bvh.m_nodes.assign(bvhNodes, bvhNodes + entry.numBvhNodes);
+			mesh.bvh.m_triangles.assign(bvhTriangles, bvhTriangles + entry.numBvhTriangles);
+			mesh.bvh.m_triangleIndices.assign(bvhTriangleIndices, bvhTriangleIndices + entry.numBvhTriangles);
+
+			mesh.lods.resize(entry.numLods);
+			for (size_t l = 0; l < mesh.lods.size(); l++)
+			{
+				mesh.lods[l].error = GetLod(i, l).error;
+				if (copyVertexData)
+					mesh.lods[l].elements.assign(GetLodElements(i, l), GetLodElements(i, l) + GetLod(i, l).numElements);
+			}
+
+			if (!copyVertexData)
+				continue;
+
+			const VertexStreams streams{ GetVertexStreams(i) };
+			mesh.vertices.assign(streams.vertices, streams.vertices + entry.numVertices);
+			if (streams.normals)
+				mesh.normals.assign(streams.normals, streams.normals + entry.numVertices);
+			if (streams.uvCoords)
+				mesh.uvCoords.assign(streams.uvCoords, streams.uvCoords + entry.numVertices);
+			if (streams.boneIndices)
+			{
+				mesh.boneIndices.assign(streams.boneIndices, streams.boneIndices + entry.numVertices);
+				mesh.boneWeights.assign(streams.boneWeights, streams.boneWeights + entry.numVertices);
+			}
+			mesh.elements.assign(GetElements(i), GetElements(i) + entry.numElements);
+		}
+	}
+
+	// Materials are small so are parsed rather than mapped, returns false if the records run off the end
+	bool MeshCache::ReadMaterials(std::vector<Material>& materials) const
+	{
+		CacheReader reader(m_file.GetData(), m_file.Size(), (size_t)m_header.materialsOffset);
+
+		materials.resize(m_header.numMaterials);
+		for (Material& material : materials)
+		{
+			if (!reader.ReadString(material.diffuseTextureFilename) ||
+				!reader.ReadString(material.specularTextureFilename) ||
+				!reader.Read(material.diffuseColour) ||
+				!reader.Read(material.ambientColour) ||
+				!reader.Read(material.emissiveColour) ||
+				!reader.Read(material.specularColour) ||
+				!reader.Read(material.specularFactor))
+				return false;
+		}
+		return true;
+	}
+
+	// Reads the node array back, checking it is still ordered as the loader builds it
+	bool MeshCache::ReadNodes(std::vector<Node>& nodes) const
+	{
+		CacheReader reader(m_file.GetData(), m_file.Size(), (size_t)m_header.nodesOffset);
+
+		nodes.clear();
+		nodes.resize(m_header.numNodes);
+		for (uint32_t i = 0; i < m_header.numNodes; i++)
+		{
+			Node& node{ nodes[i] };
+			int32_t parent;
+			if (!reader.Read(parent) ||
+				!reader.ReadString(node.name) ||
+				!reader.Read(node.transform) ||
+				!reader.ReadArray(node.meshIndices) ||
+				!reader.ReadArray(node.translationKeyTimes) ||
+				!reader.ReadArray(node.translationKeys) ||
+				!reader.ReadArray(node.rotationKeyTimes) ||
+				!reader.ReadArray(node.rotationKeys) ||
+				!reader.ReadArray(node.scaleKeyTimes) ||
+				!reader.ReadArray(node.scaleKeys))
+				return false;
+
+			// Every key needs a time
+			if (node.translationKeyTimes.size() != node.translationKeys.size() ||
+				node.rotationKeyTimes.size() != node.rotationKeys.size() ||
+				node.scaleKeyTimes.size() != node.scaleKeys.size())
+				return false;
+
+			// Only the root may be without a parent, parents come first and siblings are contiguous
+			if ((i == 0) != (parent < 0) || parent >= (int32_t)i)
+				return false;
+
+			node.parent = parent;
+			if (parent >= 0)
+			{
+				Node& parentNode{ nodes[parent] };
+				if (parentNode.numChildren == 0)
+					parentNode.firstChild = i;
+				else if (parentNode.firstChild + parentNode.numChildren != i)
+					return false;
+				parentNode.numChildren++;
+			}
+		}
+
+		return true;
+	}
+}
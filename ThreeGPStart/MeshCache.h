@@ -0,0 +1,134 @@
+#pragma once
+// Binary cache of a loaded model so warm starts can skip ASSIMP entirely
+
+#include "ExternalLibraryHeaders.h"
+#include "MappedFile.h"
+#include "MeshBounds.h"
+#include "IndexOptimiser.h"
+
+#include <cstdint>
+
+namespace Helpers
+{
+	struct Mesh;
+	struct Material;
+	struct Node;
+	struct VertexStreams;
+
+	// Start of a mesh cache file, a table of MeshCacheEntry follows straight after
+	// The cache is only used when the source hash matches and it was made with every post processing step the load asks for
+	struct MeshCacheHeader
+	{
+		char magic[4]{ 'T', 'G', 'M', 'C' };
+		uint32_t version{ 6 };
+		uint64_t sourceHash{ 0 };
+		uint32_t postProcessFlags{ 0 };
+		uint32_t numMeshes{ 0 };
+		uint32_t numMaterials{ 0 };
+		uint32_t numNodes{ 0 };
+		uint64_t materialsOffset{ 0 };
+		uint64_t nodesOffset{ 0 };
+		uint64_t fileSize{ 0 };
+		float animationDuration{ 0 };
+
+		// Non zero when the meshes were stored cooked, see ModelLoader::LoadFromFile
+		uint32_t cooked{ 0 };
+	};
+
+	// One level of detail of a cooked mesh, its elements are a blob like the full detail ones
+	struct MeshCacheLod
+	{
+		uint64_t elementsOffset{ 0 };
+		uint32_t numElements{ 0 };
+		float error{ 0 };
+	};
+
+	// Where one mesh's blobs are, offsets are from the start of the file and 16 byte aligned
+	// Counts of normals, uvs and skinning data are 0 when the mesh has none
+	// A cooked mesh also has its levels of detail, a MeshCacheLod each, clusters, BVH and index optimisation figures,
+	// otherwise those counts are 0. Bounds are always stored.
+	struct MeshCacheEntry
+	{
+		uint64_t nameOffset{ 0 };
+		uint64_t verticesOffset{ 0 };
+		uint64_t normalsOffset{ 0 };
+		uint64_t uvCoordsOffset{ 0 };
+		uint64_t elementsOffset{ 0 };
+		uint64_t boneIndicesOffset{ 0 };
+		uint64_t boneWeightsOffset{ 0 };
+		uint64_t bonesOffset{ 0 };
+		uint32_t nameLength{ 0 };
+		uint32_t materialIndex{ 0 };
+		uint32_t numVertices{ 0 };
+		uint32_t numNormals{ 0 };
+		uint32_t numUVCoords{ 0 };
+		uint32_t numElements{ 0 };
+		uint32_t numSkinnedVertices{ 0 };
+		uint32_t numBones{ 0 };
+
+		uint64_t lodsOffset{ 0 };
+		uint64_t clustersOffset{ 0 };
+		uint64_t bvhNodesOffset{ 0 };
+		uint64_t bvhTrianglesOffset{ 0 };
+		uint64_t bvhTriangleIndicesOffset{ 0 };
+		uint32_t numLods{ 0 };
+		uint32_t numClusters{ 0 };
+		uint32_t numBvhNodes{ 0 };
+		uint32_t numBvhTriangles{ 0 };
+
+		MeshBounds bounds;
+		IndexOptimisationReport indexReport;
+	};
+
+	// FNV-1a hash of a whole file, returns false if it cannot be read
+	bool HashFile(const std::string& filepath, uint64_t& hash);
+
+	// Memory mapped view of a mesh cache file
+	// Vertex data and elements are handed out as pointers into the mapping so they can go straight to the GPU
+	class MeshCache
+	{
+	private:
+		MappedFile m_file;
+		MeshCacheHeader m_header;
+
+		const MeshCacheEntry& Entry(size_t mesh) const { return ((const MeshCacheEntry*)(m_file.GetData() + sizeof(MeshCacheHeader)))[mesh]; }
+		template<typename T> const T* At(uint64_t offset) const { return (const T*)(m_file.GetData() + offset); }
+		bool CookedInRange(size_t mesh) const;
+	public:
+		// The cache file that goes with a model file
+		static std::string CachePath(const std::string& sourcePath) { return sourcePath + ".meshcache"; }
+
+		// Writes the meshes, materials and node hierarchy with its animation keys, returns false on error
+		// When cooked the meshes' levels of detail, clusters and BVHs go in too, with indexReports[i] for meshes[i]
+		static bool Write(const std::string& filepath, uint64_t sourceHash, uint32_t postProcessFlags,
+			const std::vector<Mesh>& meshes, const std::vector<Material>& materials, const std::vector<Node>& nodes,
+			float animationDuration, bool cooked, const std::vector<IndexOptimisationReport>& indexReports);
+
+		// Maps the file, returns false if it is missing, corrupt, made from a different source, missing any of the flags
+		// or, when requireCooked is set, not cooked
+		bool Open(const std::string& filepath, uint64_t sourceHash, uint32_t postProcessFlags, bool requireCooked = false);
+		void Close() { m_file.Close(); }
+
+		bool IsOpen() const { return m_file.IsOpen(); }
+		bool IsCooked() const { return m_header.cooked != 0; }
+		size_t NumMeshes() const { return m_header.numMeshes; }
+		float AnimationDuration() const { return m_header.animationDuration; }
+
+		// Direct views of a mesh's data, valid while the cache is open
+		const MeshCacheEntry& GetEntry(size_t mesh) const { return Entry(mesh); }
+		VertexStreams GetVertexStreams(size_t mesh) const;
+		const unsigned int* GetElements(size_t mesh) const { return At<unsigned int>(Entry(mesh).elementsOffset); }
+		const MeshCacheLod& GetLod(size_t mesh, size_t lod) const { return At<MeshCacheLod>(Entry(mesh).lodsOffset)[lod]; }
+		const unsigned int* GetLodElements(size_t mesh, size_t lod) const { return At<unsigned int>(GetLod(mesh, lod).elementsOffset); }
+
+		// Copies every mesh out in whole blobs, no per vertex work
+		// Without copyVertexData the vertices, skinning data and elements of every level are left in the mapping
+		void ReadMeshes(std::vector<Mesh>& meshes, bool copyVertexData) const;
+
+		// Returns false if the material records are bad
+		bool ReadMaterials(std::vector<Material>& materials) const;
+
+		// Reads the node array back, returns false if the records are bad
+		bool ReadNodes(std::vector<Node>& nodes) const;
+	};
+}
@@ -0,0 +1,148 @@
+#include "MeshClusters.h"
+#include "Mesh.h"
+
+#include <algorithm>
+
+namespace Helpers
+{
+	// Cones wider than this (as the cosine of the widest normal from the axis) are too wide to ever cull
+	static constexpr float KMinConeSpread{ 0.1f };
+
+	// Bounds and normal cone of one finished cluster
+	static void ComputeClusterBounds(const Mesh& mesh, MeshCluster& cluster)
+	{
+		const unsigned int* elements{ &mesh.elements[cluster.firstElement] };
+
+		glm::vec3 boxMin{ mesh.vertices[elements[0]] };
+		glm::vec3 boxMax{ boxMin };
+		for (GLuint i = 1; i < cluster.numElements; i++)
+		{
+			boxMin = glm::min(boxMin, mesh.vertices[elements[i]]);
+			boxMax = glm::max(boxMax, mesh.vertices[elements[i]]);
+		}
+
+		cluster.centre = (boxMin + boxMax) * 0.5f;
+		float radiusSq{ 0 };
+		for (GLuint i = 0; i < cluster.numElements; i++)
+		{
+			const glm::vec3 offset{ mesh.vertices[elements[i]] - cluster.centre };
+			radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+		}
+		cluster.radius = std::sqrt(radiusSq);
+
+		// Cone axis is the average of the face normals, the cutoff comes from the one furthest from it
+		std::vector<glm::vec3> normals;
+		normals.reserve(cluster.numElements / 3);
+		glm::vec3 normalSum{ 0 };
+		for (GLuint i = 0; i < cluster.numElements; i += 3)
+		{
+			const glm::vec3& p0{ mesh.vertices[elements[i]] };
+			const glm::vec3 cross{ glm::cross(mesh.vertices[elements[i + 1]] - p0, mesh.vertices[elements[i + 2]] - p0) };
+			const float length{ glm::length(cross) };
+			if (length <= 0)
+				continue;
+			normals.push_back(cross / length);
+			normalSum += normals.back();
+		}
+
+		cluster.coneCutoff = 2.0f;
+		const float sumLength{ glm::length(normalSum) };
+		if (normals.empty() || sumLength <= 0)
+			return;
+
+		cluster.coneAxis = normalSum / sumLength;
+		float minDot{ 1.0f };
+		for (const glm::vec3& normal : normals)
+			minDot = std::min(minDot, glm::dot(normal, cluster.coneAxis));
+		if (minDot <= KMinConeSpread)
+			return;
+
+		// Apex far enough back along the axis that every triangle's plane is in front of it
+		float apexDistance{ 0 };
+		size_t n{ 0 };
+		for (GLuint i = 0; i < cluster.numElements; i += 3)
+		{
+			const glm::vec3& p0{ mesh.vertices[elements[i]] };
+			const glm::vec3 cross{ glm::cross(mesh.vertices[elements[i + 1]] - p0, mesh.vertices[elements[i + 2]] - p0) };
+			if (glm::length(cross) <= 0)
+				continue;
+
+			const glm::vec3& normal{ normals[n++] };
+			const float distance{ glm::dot(cluster.centre - p0, normal) / glm::dot(cluster.coneAxis, normal) };
+			apexDistance = std::max(apexDistance, distance);
+		}
+
+		cluster.coneApex = cluster.centre - cluster.coneAxis * apexDistance;
+		cluster.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+
+	// Walks the triangles in order, starting a new cluster whenever the next triangle would not fit
+	void BuildMeshClusters(Mesh& mesh, size_t maxVertices, size_t maxTriangles)
+	{
+		mesh.clusters.clear();
+		if (mesh.elements.size() < 3 || maxVertices < 3 || maxTriangles < 1)
+			return;
+
+		// Which cluster last used each vertex, so counting distinct vertices needs no clearing
+		std::vector<unsigned int> usedBy(mesh.vertices.size(), ~0u);
+		MeshCluster cluster;
+		size_t clusterVertices{ 0 };
+
+		for (size_t i = 0; i + 2 < mesh.elements.size(); i += 3)
+		{
+			const unsigned int clusterIndex{ (unsigned int)mesh.clusters.size() };
+			size_t newVertices{ 0 };
+			for (int c = 0; c < 3; c++)
+				newVertices += usedBy[mesh.elements[i + c]] != clusterIndex;
+
+			if (cluster.numElements > 0 &&
+				(clusterVertices + newVertices > maxVertices || cluster.numElements / 3 + 1 > maxTriangles))
+			{
+				ComputeClusterBounds(mesh, cluster);
+				mesh.clusters.push_back(cluster);
+
+				cluster = MeshCluster();
+				cluster.firstElement = (GLuint)i;
+				clusterVertices = 0;
+				i -= 3;
+				continue;
+			}
+
+			for (int c = 0; c < 3; c++)
+				usedBy[mesh.elements[i + c]] = clusterIndex;
+			clusterVertices += newVertices;
+			cluster.numElements += 3;
+		}
+
+		ComputeClusterBounds(mesh, cluster);
+		mesh.clusters.push_back(cluster);
+	}
+
+	// Frustum and back facing cone tests
+	size_t CullClusters(const std::vector<MeshCluster>& clusters, const Frustum& frustum, const glm::vec3& viewer,
+		std::vector<ClusterDrawRange>& ranges)
+	{
+		const size_t firstRange{ ranges.size() };
+		size_t numVisible{ 0 };
+		for (const MeshCluster& cluster : clusters)
+		{
+			if (frustum.ClassifySphere(cluster.centre, cluster.radius) == Frustum::Result::Outside)
+				continue;
+
+			if (cluster.coneCutoff <= 1.0f)
+			{
+				const glm::vec3 toApex{ cluster.coneApex - viewer };
+				const float distance{ glm::length(toApex) };
+				if (distance > 0 && glm::dot(toApex, cluster.coneAxis) >= cluster.coneCutoff * distance)
+					continue;
+			}
+
+			numVisible++;
+			if (ranges.size() > firstRange && ranges.back().firstElement + ranges.back().numElements == cluster.firstElement)
+				ranges.back().numElements += cluster.numElements;
+			else
+				ranges.push_back(ClusterDrawRange{ cluster.firstElement, cluster.numElements });
+		}
+		return numVisible;
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+// Splits meshes into small clusters of triangles that can be culled individually
+
+#include "ExternalLibraryHeaders.h"
+#include "Frustum.h"
+
+namespace Helpers
+{
+	struct Mesh;
+
+	// A run of a mesh's elements with bounds for culling
+	// The cone holds every triangle normal in the cluster: it is back facing from anywhere with
+	// dot(normalize(coneApex - viewer), coneAxis) >= coneCutoff. A cutoff above 1 means the cluster can never be back facing.
+	struct MeshCluster
+	{
+		GLuint firstElement{ 0 };
+		GLuint numElements{ 0 };
+
+		glm::vec3 centre{ 0 };
+		float radius{ 0 };
+
+		glm::vec3 coneApex{ 0 };
+		glm::vec3 coneAxis{ 0, 0, 1 };
+		float coneCutoff{ 2.0f };
+	};
+
+	// Elements to draw in one go, from CullClusters
+	struct ClusterDrawRange
+	{
+		GLuint firstElement;
+		GLuint numElements;
+	};
+
+	// Splits mesh.elements into clusters of at most maxVertices distinct vertices and maxTriangles triangles
+	// The triangles keep their order so each cluster is a contiguous range and the vertex cache order is kept
+	void BuildMeshClusters(Mesh& mesh, size_t maxVertices = 64, size_t maxTriangles = 124);
+
+	// Adds the ranges of clusters that are in the frustum and not facing away from the viewer
+	// Everything is in the mesh's model space, see Frustum::Extract. Neighbouring visible clusters are merged into one range.
+	// Returns the number of clusters that passed.
+	size_t CullClusters(const std::vector<MeshCluster>& clusters, const Frustum& frustum, const glm::vec3& viewer,
+		std::vector<ClusterDrawRange>& ranges);
+}
@@ -0,0 +1,348 @@
+#include "MeshSimplifier.h"
+#include "IndexOptimiser.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace Helpers
+{
+	// Border edges are weighted up so open edges keep their outline
+	static constexpr double KBorderWeight{ 10.0 };
+
+	// A collapse may not turn a triangle further than this, as the cosine of the angle between old and new normals
+	static constexpr float KMaxNormalTurn{ 0.25f };
+
+	// Sum of squared distances to a set of planes, each weighted by the area it came from
+	struct Quadric
+	{
+		double a00{ 0 }, a11{ 0 }, a22{ 0 }, a01{ 0 }, a02{ 0 }, a12{ 0 };
+		double b0{ 0 }, b1{ 0 }, b2{ 0 };
+		double c{ 0 };
+		double weight{ 0 };
+
+		// Plane through point with unit normal n
+		static Quadric FromPlane(const glm::dvec3& n, const glm::dvec3& point, double weight)
+		{
+			const double d{ -glm::dot(n, point) };
+			Quadric q;
+			q.a00 = weight * n.x * n.x; q.a11 = weight * n.y * n.y; q.a22 = weight * n.z * n.z;
+			q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z; q.a12 = weight * n.y * n.z;
+			q.b0 = weight * n.x * d; q.b1 = weight * n.y * d; q.b2 = weight * n.z * d;
+			q.c = weight * d * d;
+			q.weight = weight;
+			return q;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a11 += q.a11; a22 += q.a22;
+			a01 += q.a01; a02 += q.a02; a12 += q.a12;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// Weighted mean squared distance of p to the planes
+		double Error(const glm::dvec3& p) const
+		{
+			const double sum{ a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+				2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+				2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c };
+			return weight > 0 ? std::max(sum, 0.0) / weight : 0.0;
+		}
+	};
+
+	// Candidate collapse of position from onto position to
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double error;
+	};
+
+	static uint64_t EdgeKey(unsigned int a, unsigned int b)
+	{
+		return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+	}
+
+	// Simplifies by passes of non overlapping collapses, cheapest first
+	float SimplifyMesh(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+		size_t targetIndexCount, float maxError, std::vector<unsigned int>& result)
+	{
+		result = indices;
+		if (indices.size() <= targetIndexCount || positions.empty())
+			return 0;
+
+		// Vertices at the same position are wedges of one position, they differ in normal or uv
+		std::vector<unsigned int> positionOf(positions.size());
+		std::vector<glm::dvec3> positionPoints;
+		{
+			struct PositionHash
+			{
+				size_t operator()(const glm::vec3& p) const
+				{
+					// Adding zero turns -0 into +0, which compare equal so must hash the same
+					const glm::vec3 canonical{ p + 0.0f };
+					uint32_t bits[3];
+					memcpy(bits, &canonical, sizeof(bits));
+					return ((size_t)bits[0] * 73856093u) ^ ((size_t)bits[1] * 19349663u) ^ ((size_t)bits[2] * 83492791u);
+				}
+			};
+			std::unordered_map<glm::vec3, unsigned int, PositionHash> firstAt;
+			for (size_t v = 0; v < positions.size(); v++)
+			{
+				const auto inserted{ firstAt.emplace(positions[v], (unsigned int)positionPoints.size()) };
+				if (inserted.second)
+					positionPoints.push_back(glm::dvec3(positions[v]));
+				positionOf[v] = inserted.first->second;
+			}
+		}
+		const size_t numPositions{ positionPoints.size() };
+
+		// Quadrics of the original surface, collapses add them together so errors are always against the original
+		std::vector<Quadric> quadrics(numPositions);
+		{
+			std::unordered_map<uint64_t, int> edgeUses;
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				for (int e = 0; e < 3; e++)
+					edgeUses[EdgeKey(positionOf[indices[i + e]], positionOf[indices[i + (e + 1) % 3]])]++;
+			}
+
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				const unsigned int p[3]{ positionOf[indices[i]], positionOf[indices[i + 1]], positionOf[indices[i + 2]] };
+				const glm::dvec3 cross{ glm::cross(positionPoints[p[1]] - positionPoints[p[0]], positionPoints[p[2]] - positionPoints[p[0]]) };
+				const double doubleArea{ glm::length(cross) };
+				if (doubleArea <= 0)
+					continue;
+
+				const glm::dvec3 normal{ cross / doubleArea };
+				const Quadric plane{ Quadric::FromPlane(normal, positionPoints[p[0]], doubleArea * 0.5) };
+				for (int e = 0; e < 3; e++)
+					quadrics[p[e]].Add(plane);
+
+				// A plane through each open edge, at right angles to the triangle, holds the edge in place
+				for (int e = 0; e < 3; e++)
+				{
+					const unsigned int a{ p[e] };
+					const unsigned int b{ p[(e + 1) % 3] };
+					if (edgeUses[EdgeKey(a, b)] != 1)
+						continue;
+
+					const glm::dvec3 edge{ positionPoints[b] - positionPoints[a] };
+					const double length{ glm::length(edge) };
+					if (length <= 0)
+						continue;
+
+					const Quadric border{ Quadric::FromPlane(glm::normalize(glm::cross(edge, normal)), positionPoints[a],
+						length * length * KBorderWeight) };
+					quadrics[a].Add(border);
+					quadrics[b].Add(border);
+				}
+			}
+		}
+
+		const double maxErrorSq{ (double)maxError * maxError };
+		double resultErrorSq{ 0 };
+
+		std::vector<unsigned int> triangleStart(numPositions + 1);
+		std::vector<unsigned int> adjacentTriangles;
+		std::vector<unsigned char> locked(numPositions);
+		std::vector<Collapse> collapses;
+		std::vector<unsigned int> wedgeTarget(positions.size(), ~0u);
+		std::vector<unsigned int> changedWedges;
+
+		while (result.size() > targetIndexCount)
+		{
+			const size_t numTriangles{ result.size() / 3 };
+
+			// Triangles around each position
+			std::fill(triangleStart.begin(), triangleStart.end(), 0);
+			for (unsigned int index : result)
+				triangleStart[positionOf[index] + 1]++;
+			for (size_t p = 0; p < numPositions; p++)
+				triangleStart[p + 1] += triangleStart[p];
+			adjacentTriangles.resize(result.size());
+			{
+				std::vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+				for (size_t i = 0; i < result.size(); i++)
+					adjacentTriangles[fill[positionOf[result[i]]]++] = (unsigned int)(i / 3);
+			}
+
+			// Both directions of every edge, cheapest first
+			collapses.clear();
+			for (size_t t = 0; t < numTriangles; t++)
+			{
+				for (int e = 0; e < 3; e++)
+				{
+					const unsigned int a{ positionOf[result[t * 3 + e]] };
+					const unsigned int b{ positionOf[result[t * 3 + (e + 1) % 3]] };
+					Quadric merged{ quadrics[a] };
+					merged.Add(quadrics[b]);
+					collapses.push_back(Collapse{ a, b, merged.Error(positionPoints[b]) });
+					collapses.push_back(Collapse{ b, a, merged.Error(positionPoints[a]) });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.error < r.error; });
+
+			// Each collapse removes about two triangles
+			const size_t wantedCollapses{ std::max<size_t>(1, (result.size() - targetIndexCount) / 6) };
+			size_t numCollapses{ 0 };
+			std::fill(locked.begin(), locked.end(), 0);
+
+			for (const Collapse& collapse : collapses)
+			{
+				if (numCollapses >= wantedCollapses || collapse.error > maxErrorSq)
+					break;
+				if (locked[collapse.from] || locked[collapse.to])
+					continue;
+
+				// Each wedge at from must meet a single wedge at to along the edge, which it then becomes
+				// A wedge with no triangle on the edge would have nowhere to go, so that collapse is not allowed
+				bool valid{ true };
+				changedWedges.clear();
+				for (unsigned int a = triangleStart[collapse.from]; a < triangleStart[collapse.from + 1] && valid; a++)
+				{
+					const unsigned int* triangle{ &result[adjacentTriangles[a] * 3] };
+					unsigned int fromWedge{ ~0u };
+					unsigned int toWedge{ ~0u };
+					for (int c = 0; c < 3; c++)
+					{
+						if (positionOf[triangle[c]] == collapse.from)
+							fromWedge = triangle[c];
+						else if (positionOf[triangle[c]] == collapse.to)
+							toWedge = triangle[c];
+					}
+					if (toWedge == ~0u)
+						continue;
+
+					if (wedgeTarget[fromWedge] == ~0u)
+					{
+						wedgeTarget[fromWedge] = toWedge;
+						changedWedges.push_back(fromWedge);
+					}
+					else if (wedgeTarget[fromWedge] != toWedge)
+						valid = false;
+				}
+
+				// The remaining triangles must not flip or turn too far
+				for (unsigned int a = triangleStart[collapse.from]; a < triangleStart[collapse.from + 1] && valid; a++)
+				{
+					const unsigned int* triangle{ &result[adjacentTriangles[a] * 3] };
+					glm::vec3 before[3];
+					glm::vec3 after[3];
+					bool onEdge{ false };
+					for (int c = 0; c < 3; c++)
+					{
+						const unsigned int p{ positionOf[triangle[c]] };
+						onEdge = onEdge || p == collapse.to;
+						if (p == collapse.from && wedgeTarget[triangle[c]] == ~0u)
+							valid = false;
+						before[c] = glm::vec3(positionPoints[p]);
+						after[c] = glm::vec3(positionPoints[p == collapse.from ? collapse.to : p]);
+					}
+					if (onEdge || !valid)
+						continue;
+
+					const glm::vec3 normalBefore{ glm::cross(before[1] - before[0], before[2] - before[0]) };
+					const glm::vec3 normalAfter{ glm::cross(after[1] - after[0], after[2] - after[0]) };
+					if (glm::dot(normalBefore, normalAfter) <= KMaxNormalTurn * glm::length(normalBefore) * glm::length(normalAfter))
+						valid = false;
+				}
+
+				if (!valid)
+				{
+					for (unsigned int wedge : changedWedges)
+						wedgeTarget[wedge] = ~0u;
+					continue;
+				}
+
+				// Nothing touching the changed triangles may move again this pass
+				for (unsigned int a = triangleStart[collapse.from]; a < triangleStart[collapse.from + 1]; a++)
+				{
+					for (int c = 0; c < 3; c++)
+						locked[positionOf[result[adjacentTriangles[a] * 3 + c]]] = 1;
+				}
+
+				quadrics[collapse.to].Add(quadrics[collapse.from]);
+				resultErrorSq = std::max(resultErrorSq, collapse.error);
+				numCollapses++;
+			}
+
+			if (numCollapses == 0)
+				break;
+
+			// Move collapsed wedges and drop the triangles that have lost their area
+			size_t kept{ 0 };
+			for (size_t t = 0; t < numTriangles; t++)
+			{
+				unsigned int triangle[3];
+				for (int c = 0; c < 3; c++)
+				{
+					const unsigned int index{ result[t * 3 + c] };
+					triangle[c] = wedgeTarget[index] == ~0u ? index : wedgeTarget[index];
+				}
+
+				const unsigned int p0{ positionOf[triangle[0]] };
+				const unsigned int p1{ positionOf[triangle[1]] };
+				const unsigned int p2{ positionOf[triangle[2]] };
+				if (p0 == p1 || p1 == p2 || p0 == p2)
+					continue;
+
+				result[kept++] = triangle[0];
+				result[kept++] = triangle[1];
+				result[kept++] = triangle[2];
+			}
+			result.resize(kept);
+			std::fill(wedgeTarget.begin(), wedgeTarget.end(), ~0u);
+		}
+
+		return (float)std::sqrt(resultErrorSq);
+	}
+
+	// Each level starts again from the full mesh so its error is measured against the original
+	void GenerateMeshLods(Mesh& mesh, size_t maxLods, float maxError)
+	{
+		mesh.lods.clear();
+		if (mesh.vertices.empty())
+			return;
+
+		glm::vec3 minExtents;
+		glm::vec3 maxExtents;
+		mesh.GetLocalExtents(minExtents, maxExtents);
+		const float meshSize{ glm::length(maxExtents - minExtents) };
+
+		size_t previousCount{ mesh.elements.size() };
+		for (size_t lod = 1; lod <= maxLods; lod++)
+		{
+			const size_t target{ (mesh.elements.size() >> lod) / 3 * 3 };
+			if (target < 3)
+				break;
+
+			MeshLod newLod;
+			newLod.error = SimplifyMesh(mesh.elements, mesh.vertices, target, maxError * meshSize, newLod.elements);
+
+			// Not worth a level of its own if it barely saves anything
+			if (newLod.elements.empty() || newLod.elements.size() > previousCount * 9 / 10)
+				break;
+
+			previousCount = newLod.elements.size();
+			OptimiseVertexCache(newLod.elements, mesh.vertices.size());
+			mesh.lods.push_back(std::move(newLod));
+		}
+	}
+
+	// Coarsest level whose error projects to no more than pixelError pixels
+	size_t SelectLod(const std::vector<float>& levelErrors, float distance, float pixelsPerUnit, float pixelError)
+	{
+		const float maxWorldError{ pixelError * std::max(distance, 1e-3f) / pixelsPerUnit };
+
+		size_t level{ 0 };
+		while (level + 1 < levelErrors.size() && levelErrors[level + 1] <= maxWorldError)
+			level++;
+		return level;
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+// Quadric error edge collapse simplification to build level of detail index lists
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	struct Mesh;
+
+	// Simplifies a triangle list by collapsing edges onto one of their vertices, so the result indexes the same vertices
+	// Vertices sharing a position with different normals or uvs only collapse along the seam they form, keeping attributes
+	// Stops at targetIndexCount or before any collapse would move the surface more than maxError, whichever comes first
+	// Returns the error of the result, an estimate of how far its surface is from the original in model units
+	float SimplifyMesh(const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions,
+		size_t targetIndexCount, float maxError, std::vector<unsigned int>& result);
+
+	// Fills mesh.lods with up to maxLods index lists, each about half the triangles of the one before
+	// maxError is relative to the mesh's size. The chain stops early once a level no longer reduces much.
+	void GenerateMeshLods(Mesh& mesh, size_t maxLods = 4, float maxError = 0.05f);
+
+	// Level to draw at the given distance, given each level's error most detailed first (so levelErrors[0] is 0)
+	// Picks the coarsest level whose error projects to no more than pixelError pixels,
+	// pixelsPerUnit being the size in pixels of one unit at distance 1
+	size_t SelectLod(const std::vector<float>& levelErrors, float distance, float pixelsPerUnit, float pixelError);
+}
@@ -0,0 +1,184 @@
+#include "NoiseTerrain.h"
+#include "Parallel.h"
+
+#include <emmintrin.h>
+
+namespace Helpers
+{
+	// Rows smaller than this are not worth a thread of their own
+	static constexpr size_t KMinRowsPerThread{ 16 };
+
+	// Offsets that decorrelate the two warp fields from the height field
+	static constexpr float KWarpOffsetX{ 37.1f };
+	static constexpr float KWarpOffsetZ{ 91.7f };
+
+	// Shuffled lattice hash for one seed, repeated so lookups never need wrapping
+	struct NoisePermutation
+	{
+		uint8_t values[512];
+
+		explicit NoisePermutation(uint32_t seed)
+		{
+			for (int i = 0; i < 256; i++)
+				values[i] = (uint8_t)i;
+
+			// Own generator rather than std::shuffle, which differs between standard libraries
+			uint32_t state{ seed * 747796405u + 2891336453u };
+			for (int i = 255; i > 0; i--)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				std::swap(values[i], values[state % (i + 1)]);
+			}
+
+			for (int i = 0; i < 256; i++)
+				values[256 + i] = values[i];
+		}
+
+		int Hash(int x, int z) const { return values[values[x & 255] + (z & 255)]; }
+	};
+
+	// Eight evenly spaced unit gradients
+	static const float KGradientX[8]{ 1.0f, 0.7071f, 0.0f, -0.7071f, -1.0f, -0.7071f, 0.0f, 0.7071f };
+	static const float KGradientZ[8]{ 0.0f, 0.7071f, 1.0f, 0.7071f, 0.0f, -0.7071f, -1.0f, -0.7071f };
+
+	// Floor for SSE2, which has no rounding instructions
+	static __m128 Floor(__m128 value, __m128i& asInt)
+	{
+		const __m128i truncated{ _mm_cvttps_epi32(value) };
+		const __m128 truncatedFloat{ _mm_cvtepi32_ps(truncated) };
+		const __m128 roundedUp{ _mm_cmpgt_ps(truncatedFloat, value) };
+		asInt = _mm_add_epi32(truncated, _mm_castps_si128(roundedUp));
+		return _mm_sub_ps(truncatedFloat, _mm_and_ps(roundedUp, _mm_set1_ps(1.0f)));
+	}
+
+	// Gradient noise at four points, roughly -1 to 1
+	static __m128 GradientNoise4(const NoisePermutation& permutation, __m128 x, __m128 z)
+	{
+		__m128i cellX, cellZ;
+		const __m128 fx{ _mm_sub_ps(x, Floor(x, cellX)) };
+		const __m128 fz{ _mm_sub_ps(z, Floor(z, cellZ)) };
+
+		// The lattice lookups have no SIMD form, fetch the corner gradients one lane at a time
+		alignas(16) int32_t ix[4], iz[4];
+		_mm_store_si128((__m128i*)ix, cellX);
+		_mm_store_si128((__m128i*)iz, cellZ);
+
+		alignas(16) float gx[4][4], gz[4][4];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			for (int corner = 0; corner < 4; corner++)
+			{
+				const int gradient{ permutation.Hash(ix[lane] + (corner >> 1), iz[lane] + (corner & 1)) & 7 };
+				gx[corner][lane] = KGradientX[gradient];
+				gz[corner][lane] = KGradientZ[gradient];
+			}
+		}
+
+		const __m128 one{ _mm_set1_ps(1.0f) };
+		const __m128 fx1{ _mm_sub_ps(fx, one) };
+		const __m128 fz1{ _mm_sub_ps(fz, one) };
+		const __m128 d00{ _mm_add_ps(_mm_mul_ps(_mm_load_ps(gx[0]), fx), _mm_mul_ps(_mm_load_ps(gz[0]), fz)) };
+		const __m128 d01{ _mm_add_ps(_mm_mul_ps(_mm_load_ps(gx[1]), fx), _mm_mul_ps(_mm_load_ps(gz[1]), fz1)) };
+		const __m128 d10{ _mm_add_ps(_mm_mul_ps(_mm_load_ps(gx[2]), fx1), _mm_mul_ps(_mm_load_ps(gz[2]), fz)) };
+		const __m128 d11{ _mm_add_ps(_mm_mul_ps(_mm_load_ps(gx[3]), fx1), _mm_mul_ps(_mm_load_ps(gz[3]), fz1)) };
+
+		// Quintic fade, t^3 (t (6t - 15) + 10)
+		auto fade = [](__m128 t)
+		{
+			const __m128 inner{ _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f)) };
+			return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+		};
+		const __m128 u{ fade(fx) };
+		const __m128 v{ fade(fz) };
+
+		const __m128 row0{ _mm_add_ps(d00, _mm_mul_ps(v, _mm_sub_ps(d01, d00))) };
+		const __m128 row1{ _mm_add_ps(d10, _mm_mul_ps(v, _mm_sub_ps(d11, d10))) };
+
+		// Scaled so the extremes of 2D gradient noise reach about +-1
+		return _mm_mul_ps(_mm_add_ps(row0, _mm_mul_ps(u, _mm_sub_ps(row1, row0))), _mm_set1_ps(1.4142f));
+	}
+
+	// Sums the octaves at four points and maps the result to 0 to 1
+	static __m128 FractalNoise4(const NoisePermutation& permutation, const NoiseTerrainSettings& settings, __m128 x, __m128 z)
+	{
+		const __m128 signMask{ _mm_set1_ps(-0.0f) };
+		const __m128 one{ _mm_set1_ps(1.0f) };
+
+		__m128 sum{ _mm_setzero_ps() };
+		float frequency{ settings.frequency };
+		float amplitude{ 1.0f };
+		float totalAmplitude{ 0 };
+		for (int octave = 0; octave < settings.octaves; octave++)
+		{
+			const __m128 scale{ _mm_set1_ps(frequency) };
+
+			// Each octave is shifted so their lattices do not line up
+			const __m128 shift{ _mm_set1_ps(octave * 17.3f) };
+			__m128 n{ GradientNoise4(permutation, _mm_add_ps(_mm_mul_ps(x, scale), shift), _mm_add_ps(_mm_mul_ps(z, scale), shift)) };
+			if (settings.ridged)
+			{
+				n = _mm_sub_ps(one, _mm_andnot_ps(signMask, n));
+				n = _mm_mul_ps(n, n);
+			}
+			else
+				n = _mm_mul_ps(_mm_add_ps(n, one), _mm_set1_ps(0.5f));
+
+			sum = _mm_add_ps(sum, _mm_mul_ps(n, _mm_set1_ps(amplitude)));
+			totalAmplitude += amplitude;
+			frequency *= settings.lacunarity;
+			amplitude *= settings.gain;
+		}
+
+		const __m128 normalised{ _mm_div_ps(sum, _mm_set1_ps(std::max(totalAmplitude, 1e-6f))) };
+		return _mm_min_ps(_mm_max_ps(normalised, _mm_setzero_ps()), one);
+	}
+
+	void GenerateNoiseHeights(const NoiseTerrainSettings& settings, int numVertsX, int numVertsZ, std::vector<float>& heights)
+	{
+		heights.resize((size_t)numVertsX * numVertsZ);
+		const NoisePermutation permutation(settings.seed);
+
+		// The warp fields are smoother, two octave noise
+		NoiseTerrainSettings warpSettings;
+		warpSettings.octaves = 2;
+		warpSettings.frequency = settings.frequency;
+
+		const __m128 laneOffsets{ _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f) };
+		const __m128 maxHeight{ _mm_set1_ps(settings.maxHeight) };
+		const __m128 warp{ _mm_set1_ps(settings.warp * 2.0f) };
+		const __m128 half{ _mm_set1_ps(0.5f) };
+
+		ParallelFor((size_t)numVertsX, [&](size_t begin, size_t end)
+		{
+			alignas(16) float lanes[4];
+			for (size_t x = begin; x < end; x++)
+			{
+				float* row{ &heights[x * numVertsZ] };
+				for (int z = 0; z < numVertsZ; z += 4)
+				{
+					__m128 sampleX{ _mm_set1_ps((float)x) };
+					__m128 sampleZ{ _mm_add_ps(_mm_set1_ps((float)z), laneOffsets) };
+
+					if (settings.warp != 0)
+					{
+						const __m128 warpX{ FractalNoise4(permutation, warpSettings, _mm_add_ps(sampleX, _mm_set1_ps(KWarpOffsetX)), sampleZ) };
+						const __m128 warpZ{ FractalNoise4(permutation, warpSettings, sampleX, _mm_add_ps(sampleZ, _mm_set1_ps(KWarpOffsetZ))) };
+						sampleX = _mm_add_ps(sampleX, _mm_mul_ps(_mm_sub_ps(warpX, half), warp));
+						sampleZ = _mm_add_ps(sampleZ, _mm_mul_ps(_mm_sub_ps(warpZ, half), warp));
+					}
+
+					const __m128 height{ _mm_mul_ps(FractalNoise4(permutation, settings, sampleX, sampleZ), maxHeight) };
+					if (z + 4 <= numVertsZ)
+						_mm_storeu_ps(row + z, height);
+					else
+					{
+						_mm_store_ps(lanes, height);
+						std::copy(lanes, lanes + (numVertsZ - z), row + z);
+					}
+				}
+			}
+		}, KMinRowsPerThread);
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+// Seedable procedural heights, fractal gradient noise
+
+#include "ExternalLibraryHeaders.h"
+
+#include <cstdint>
+
+namespace Helpers
+{
+	// Controls for the noise terrain. The same settings always give the same heights.
+	struct NoiseTerrainSettings
+	{
+		uint32_t seed{ 1 };
+
+		// Octaves of noise summed, each lacunarity times the frequency and gain times the amplitude of the last
+		int octaves{ 6 };
+		float frequency{ 1.0f / 128.0f };
+		float lacunarity{ 2.0f };
+		float gain{ 0.5f };
+
+		// Heights run from 0 to this
+		float maxHeight{ 255.0f };
+
+		// Folds each octave into sharp ridges rather than rolling hills
+		bool ridged{ false };
+
+		// Distorts the sample positions by another noise field, in grid vertices. 0 for none.
+		float warp{ 0 };
+	};
+
+	// Fills one height per vertex of a numVertsX by numVertsZ grid, laid out as TerrainBuilder's vertices
+	// Rows are generated in parallel, four vertices at a time with SSE
+	void GenerateNoiseHeights(const NoiseTerrainSettings& settings, int numVertsX, int numVertsZ, std::vector<float>& heights);
+}
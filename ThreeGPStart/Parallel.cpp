@@ -0,0 +1,72 @@
+#include "Parallel.h"
+
+namespace Helpers
+{
+	ThreadPool::ThreadPool(size_t numWorkers)
+	{
+		for (size_t i = 0; i < numWorkers; i++)
+			m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_taskReady.notify_all();
+
+		for (std::thread& worker : m_workers)
+			worker.join();
+	}
+
+	ThreadPool& ThreadPool::Instance()
+	{
+		static ThreadPool pool(NumWorkerThreads() - 1);
+		return pool;
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_taskReady.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+				if (m_stopping)
+					return;
+
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	// Queues a task for any worker
+	void ThreadPool::Submit(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push_back(std::move(task));
+		}
+		m_taskReady.notify_one();
+	}
+
+	// Runs one queued task on the calling thread, false if there were none
+	bool ThreadPool::RunPendingTask()
+	{
+		std::function<void()> task;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_tasks.empty())
+				return false;
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+		return true;
+	}
+}
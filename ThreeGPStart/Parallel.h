@@ -0,0 +1,92 @@
+#pragma once
+// Simple data parallel helpers used by the CPU heavy builders
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Helpers
+{
+	// Number of worker threads to split data parallel work over
+	inline size_t NumWorkerThreads()
+	{
+		const unsigned int hw{ std::thread::hardware_concurrency() };
+		return hw == 0 ? 1 : (size_t)hw;
+	}
+
+	// Threads shared by everything that runs work in parallel, started on first use
+	// Threads waiting on their own tasks should help with queued ones rather than block, see RunPendingTask
+	class ThreadPool
+	{
+	private:
+		std::vector<std::thread> m_workers;
+		std::deque<std::function<void()>> m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_taskReady;
+		bool m_stopping{ false };
+
+		explicit ThreadPool(size_t numWorkers);
+		void WorkerLoop();
+	public:
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// The pool has one worker fewer than NumWorkerThreads as the thread handing out work joins in
+		static ThreadPool& Instance();
+
+		size_t NumWorkers() const { return m_workers.size(); }
+
+		// Queues a task for any worker
+		void Submit(std::function<void()> task);
+
+		// Runs one queued task on the calling thread, false if there were none
+		bool RunPendingTask();
+	};
+
+	// Splits [0, count) into contiguous ranges and calls func(begin, end) for each on the thread pool
+	// The calling thread takes the first range. Blocks until every range has been processed.
+	// minPerThread stops tiny jobs paying for threads they do not need.
+	template<typename Func>
+	void ParallelFor(size_t count, Func&& func, size_t minPerThread = 1)
+	{
+		if (count == 0)
+			return;
+
+		const size_t maxThreads{ std::max<size_t>(1, count / std::max<size_t>(1, minPerThread)) };
+		const size_t numThreads{ std::min(NumWorkerThreads(), maxThreads) };
+		if (numThreads == 1)
+		{
+			func((size_t)0, count);
+			return;
+		}
+
+		const size_t perThread{ (count + numThreads - 1) / numThreads };
+
+		ThreadPool& pool{ ThreadPool::Instance() };
+		std::atomic<size_t> remaining{ 0 };
+		for (size_t t = 1; t < numThreads; t++)
+		{
+			const size_t begin{ t * perThread };
+			const size_t end{ std::min(count, begin + perThread) };
+			if (begin >= end)
+				break;
+			remaining++;
+			pool.Submit([&func, &remaining, begin, end]() { func(begin, end); remaining--; });
+		}
+
+		func((size_t)0, std::min(count, perThread));
+
+		// Help out while waiting so nested calls cannot starve the pool
+		while (remaining > 0)
+		{
+			if (!pool.RunPendingTask())
+				std::this_thread::yield();
+		}
+	}
+}
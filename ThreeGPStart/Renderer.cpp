@@ -1,6 +1,12 @@
 #include "Renderer.h"
 #include "Camera.h"
 #include "ImageLoader.h"
+#include "TerrainBuilder.h"
+#include "TerrainQuadtree.h"
+#include "TerrainQuery.h"
+#include "TiledHeightmap.h"
+#include "IndexOptimiser.h"
+#include <chrono>
 Renderer::Renderer() 
 {
 
@@ -9,9 +15,16 @@ Renderer::Renderer()
 // On exit must clean up any OpenGL resources e.g. the program, the buffers
 Renderer::~Renderer()
 {
+	// The loading thread writes into members that are about to be destroyed, so let it finish first
+	if (m_jeepLoading.valid())
+		m_jeepLoading.wait();
+
 	// TODO: clean up any memory used including OpenGL objects via glDelete* calls
 	glDeleteProgram(m_program);
 	glDeleteProgram(SkyProgram);
+	glDeleteProgram(TerrainProgram);
+	glDeleteProgram(m_skinnedProgram);
+	glDeleteTextures(1, &TerrainHeightTex);
 	glDeleteBuffers(1, &m_VAO);
 	glDeleteBuffers(1, &SkyVAO);
 	
@@ -29,6 +42,89 @@ void Renderer::DefineGUI()
 
 	ImGui::Checkbox("Wireframe", &m_wireframe);	// A checkbox linked to a member variable
 
+	ImGui::SliderFloat("Terrain pixel error", &m_terrainPixelError, 0.25f, 16.0f);
+	ImGui::Checkbox("Terrain frustum culling", &m_terrainFrustumCulling);
+	if (m_terrainFromNoise)
+		ImGui::Text("Terrain from noise, seed %u", KTerrainNoiseSeed);
+	ImGui::Text("Terrain patches drawn: %d, %d quadrants (%s)", (int)m_terrainSelection.size(), m_terrainQuadrantsDrawn,
+		m_terrainGpuDisplacement ? "GPU displaced" : "CPU baked");
+	if (m_terrainPager.IsStarted())
+		ImGui::Text("Terrain tiles: %d resident (%.1f MB), %d loading, %d of %d applied", (int)m_terrainPager.NumResidentTiles(),
+			m_terrainPager.ResidentBytes() / (1024.0 * 1024.0), (int)m_terrainPager.NumPendingTiles(), m_terrainTilesAppliedCount,
+			(int)m_terrainTilesApplied.size());
+
+	if (m_groundHitDistance >= 0)
+	{
+		ImGui::Text("Ground in view %.1f away", m_groundHitDistance);
+		if (m_terrainGpuDisplacement && ImGui::Button("Flatten ground in view"))
+			FlattenGroundInView();
+	}
+	else
+		ImGui::Text("Ground in view: none");
+
+	if (ImGui::TreeNode("Jeep import", "Jeep import: %s%s, %.2f ms", Helpers::ImportProfileName(m_jeepImportReport.profile),
+		m_jeepImportReport.fromCache ? " from cache" : "", m_jeepImportReport.totalMilliseconds))
+	{
+		for (const Helpers::ImportStepTiming& step : m_jeepImportReport.steps)
+			ImGui::Text("%s: %.2f ms", step.name.c_str(), step.milliseconds);
+		ImGui::TreePop();
+	}
+
+	ImGui::SliderFloat("Mesh pixel error", &m_meshPixelError, 0.25f, 16.0f);
+	if (!m_jeepMeshes.empty())
+		ImGui::Text("Jeep %d mesh, %d triangles in %d ranges, %d draw calls", (int)m_jeepMeshes.size(), m_jeepTrianglesDrawn,
+			m_jeepDrawRanges, m_jeepDrawCalls);
+	ImGui::Text("Textures: %d loaded, %.1f MB, %d decodes", (int)m_textureCache.NumTextures(),
+		m_textureCache.TotalBytes() / (1024.0f * 1024.0f), (int)m_textureCache.NumDecodes());
+
+	if (!m_jeepVisible)
+		ImGui::Text("Jeep culled by its bounds");
+	if (m_jeepHitDistance >= 0)
+		ImGui::Text("Jeep in view %.1f away, picked in %.2f us", m_jeepHitDistance, m_jeepPickMicroseconds);
+	size_t bvhNodes{ 0 }, bvhBytes{ 0 };
+	for (const JeepMesh& mesh : m_jeepMeshes)
+	{
+		bvhNodes += mesh.bvh.NumNodes();
+		bvhBytes += mesh.bvh.MemoryBytes();
+	}
+	if (bvhNodes > 0)
+		ImGui::Text("Jeep BVH: %d nodes, %.1f MB", (int)bvhNodes, bvhBytes / (1024.0f * 1024.0f));
+
+	ImGui::Checkbox("Jeep cluster culling", &m_jeepClusterCulling);
+	ImGui::Text("Jeep clusters drawn: %d", m_jeepClustersDrawn);
+
+	// The reports are copied from the loader once it has finished, so are only ever touched here
+	if (m_jeepLoading.valid())
+		ImGui::Text("Jeep loading...");
+	for (size_t i = 0; i < m_meshIndexReports.size(); i++)
+	{
+		const Helpers::IndexOptimisationReport& report{ m_meshIndexReports[i] };
+		ImGui::Text("Jeep mesh %d: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", (int)i, report.before.acmr, report.after.acmr,
+			report.before.atvr, report.after.atvr);
+	}
+
+	ImGui::SliderInt("Jeep crowd", &m_crowdSize, 0, KMaxCrowd);
+	if (m_crowdBuilt > 0)
+		ImGui::Text("Jeep crowd: %d of %d instances drawn in %d draw calls", m_jeepCrowd.InstancesDrawn(), m_crowdBuilt, m_crowdDrawCalls);
+
+	// Runs at the start of the next frame, 100k separate draws take a few seconds
+	if (ImGui::Button("Benchmark instancing"))
+		m_runInstancingBenchmark = true;
+	for (const InstancingBenchmark& result : m_instancingBenchmarks)
+		ImGui::Text("%d Jeeps: instanced %.2f ms, separate %.2f ms (%.1fx)", result.instances, result.instancedMs,
+			result.separateMs, result.separateMs / std::max(result.instancedMs, 1e-6));
+
+	// Blocks the frame while it runs, the 4k grid takes a few seconds
+	if (ImGui::Button("Benchmark terrain normals"))
+	{
+		m_normalsBenchmarks.clear();
+		for (int gridCells : { 1024, 4096 })
+			m_normalsBenchmarks.push_back(Helpers::BenchmarkTerrainNormals(gridCells));
+	}
+	for (const Helpers::TerrainNormalsBenchmark& result : m_normalsBenchmarks)
+		ImGui::Text("%dx%d normals: scatter %.2f ms, gather %.2f ms (%.1fx)", result.gridCells, result.gridCells,
+			result.scatterMs, result.gatherMs, result.scatterMs / std::max(result.gatherMs, 1e-6));
+
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 		
 	ImGui::End();
@@ -126,6 +222,58 @@ bool Renderer::CreateCubeProgram()
 	return true;
 }
 
+bool Renderer::CreateTerrainProgram()
+{
+	// Create a new program (returns a unqiue id)
+	TerrainProgram = glCreateProgram();
+
+	// Load and create vertex and fragment shaders
+	// Displacing on the GPU needs a different vertex shader, the fragment side is the same either way
+	const char* vertexShaderFile{ m_terrainGpuDisplacement ? "Data/Shaders/terrain_gpu_vertex_shader.vert" : "Data/Shaders/terrain_vertex_shader.vert" };
+	GLuint vertex_shader{ Helpers::LoadAndCompileShader(GL_VERTEX_SHADER, vertexShaderFile) };
+	GLuint fragment_shader{ Helpers::LoadAndCompileShader(GL_FRAGMENT_SHADER, "Data/Shaders/fragment_shader.frag") };
+	if (vertex_shader == 0 || fragment_shader == 0)
+		return false;
+
+	// Attach the vertex shader to this program (copies it)
+	glAttachShader(TerrainProgram, vertex_shader);
+
+	// Attach the fragment shader (copies it)
+	glAttachShader(TerrainProgram, fragment_shader);
+
+	// Done with the originals of these as we have made copies
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	// Link the shaders, checking for errors
+	if (!Helpers::LinkProgramShaders(TerrainProgram))
+		return false;
+
+	return true;
+}
+
+// Same as the main program but the vertex shader skins with the bone matrix buffer
+bool Renderer::CreateSkinnedProgram()
+{
+	m_skinnedProgram = glCreateProgram();
+
+	GLuint vertex_shader{ Helpers::LoadAndCompileShader(GL_VERTEX_SHADER, "Data/Shaders/skinned_vertex_shader.vert") };
+	GLuint fragment_shader{ Helpers::LoadAndCompileShader(GL_FRAGMENT_SHADER, "Data/Shaders/fragment_shader.frag") };
+	if (vertex_shader == 0 || fragment_shader == 0)
+		return false;
+
+	glAttachShader(m_skinnedProgram, vertex_shader);
+	glAttachShader(m_skinnedProgram, fragment_shader);
+
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	if (!Helpers::LinkProgramShaders(m_skinnedProgram))
+		return false;
+
+	return true;
+}
+
 // Load / create geometry into OpenGL buffers	
 bool Renderer::InitialiseGeometry()
 {
@@ -136,6 +284,10 @@ bool Renderer::InitialiseGeometry()
 		return false;
 	if (!CreateCubeProgram())
 		return false;
+	if (!CreateTerrainProgram())
+		return false;
+	if (!CreateSkinnedProgram())
+		return false;
 
 	glm::vec3 FrontCubevertices[4] =
 	{
@@ -361,15 +513,6 @@ bool Renderer::InitialiseGeometry()
 
 	
 
-	float NumberofCellsX = 100;
-	float NumberofCellsZ = 100;
-
-	int NumberofVertsX = NumberofCellsX + 1;
-	int NumberofVertsZ = NumberofCellsZ + 1;
-	bool Diamond = true;
-
-
-	Helpers::ImageLoader IMLoader;
 	Helpers::ImageLoader IMLSkyBack;
 	Helpers::ImageLoader IMLSkyBottom;
 	Helpers::ImageLoader IMLSkyFront;
@@ -423,96 +566,98 @@ bool Renderer::InitialiseGeometry()
 		 5.0f, -5.0f,  5.0f
 	};
 
-	if (IMLoader.Load("Data\\Heightmaps\\Heightmap.jpg"))
+	// Terrain is a grid of cells with heights taken from the heightmap, or generated if that fails to load
+	// The image is only decoded to remake the tiled copy, at a reduced scale if it is bigger than the grid could ever use
+	Helpers::TerrainBuilder terrainBuilder(KTerrainCells, KTerrainCells, KTerrainSize / KTerrainCells);
+	Helpers::TiledHeightmap tiledHeightmap;
+	bool heightsLoaded{ false };
+	if (!tiledHeightmap.Open(KTiledHeightmapFilename, KHeightmapFilename))
 	{
-		float VertXToIm = IMLoader.Width() / NumberofVertsX;
-		float VertZToIm = IMLoader.Height() / NumberofVertsZ;
-
-		BYTE* HeightMapData = IMLoader.GetData();
-		for (size_t x = 0; x < NumberofVertsX; x++)
+		if (Helpers::ConvertHeightmapImage(KTiledHeightmapFilename, KHeightmapFilename, KMaxHeightmapSamples, KTerrainTileSize,
+			KTerrainSize, 255.0f))
 		{
-			for (size_t z = 0; z < NumberofVertsZ; z++)
-			{
-				float ImageX = VertXToIm * x;
-				float ImageZ = VertXToIm * z;
-
-				size_t Offset = ((size_t)ImageX + (size_t)ImageZ * IMLoader.Width()) * 4;
-				BYTE height = HeightMapData[Offset]; 
-
-				Corners.push_back(glm::vec3(x * 8, height, z * 8));
-				UV.push_back(glm::vec2(z / NumberofCellsX, x / NumberofCellsZ));
-				Normals.push_back(glm::vec3(0, 1, 0));
-			}
+			tiledHeightmap.Open(KTiledHeightmapFilename, KHeightmapFilename);
 		}
-	}
-	else
-	{
-		for (size_t i = 0; i < NumberofVertsX; i++)
+		else
 		{
-			for (size_t x = 0; x < NumberofVertsZ; x++)
+			// Still usable if the copy could not be written, at the cost of decoding the whole image
+			Helpers::ImageLoader heightmapImage;
+			if (heightmapImage.Load(KHeightmapFilename))
 			{
-				Corners.push_back(glm::vec3(i * 8, 0, x * 8));
-				UV.push_back(glm::vec2(x / NumberofCellsX, i / NumberofCellsZ));
-				Normals.push_back(glm::vec3(0, 1, 0));
+				terrainBuilder.SampleHeightmap(heightmapImage.GetData(), heightmapImage.Width(), heightmapImage.Height());
+				heightsLoaded = true;
 			}
 		}
 	}
 
+	// Baked patches cannot be refreshed as tiles arrive, so in that mode every sample the grid uses is read up front
+	bool pageTerrain{ false };
+	if (tiledHeightmap.IsOpen())
+	{
+		pageTerrain = m_terrainGpuDisplacement;
+		if (pageTerrain)
+			terrainBuilder.SampleTiledOverview(tiledHeightmap);
+		else
+			terrainBuilder.SampleTiledHeightmap(tiledHeightmap);
+		heightsLoaded = true;
+	}
 
-	for (size_t CellZ = 0; CellZ < NumberofCellsZ; CellZ++)
+	if (!heightsLoaded)
 	{
-		for (size_t CellX = 0; CellX < NumberofCellsX; CellX++)
-		{
-			int StartVertex = (CellZ * NumberofVertsX) + CellX;
-			if (Diamond)
-			{
-				//first triangle
-				elements.push_back(StartVertex);
-				elements.push_back(StartVertex + 1);
-				elements.push_back(StartVertex + NumberofVertsX);
-				//	second triangle
-				elements.push_back(StartVertex + 1);
-				elements.push_back(StartVertex + NumberofVertsX + 1);
-				elements.push_back(StartVertex + NumberofVertsX);
-		
-				std::cout << Diamond << "\n";
-			}
-			else
-			{
-				//first triangle
-				elements.push_back(StartVertex);
-				elements.push_back(StartVertex + NumberofVertsX + 1);
-				elements.push_back(StartVertex + NumberofVertsX);
-			//	second triangle
-				elements.push_back(StartVertex + 1);
-				elements.push_back(StartVertex + NumberofVertsX + 1);
-				elements.push_back(StartVertex);
-			
-				std::cout << Diamond << "\n";
-			}
-			Diamond = !Diamond;
-		}
-		Diamond = !Diamond;
+		Helpers::NoiseTerrainSettings noise;
+		noise.seed = KTerrainNoiseSeed;
+		terrainBuilder.GenerateNoise(noise);
+		m_terrainFromNoise = true;
 	}
 
+	// Ground queries for placing things on the terrain
+	m_terrainQuery.Create(terrainBuilder);
 
-	for (size_t i = 0; i < elements.size(); i += 3)
-	{
-		glm::vec3 v0{ Corners [elements[i]] };
-		glm::vec3 v1{ Corners[elements[i+1]] };
-		glm::vec3 v2{ Corners[elements[i + 2]] };
+	// Split into a quadtree of patches so distant terrain is drawn with less detail
+	if (!m_terrainQuadtree.Create(terrainBuilder, KTerrainPatchCells))
+		return false;
 
-		glm::vec3 Side1 = v1-v0;
-		glm::vec3 Side2 = v2 - v0;
+	if (m_terrainGpuDisplacement)
+	{
+		// One texel per grid vertex, z across the texture and x down it
+		// Paged terrain is quantised over the whole range the file can hold so tiles go in as they are
+		std::vector<uint16_t> quantisedHeights;
+		if (pageTerrain)
+		{
+			m_terrainHeightOffset = 0;
+			m_terrainHeightRange = tiledHeightmap.GetHeader().heightScale * 65535.0f;
+			terrainBuilder.QuantiseHeights(quantisedHeights, m_terrainHeightOffset, m_terrainHeightRange);
+		}
+		else
+		{
+			terrainBuilder.GetQuantisedHeights(quantisedHeights, m_terrainHeightOffset, m_terrainHeightRange);
+		}
 
-		glm::vec3 TriangleNormal = glm::normalize(glm::cross(Side1, Side2));
-		
-		Normals[elements[i]] += TriangleNormal;
-		Normals[elements[i+1]] += TriangleNormal;
-		Normals[elements[i+2]] += TriangleNormal;
+		glGenTextures(1, &TerrainHeightTex);
+		glBindTexture(GL_TEXTURE_2D, TerrainHeightTex);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, terrainBuilder.NumVertsZ(), terrainBuilder.NumVertsX(), 0, GL_RED, GL_UNSIGNED_SHORT, quantisedHeights.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		// Fetched per texel in the shader, no filtering or mips wanted
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		if (pageTerrain && m_terrainPager.Start(KTiledHeightmapFilename, KHeightmapFilename, KTerrainPagerBudget, KTerrainLoadRadius,
+			KTerrainPagerWorkers))
+			MapTerrainTiles(terrainBuilder);
+	}
+	else
+	{
+		Helpers::TerrainMesh terrainMesh;
+		terrainBuilder.Build(terrainMesh);
+		m_terrainQuadtree.BakeVertices(terrainBuilder, terrainMesh.normals);
+		m_terrainHeightOffset = m_terrainQuadtree.HeightOffset();
+		m_terrainHeightRange = m_terrainQuadtree.HeightRange();
 	}
-	
-	
 
 	//Skybox Prep
 	if (!IMLSkyBack.Load("Data\\Models\\Sky\\Hills\\SkyBox_Back.JPG"))
@@ -575,26 +720,13 @@ bool Renderer::InitialiseGeometry()
 	}
 
 
-	if (!IMLoader.Load("Data\\Textures\\dirt_earth-n-moss_df_.DDS"))
+	m_terrainTexture = m_textureCache.Acquire("Data\\Textures\\dirt_earth-n-moss_df_.DDS");
+	if (!m_terrainTexture)
 	{
 		MessageBox(NULL, L"Can't Load Grass Texture", L"ERROR",
 			MB_OK | MB_ICONEXCLAMATION);
 		return false;
 	}
-	else
-	{
-		//Creates the Texure object
-		glGenTextures(1, &Terraintex);
-		glBindTexture(GL_TEXTURE_2D, Terraintex);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, IMLoader.Width(), IMLoader.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, IMLoader.GetData());
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-	}
 	/*
 		TODO 2: Next you need to create VBOs for the vertices and the colours
 		You can look back to last week for examples
@@ -602,107 +734,34 @@ bool Renderer::InitialiseGeometry()
 
 
 
-	Helpers::ModelLoader loader;
-	if (!loader.LoadFromFile("Data\\Models\\Jeep\\Jeep.obj"))
-	{
-		MessageBox(NULL, L"Can't Load Jeep Model", L"ERROR",
-			MB_OK | MB_ICONEXCLAMATION);
-		return false;
-	}
-
-
-
-	for (const Helpers::Mesh& mesh : loader.GetMeshVector())
-	{
-
-		GLuint JeepPositonVBO;
-		glGenBuffers(1, &JeepPositonVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, JeepPositonVBO);
-
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.vertices.size(), mesh.vertices.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		GLuint JeepNormalsVBO;
-		glGenBuffers(1, &JeepNormalsVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, JeepNormalsVBO);
-
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.normals.size(), mesh.normals.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		GLuint JeepElementsBuffer;
-		glGenBuffers(1, &JeepElementsBuffer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, JeepElementsBuffer);
-
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.elements.size(), mesh.elements.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		JeepNumElements = mesh.elements.size();
-
-		GLuint JeepUVVBO;
-		glGenBuffers(1, &JeepUVVBO);
-		glBindBuffer(GL_ARRAY_BUFFER, JeepUVVBO);
-
-		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * mesh.uvCoords.size(), mesh.uvCoords.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		
-		glGenVertexArrays(1, &JeepVAO);
-		glBindVertexArray(JeepVAO);
-
-		glBindBuffer(GL_ARRAY_BUFFER, JeepPositonVBO);
-
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, JeepElementsBuffer);
-
-		
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, JeepElementsBuffer);
-		
-		glBindBuffer(GL_ARRAY_BUFFER, JeepUVVBO);
-
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		glBindBuffer(GL_ARRAY_BUFFER, JeepNormalsVBO);
+	// Every loaded mesh shares these buffers
+	m_meshArena.Create(KArenaVertices, KArenaIndices);
 
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-		
-		glBindVertexArray(0);
+	// The Jeep itself is the only instance, positioned by model_xform so its own transform is identity
+	m_jeepInstances.Create(1);
+	m_jeepInstances.Add(glm::mat4(1));
+	m_jeepInstances.Upload();
+	m_jeepInstances.Attach(m_meshArena.GetVAO());
 
+	// The window is usable straight away, the Jeep appears once its worker has loaded it
+	// Its mesh are reordered for the vertex cache, overdraw and fetch order, simplified into levels of detail and split
+	// into clusters on the worker the first time, then read back cooked from the cache and uploaded from its mapping
+	m_jeepLoader = std::make_unique<Helpers::ModelLoader>();
+	m_jeepLoading = m_jeepLoader->LoadFromFileAsync(KJeepFilename, Helpers::ImportProfile::FullQuality, true);
 
-	}
+	// Stand the Jeep on the ground, rotating its up to the terrain normal
+	PlaceJeep();
 
-	//Load Jeep Texture
-	Helpers::ImageLoader JeepIMLoader;
-	if (!JeepIMLoader.Load("Data\\Models\\Jeep\\Jeep_rood.jpg"))
+	//Load Jeep Texture, used by any of its mesh whose material has none
+	m_jeepTexture = m_textureCache.Acquire("Data\\Models\\Jeep\\Jeep_rood.jpg");
+	if (!m_jeepTexture)
 	{
 		MessageBox(NULL, L"Can't Load Jeep Texture", L"ERROR",
 			MB_OK | MB_ICONEXCLAMATION);
 		return false;
 	}
-	else
-	{
-		//Creates the Texure object
-		glGenTextures(1, &Jeeptex);
-		glBindTexture(GL_TEXTURE_2D, Jeeptex);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-			GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, JeepIMLoader.Width(), JeepIMLoader.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, JeepIMLoader.GetData());
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-	}
-
 
 
-	GLuint TerrainPositonVBO;
-	glGenBuffers(1, &TerrainPositonVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, TerrainPositonVBO);
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * Corners.size(), Corners.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	GLuint PositonVBO;
 	glGenBuffers(1, &PositonVBO);
@@ -722,7 +781,7 @@ bool Renderer::InitialiseGeometry()
 	glGenBuffers(1, &CubeNormalsVBO);
 	glBindBuffer(GL_ARRAY_BUFFER, CubeNormalsVBO);
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2)* CubeNormals.size(), CubeNormals.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* CubeNormals.size(), CubeNormals.data(), GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 
@@ -734,29 +793,40 @@ bool Renderer::InitialiseGeometry()
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 
-	GLuint UVVBO;
-	glGenBuffers(1, &UVVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, UVVBO);
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * UV.size(), UV.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	GLuint NormalsVBO;
-	glGenBuffers(1, &NormalsVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, NormalsVBO);
+	// All the baked terrain patches share one vertex buffer and one patch sized element buffer
+	// With GPU displacement the vertex buffer is a single flat patch reused by every node instead
+	GLuint TerrainVBO;
+	glGenBuffers(1, &TerrainVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, TerrainVBO);
 
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2)* Normals.size(), Normals.data(), GL_STATIC_DRAW);
+	if (m_terrainGpuDisplacement)
+	{
+		const int patchVerts{ m_terrainQuadtree.PatchCells() + 1 };
+		std::vector<glm::vec2> patchPositions;
+		patchPositions.reserve((size_t)patchVerts * patchVerts);
+		for (int x = 0; x < patchVerts; x++)
+			for (int z = 0; z < patchVerts; z++)
+				patchPositions.emplace_back((float)x, (float)z);
+
+		glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * patchPositions.size(), patchPositions.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		const std::vector<Helpers::TerrainPatchVertex>& terrainVertices{ m_terrainQuadtree.GetVertices() };
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Helpers::TerrainPatchVertex) * terrainVertices.size(), terrainVertices.data(), GL_STATIC_DRAW);
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-
+	// 16 bit strips of every stitch variant of the patch, a few hundred KB however big the terrain
+	const std::vector<GLushort>& patchElements{ m_terrainQuadtree.GetPatchElements() };
 	GLuint ElementsBuffer;
 	glGenBuffers(1, &ElementsBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ElementsBuffer);
 
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::vec3) * elements.size(), elements.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * patchElements.size(), patchElements.data(), GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	m_numElements = elements.size();
+	m_numElements = m_terrainQuadtree.VariantCount();
 
 
 	GLuint CubeElementsBuffer;
@@ -808,28 +878,267 @@ bool Renderer::InitialiseGeometry()
 	glBindVertexArray(m_VAO); //start binding to VAO
 
 
-	glBindBuffer(GL_ARRAY_BUFFER, TerrainPositonVBO);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, TerrainVBO);
+	if (m_terrainGpuDisplacement)
+	{
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	}
+	else
+	{
+		// Grid position as plain integers, heights and normal normalised to 0..1 and -1..1
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(Helpers::TerrainPatchVertex), (void*)offsetof(Helpers::TerrainPatchVertex, gridX));
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ElementsBuffer);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(Helpers::TerrainPatchVertex), (void*)offsetof(Helpers::TerrainPatchVertex, height));
 
-	glBindBuffer(GL_ARRAY_BUFFER, UVVBO);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(Helpers::TerrainPatchVertex), (void*)offsetof(Helpers::TerrainPatchVertex, normal));
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, NormalsVBO);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ElementsBuffer);
 
 	glBindVertexArray(0); //end
 
 	return true;
 }
 
+// Picks up the Jeep once its worker has finished, then uploads its mesh within the frame's budget
+void Renderer::UploadPendingModels()
+{
+	if (m_jeepLoading.valid())
+	{
+		if (m_jeepLoading.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return;
+
+		if (!m_jeepLoading.get())
+		{
+			MessageBox(NULL, L"Can't Load Jeep Model", L"ERROR",
+				MB_OK | MB_ICONEXCLAMATION);
+			m_jeepLoader.reset();
+			return;
+		}
+
+		m_jeepImportReport = m_jeepLoader->GetImportReport();
+		std::cout << m_jeepImportReport.ToString();
+
+		// The clip keeps its own copy of the hierarchy so outlives the loader
+		m_jeepAnimation.Create(*m_jeepLoader);
+		m_jeepPose.clip = &m_jeepAnimation;
+		m_jeepBounds = m_jeepLoader->GetBounds();
+
+		const std::vector<Helpers::Mesh>& meshes{ m_jeepLoader->GetMeshVector() };
+		m_meshIndexReports = m_jeepLoader->GetIndexReports();
+		for (size_t i = 0; i < m_meshIndexReports.size(); i++)
+		{
+			const Helpers::IndexOptimisationReport& report{ m_meshIndexReports[i] };
+			std::cout << "Mesh " << meshes[i].name << " ACMR " << report.before.acmr << " -> " << report.after.acmr
+				<< ", ATVR " << report.before.atvr << " -> " << report.after.atvr << std::endl;
+		}
+		m_jeepMeshesUploaded = 0;
+
+		// Size the arenas for every mesh and level of detail up front rather than growing a mesh at a time
+		size_t staticSize[2]{ 0, 0 };
+		size_t skinnedSize[2]{ 0, 0 };
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			size_t* size{ meshes[i].bones.empty() ? staticSize : skinnedSize };
+			size[0] += m_jeepLoader->GetVertexStreams(i).numVertices;
+			for (size_t level = 0; level <= meshes[i].lods.size(); level++)
+			{
+				size_t count{ 0 };
+				m_jeepLoader->GetElements(i, level, count);
+				size[1] += count;
+			}
+		}
+		m_meshArena.Reserve(staticSize[0], staticSize[1]);
+		if (skinnedSize[0] > 0 && !m_skinnedMeshArena.GetVAO())
+			m_skinnedMeshArena.Create(skinnedSize[0], skinnedSize[1], true);
+	}
+
+	if (!m_jeepLoader)
+		return;
+
+	const size_t numMeshes{ m_jeepLoader->GetMeshVector().size() };
+	size_t bytesUploaded{ 0 };
+	while (m_jeepMeshesUploaded < numMeshes)
+	{
+		const Helpers::Mesh& mesh{ m_jeepLoader->GetMeshVector()[m_jeepMeshesUploaded] };
+		const Helpers::VertexStreams streams{ m_jeepLoader->GetVertexStreams(m_jeepMeshesUploaded) };
+		size_t meshBytes{ streams.numVertices * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2)) };
+		if (!mesh.bones.empty())
+			meshBytes += streams.numVertices * (sizeof(glm::uvec4) + sizeof(glm::vec4));
+		for (size_t level = 0; level <= mesh.lods.size(); level++)
+		{
+			size_t count{ 0 };
+			m_jeepLoader->GetElements(m_jeepMeshesUploaded, level, count);
+			meshBytes += count * sizeof(GLuint);
+		}
+		if (bytesUploaded > 0 && bytesUploaded + meshBytes > KUploadBytesPerFrame)
+			break;
+
+		UploadJeepMesh(m_jeepMeshesUploaded);
+		bytesUploaded += meshBytes;
+		m_jeepMeshesUploaded++;
+	}
+
+	// Everything is on the GPU so the CPU copies, or the cache mapping, can go
+	if (m_jeepMeshesUploaded == numMeshes)
+	{
+		m_jeepLoader.reset();
+		RegisterCrowdModel();
+	}
+}
+
+// Places one Jeep mesh in the shared arena, its full detail elements followed by each level of detail's
+// Vertices and elements come from the loader, straight out of the cache mapping on a warm start
+// The mesh's BVH is moved out to outlive the loader
+void Renderer::UploadJeepMesh(size_t meshIndex)
+{
+	Helpers::Mesh& mesh{ m_jeepLoader->GetMeshVector()[meshIndex] };
+	const std::vector<Helpers::Material>& materials{ m_jeepLoader->GetMaterialVector() };
+
+	JeepMesh jeepMesh;
+	jeepMesh.skinned = !mesh.bones.empty();
+	jeepMesh.clusters = mesh.clusters;
+	jeepMesh.bvh = std::move(mesh.bvh);
+
+	// Mesh sharing an image share its texture, however many models use it
+	if (mesh.materialIndex < materials.size() && !materials[mesh.materialIndex].diffuseTextureFilename.empty())
+		jeepMesh.texture = m_textureCache.Acquire(Helpers::TextureCache::ResolvePath(KJeepFilename, materials[mesh.materialIndex].diffuseTextureFilename));
+	if (!jeepMesh.texture)
+		jeepMesh.texture = m_jeepTexture;
+
+	std::vector<const unsigned int*> levelElements(mesh.lods.size() + 1);
+	jeepMesh.lodFirst.assign(1, 0);
+	for (size_t level = 0; level < levelElements.size(); level++)
+	{
+		size_t count{ 0 };
+		levelElements[level] = m_jeepLoader->GetElements(meshIndex, level, count);
+		if (level > 0)
+			jeepMesh.lodFirst.push_back(jeepMesh.lodFirst.back() + jeepMesh.lodCount.back());
+		jeepMesh.lodCount.push_back((GLuint)count);
+		jeepMesh.lodErrors.push_back(level == 0 ? 0.0f : mesh.lods[level - 1].error);
+	}
+
+	// Skinned mesh need the bone attributes so go in their own arena, their bones join the one bone matrix buffer
+	if (jeepMesh.skinned && !m_skinnedMeshArena.GetVAO())
+		m_skinnedMeshArena.Create(KArenaVertices, KArenaIndices, true);
+	Helpers::GeometryArena& arena{ jeepMesh.skinned ? m_skinnedMeshArena : m_meshArena };
+
+	const Helpers::VertexStreams streams{ m_jeepLoader->GetVertexStreams(meshIndex) };
+	jeepMesh.allocation = arena.Allocate(streams.numVertices, jeepMesh.lodFirst.back() + jeepMesh.lodCount.back());
+	arena.WriteVertices(jeepMesh.allocation, streams, (GLuint)m_jeepBones.size());
+	for (size_t level = 0; level < levelElements.size(); level++)
+		arena.WriteIndices(jeepMesh.allocation, jeepMesh.lodFirst[level], levelElements[level], jeepMesh.lodCount[level]);
+
+	m_jeepBones.insert(m_jeepBones.end(), mesh.bones.begin(), mesh.bones.end());
+	m_jeepMeshes.push_back(std::move(jeepMesh));
+}
+
+// Also called after the terrain is edited under it
+void Renderer::PlaceJeep()
+{
+	const glm::vec3 groundNormal{ m_terrainQuery.GetNormal(KJeepX, KJeepZ) };
+	const glm::vec3 tiltAxis{ glm::cross(glm::vec3(0, 1, 0), groundNormal) };
+	m_jeepTransform = glm::translate(glm::mat4(1), glm::vec3(KJeepX, m_terrainQuery.GetHeight(KJeepX, KJeepZ), KJeepZ));
+	if (glm::length(tiltAxis) > 1e-6f)
+		m_jeepTransform = glm::rotate(m_jeepTransform, std::acos(glm::clamp(groundNormal.y, -1.0f, 1.0f)), glm::normalize(tiltAxis));
+}
+
+// Each static mesh is a part, at the levels of detail it was uploaded with
+void Renderer::RegisterCrowdModel()
+{
+	m_jeepCrowd.Create(m_meshArena);
+	for (const JeepMesh& mesh : m_jeepMeshes)
+	{
+		if (mesh.skinned)
+			continue;
+		Helpers::InstancedModelPart part;
+		part.allocation = mesh.allocation;
+		part.texture = mesh.texture.Get();
+		part.lodFirst = mesh.lodFirst;
+		part.lodCount = mesh.lodCount;
+		part.lodErrors = mesh.lodErrors;
+		m_jeepCrowd.AddPart(part);
+	}
+	m_jeepCrowd.SetBounds(m_jeepBounds);
+	BuildCrowd(m_crowdSize);
+}
+
+// Spaced by the Jeep's size, starting beside it rather than on top of it
+void Renderer::BuildCrowd(int count)
+{
+	count = std::clamp(count, 0, KMaxCrowd);
+	const float spacing{ m_jeepBounds.valid ? m_jeepBounds.radius * 2.5f : 10.0f };
+	const int side{ (int)std::ceil(std::sqrt((float)count)) };
+
+	std::vector<glm::vec2> points((size_t)count);
+	for (int i = 0; i < count; i++)
+		points[i] = glm::vec2(KJeepX + (i % side - side / 2 + 0.5f) * spacing, KJeepZ + (i / side - side / 2 + 0.5f) * spacing);
+	std::vector<float> heights((size_t)count);
+	m_terrainQuery.GetHeights(points.data(), points.size(), heights.data());
+
+	m_jeepCrowd.ResizeInstances((size_t)count);
+	for (int i = 0; i < count; i++)
+	{
+		// Integer hash of the index for a repeatable heading and tint
+		uint32_t hash{ (uint32_t)i * 2654435761u };
+		hash ^= hash >> 16;
+		const float heading{ (hash & 0xffff) / 65535.0f * glm::two_pi<float>() };
+		const glm::vec4 tint{ 0.6f + 0.4f * ((hash >> 16) & 0xff) / 255.0f, 0.6f + 0.4f * ((hash >> 8) & 0xff) / 255.0f,
+			0.6f + 0.4f * (hash & 0xff) / 255.0f, 1.0f };
+
+		const glm::mat4 transform{ glm::rotate(glm::translate(glm::mat4(1), glm::vec3(points[i].x, heights[i], points[i].y)),
+			heading, glm::vec3(0, 1, 0)) };
+		m_jeepCrowd[(size_t)i] = Helpers::InstanceData{ transform, tint };
+	}
+	m_crowdBuilt = count;
+}
+
+// The instanced times include culling, sorting and uploading the instances, as the crowd's draw does each frame
+// Each way is run three times and the fastest kept
+void Renderer::BenchmarkInstancing(const glm::mat4& combined_xform, const glm::vec3& viewer, float pixelsPerUnit)
+{
+	m_instancingBenchmarks.clear();
+	if (m_jeepCrowd.NumParts() == 0)
+		return;
+
+	const auto timeDraw = [&](bool instanced)
+	{
+		double best{ 1e30 };
+		for (int repeat = 0; repeat < 3; repeat++)
+		{
+			glFinish();
+			const auto start{ std::chrono::steady_clock::now() };
+			m_jeepCrowd.Draw(m_program, combined_xform, viewer, pixelsPerUnit, m_meshPixelError, instanced);
+			glFinish();
+			const std::chrono::duration<double, std::milli> taken{ std::chrono::steady_clock::now() - start };
+			best = std::min(best, taken.count());
+		}
+		return best;
+	};
+
+	for (int instances : { 1, 10, 100, 1000, 10000, 100000 })
+	{
+		BuildCrowd(instances);
+		InstancingBenchmark result;
+		result.instances = instances;
+		result.instancedMs = timeDraw(true);
+		result.separateMs = timeDraw(false);
+		m_instancingBenchmarks.push_back(result);
+	}
+
+	BuildCrowd(m_crowdSize);
+}
+
 // Render the scene. Passed the delta time since last called.
 void Renderer::Render(const Helpers::Camera& camera, float deltaTime)
 {			
+	UploadPendingModels();
+	UpdateTerrainPaging(camera.GetPosition());
+
 	// Configure pipeline settings
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
@@ -854,6 +1163,16 @@ void Renderer::Render(const Helpers::Camera& camera, float deltaTime)
 	glm::mat4 view_xform = glm::lookAt(camera.GetPosition(), camera.GetPosition() + camera.GetLookVector(), camera.GetUpVector());
 	glm::mat4 combined_xform = projection_xform * view_xform;
 
+	// Size in pixels of one unit at distance 1, for judging levels of detail
+	const float pixelsPerUnit{ viewportSize[3] / (2.0f * std::tan(glm::radians(45.0f) * 0.5f)) };
+
+	// Draws over the cleared frame so clears again after
+	if (m_runInstancingBenchmark)
+	{
+		m_runInstancingBenchmark = false;
+		BenchmarkInstancing(combined_xform, camera.GetPosition(), pixelsPerUnit);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
 
 	// SkyBox Draw
 	glDepthMask(GL_FALSE);
@@ -897,21 +1216,232 @@ void Renderer::Render(const Helpers::Camera& camera, float deltaTime)
 	
 
 	//Terrain Draw
-	glBindTexture(GL_TEXTURE_2D, Terraintex);
-	glUniform1i(glGetUniformLocation(m_program, "sampler_tex"), 0);
+	float groundHit{ 0 };
+	m_groundHitDistance = m_terrainQuery.Raycast(camera.GetPosition(), camera.GetLookVector(), 10000.0f, groundHit) ? groundHit : -1.0f;
+	m_groundHitPoint = camera.GetPosition() + camera.GetLookVector() * groundHit;
+
+	glUseProgram(TerrainProgram);
+	glUniformMatrix4fv(glGetUniformLocation(TerrainProgram, "combined_xform"), 1, GL_FALSE, glm::value_ptr(combined_xform));
+	glUniformMatrix4fv(glGetUniformLocation(TerrainProgram, "model_xform"), 1, GL_FALSE, glm::value_ptr(model_xform));
+	glUniform3fv(glGetUniformLocation(TerrainProgram, "camera_position"), 1, glm::value_ptr(camera.GetPosition()));
+	glUniform1f(glGetUniformLocation(TerrainProgram, "terrain_size"), m_terrainQuadtree.WorldSize());
+
+	glBindTexture(GL_TEXTURE_2D, m_terrainTexture.Get());
+	glUniform1i(glGetUniformLocation(TerrainProgram, "sampler_tex"), 0);
+
+	// Both modes store heights quantised over the same range
+	glUniform1f(glGetUniformLocation(TerrainProgram, "height_offset"), m_terrainHeightOffset);
+	glUniform1f(glGetUniformLocation(TerrainProgram, "height_range"), m_terrainHeightRange);
+	glUniform1f(glGetUniformLocation(TerrainProgram, "cell_size"), m_terrainQuadtree.CellSize());
+
+	if (m_terrainGpuDisplacement)
+	{
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, TerrainHeightTex);
+		glUniform1i(glGetUniformLocation(TerrainProgram, "height_tex"), 1);
+		glActiveTexture(GL_TEXTURE0);
+
+		glUniform1i(glGetUniformLocation(TerrainProgram, "grid_cells"), m_terrainQuadtree.GridCells());
+		glUniform1i(glGetUniformLocation(TerrainProgram, "patch_cells"), m_terrainQuadtree.PatchCells());
+	}
+
+	// Pick the level of detail for each part of the terrain from the camera distance and allowed pixel error
+	m_terrainQuadtree.ComputeLodRanges(m_terrainPixelError, (float)viewportSize[3], glm::radians(45.0f), m_terrainLodRanges);
+	// Terrain is drawn untransformed so the frustum from combined_xform is already in terrain space
+	Helpers::Frustum frustum;
+	frustum.Extract(combined_xform);
+	m_terrainQuadtree.Select(camera.GetPosition(), m_terrainLodRanges, m_terrainSelection, m_terrainFrustumCulling ? &frustum : nullptr);
+
+	const GLint morph_range_id{ glGetUniformLocation(TerrainProgram, "morph_range") };
+	const GLint node_origin_id{ glGetUniformLocation(TerrainProgram, "node_origin") };
+	const GLint node_spacing_id{ glGetUniformLocation(TerrainProgram, "node_spacing") };
+	const std::vector<Helpers::TerrainQuadtree::Node>& terrainNodes{ m_terrainQuadtree.GetNodes() };
+
+	// Each row of a patch is its own strip
+	glEnable(GL_PRIMITIVE_RESTART);
+	glPrimitiveRestartIndex(Helpers::TerrainQuadtree::KPrimitiveRestartIndex);
 
 	glBindVertexArray(m_VAO);
-	glDrawElements(GL_TRIANGLES, m_numElements, GL_UNSIGNED_INT, (void*)0);
+	m_terrainQuadrantsDrawn = 0;
+	for (const Helpers::TerrainSelection& selected : m_terrainSelection)
+	{
+		for (int q = 0; q < 4; q++)
+			m_terrainQuadrantsDrawn += (selected.quadrantMask >> q) & 1;
+
+		glUniform2fv(morph_range_id, 1, glm::value_ptr(Helpers::TerrainQuadtree::MorphRange(m_terrainLodRanges, selected.level)));
+
+		// Displaced patches all share vertex 0 onwards and are placed by the node uniforms instead
+		const Helpers::TerrainQuadtree::Node& node{ terrainNodes[selected.node] };
+		GLint baseVertex{ node.baseVertex };
+		if (m_terrainGpuDisplacement)
+		{
+			glUniform2i(node_origin_id, node.minX, node.minZ);
+			glUniform1i(node_spacing_id, node.size / m_terrainQuadtree.PatchCells());
+			baseVertex = 0;
+		}
+
+		// Whole patch in one go unless quadrants are missing or need different stitching
+		const unsigned int* stitch{ selected.stitchMasks };
+		if (selected.quadrantMask == 0xF && stitch[0] == stitch[1] && stitch[0] == stitch[2] && stitch[0] == stitch[3])
+		{
+			const GLuint first{ m_terrainQuadtree.QuadrantFirst(stitch[0], 0) };
+			glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, m_numElements, GL_UNSIGNED_SHORT, (void*)(first * sizeof(GLushort)), baseVertex);
+			continue;
+		}
+
+		for (int q = 0; q < 4; q++)
+		{
+			if (!(selected.quadrantMask & (1u << q)))
+				continue;
+			const GLuint first{ m_terrainQuadtree.QuadrantFirst(stitch[q], q) };
+			glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, m_terrainQuadtree.QuadrantCount(q), GL_UNSIGNED_SHORT, (void*)(first * sizeof(GLushort)), baseVertex);
+		}
+	}
 	glBindVertexArray(0);
+	glDisable(GL_PRIMITIVE_RESTART);
+
+	glUseProgram(m_program);
 
 	
-	//Jeep Draw
-	glBindTexture(GL_TEXTURE_2D, Jeeptex);
-	glUniform1i(glGetUniformLocation(m_program, "sampler_tex"), 0);
-	glBindVertexArray(JeepVAO);
+	//Jeep Draw, nothing to draw until its first mesh has been uploaded
+	if (!m_jeepMeshes.empty())
+	{
+		// Culling, level of detail and picking all work in the Jeep's model space from the bounds worked out at load
+		// Skinned bounds are of the bind pose so cannot be trusted to cull
+		const bool anySkinned{ !m_jeepBones.empty() };
+		Helpers::Frustum jeepFrustum;
+		jeepFrustum.Extract(combined_xform * m_jeepTransform);
+		const glm::mat4 worldToJeep{ glm::inverse(m_jeepTransform) };
+		const glm::vec3 viewer{ worldToJeep * glm::vec4(camera.GetPosition(), 1.0f) };
+		m_jeepVisible = !m_jeepBounds.valid || anySkinned ||
+			jeepFrustum.ClassifySphere(m_jeepBounds.centre, m_jeepBounds.radius) != Helpers::Frustum::Result::Outside;
+
+		// The bounds rule out most misses, then each mesh's triangles give the exact hit
+		// Mesh whose BVH has not been built only have their bounds to go on
+		float jeepHit;
+		const glm::vec3 lookInJeep{ worldToJeep * glm::vec4(camera.GetLookVector(), 0.0f) };
+		m_jeepHitDistance = -1.0f;
+		if (m_jeepBounds.IntersectRay(viewer, lookInJeep, 10000.0f, jeepHit))
+		{
+			const auto pickStart{ std::chrono::steady_clock::now() };
+			float nearest{ 10000.0f };
+			bool anyBvh{ false };
+			for (const JeepMesh& mesh : m_jeepMeshes)
+			{
+				Helpers::BvhHit hit;
+				anyBvh |= !mesh.bvh.Empty();
+				if (mesh.bvh.IntersectRay(viewer, lookInJeep, nearest, hit))
+				{
+					nearest = hit.distance;
+					m_jeepHitDistance = hit.distance;
+				}
+			}
+			if (!anyBvh)
+				m_jeepHitDistance = jeepHit;
+			m_jeepPickMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+		}
 
-	glDrawElements(GL_TRIANGLES, JeepNumElements, GL_UNSIGNED_INT, (void*)0);
-	glBindVertexArray(0);
+		// Mesh with bones are posed on the CPU then skinned in the vertex shader, their buffers stay as they are
+		if (anySkinned)
+		{
+			m_animationTime += deltaTime;
+			Helpers::EvaluateAnimation(m_jeepPose, m_animationTime);
+			Helpers::ComputeSkinMatrices(m_jeepBones, m_jeepPose.worldTransforms, m_jeepSkinMatrices);
+			m_jeepBoneMatrices.Update(m_jeepSkinMatrices);
+		}
+
+		// Error is judged from the nearest the bounding sphere gets to the camera
+		const float jeepDistance{ m_jeepBounds.valid ? std::max(0.0f, glm::distance(viewer, m_jeepBounds.centre) - m_jeepBounds.radius) :
+			glm::length(viewer) };
+
+		m_jeepClustersDrawn = 0;
+		m_jeepTrianglesDrawn = 0;
+		m_jeepDrawRanges = 0;
+		m_jeepDrawCalls = 0;
+
+		// Lists the ranges to draw of every mesh, once a frame, in the order of m_jeepMeshes
+		m_jeepMeshRanges.resize(m_jeepMeshes.size());
+		for (size_t m = 0; m < m_jeepMeshes.size() && m_jeepVisible; m++)
+		{
+			const JeepMesh& mesh{ m_jeepMeshes[m] };
+			const size_t lod{ Helpers::SelectLod(mesh.lodErrors, jeepDistance, pixelsPerUnit, m_meshPixelError) };
+
+			// Clusters are only worth it at full detail, the coarser levels are small enough to draw whole
+			// Their bounds are of the bind pose so skinned mesh are drawn whole too
+			std::vector<Helpers::ClusterDrawRange>& ranges{ m_jeepMeshRanges[m] };
+			ranges.clear();
+			if (m_jeepClusterCulling && !mesh.skinned && lod == 0 && !mesh.clusters.empty())
+			{
+				m_jeepClustersDrawn += (int)Helpers::CullClusters(mesh.clusters, jeepFrustum, viewer, ranges);
+			}
+			else
+			{
+				m_jeepClustersDrawn += (int)mesh.clusters.size();
+				ranges.push_back(Helpers::ClusterDrawRange{ mesh.lodFirst[lod], mesh.lodCount[lod] });
+			}
+		}
+
+		// One draw call for each arena and texture, so mesh only split calls when their material needs it
+		for (int skinnedPass = 0; skinnedPass < 2 && m_jeepVisible; skinnedPass++)
+		{
+			m_jeepBatchTextures.clear();
+			for (const JeepMesh& mesh : m_jeepMeshes)
+			{
+				if (mesh.skinned == (skinnedPass == 1) &&
+					std::find(m_jeepBatchTextures.begin(), m_jeepBatchTextures.end(), mesh.texture.Get()) == m_jeepBatchTextures.end())
+					m_jeepBatchTextures.push_back(mesh.texture.Get());
+			}
+			if (m_jeepBatchTextures.empty())
+				continue;
+
+			const GLuint jeepProgram{ skinnedPass ? m_skinnedProgram : m_program };
+			glUseProgram(jeepProgram);
+			glUniformMatrix4fv(glGetUniformLocation(jeepProgram, "combined_xform"), 1, GL_FALSE, glm::value_ptr(combined_xform));
+			glUniformMatrix4fv(glGetUniformLocation(jeepProgram, "model_xform"), 1, GL_FALSE, glm::value_ptr(m_jeepTransform));
+			glUniform1i(glGetUniformLocation(jeepProgram, "sampler_tex"), 0);
+			if (skinnedPass)
+			{
+				m_jeepBoneMatrices.Bind(2);
+				glUniform1i(glGetUniformLocation(jeepProgram, "bone_matrices"), 2);
+			}
+			glBindVertexArray(skinnedPass ? m_skinnedMeshArena.GetVAO() : m_meshArena.GetVAO());
+
+			for (GLuint texture : m_jeepBatchTextures)
+			{
+				m_jeepDrawCounts.clear();
+				m_jeepDrawOffsets.clear();
+				m_jeepDrawBaseVertices.clear();
+				for (size_t m = 0; m < m_jeepMeshes.size(); m++)
+				{
+					const JeepMesh& mesh{ m_jeepMeshes[m] };
+					if (mesh.skinned != (skinnedPass == 1) || mesh.texture.Get() != texture)
+						continue;
+
+					for (const Helpers::ClusterDrawRange& range : m_jeepMeshRanges[m])
+					{
+						m_jeepDrawCounts.push_back((GLsizei)range.numElements);
+						m_jeepDrawOffsets.push_back((void*)((mesh.allocation.firstIndex + range.firstElement) * sizeof(GLuint)));
+						m_jeepDrawBaseVertices.push_back(mesh.allocation.baseVertex);
+						m_jeepTrianglesDrawn += (int)range.numElements / 3;
+					}
+				}
+				if (m_jeepDrawCounts.empty())
+					continue;
+
+				glBindTexture(GL_TEXTURE_2D, texture);
+				glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_jeepDrawCounts.data(), GL_UNSIGNED_INT, m_jeepDrawOffsets.data(),
+					(GLsizei)m_jeepDrawCounts.size(), m_jeepDrawBaseVertices.data());
+				m_jeepDrawRanges += (int)m_jeepDrawCounts.size();
+				m_jeepDrawCalls++;
+			}
+			glBindVertexArray(0);
+		}
+	}
+
+	// Crowd of Jeeps, rebuilt only when its size changes
+	if (m_crowdSize != m_crowdBuilt)
+		BuildCrowd(m_crowdSize);
+	m_crowdDrawCalls = m_jeepCrowd.Draw(m_program, combined_xform, camera.GetPosition(), pixelsPerUnit, m_meshPixelError);
 
 	glUseProgram(CubeProgram);
 
@@ -951,3 +1481,144 @@ void Renderer::Render(const Helpers::Camera& camera, float deltaTime)
 
 }
 
+// Edits the height texture in place and brings the CPU copies used for culling, level of detail and placement into line
+void Renderer::UpdateTerrainHeights(int x, int z, int width, int height, const uint16_t* quantisedHeights)
+{
+	if (!WriteTerrainHeights(x, z, width, height, quantisedHeights))
+		return;
+
+	// Anything stood on the ground follows it
+	PlaceJeep();
+	if (m_crowdBuilt > 0)
+		BuildCrowd(m_crowdBuilt);
+}
+
+bool Renderer::WriteTerrainHeights(int x, int z, int width, int height, const uint16_t* quantisedHeights)
+{
+	if (!m_terrainGpuDisplacement || TerrainHeightTex == 0 || width <= 0 || height <= 0)
+		return false;
+
+	// Clip to the grid, the texture has a sample per vertex so KTerrainCells + 1 a side
+	const int minX{ std::max(x, 0) };
+	const int minZ{ std::max(z, 0) };
+	const int maxX{ std::min(x + width, KTerrainCells + 1) };
+	const int maxZ{ std::min(z + height, KTerrainCells + 1) };
+	if (minX >= maxX || minZ >= maxZ)
+		return false;
+	const int clippedWidth{ maxX - minX };
+	const int clippedHeight{ maxZ - minZ };
+
+	// Rows run along x, only the clipped block is read out of the caller's
+	glBindTexture(GL_TEXTURE_2D, TerrainHeightTex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, height);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, minZ - z);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, minX - x);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, minZ, minX, clippedHeight, clippedWidth, GL_RED, GL_UNSIGNED_SHORT, quantisedHeights);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Decoded as the shader does so raycasts and bounds match what is drawn
+	std::vector<float> heights((size_t)clippedWidth * clippedHeight);
+	for (int i = 0; i < clippedWidth; i++)
+	{
+		const uint16_t* row{ quantisedHeights + (size_t)(minX - x + i) * height + (minZ - z) };
+		for (int j = 0; j < clippedHeight; j++)
+			heights[(size_t)i * clippedHeight + j] = m_terrainHeightOffset + row[j] / 65535.0f * m_terrainHeightRange;
+	}
+	m_terrainQuery.SetHeights(minX, minZ, clippedWidth, clippedHeight, heights.data());
+	m_terrainQuadtree.UpdateHeights(m_terrainQuery.GetHeights(), minX, minZ, maxX - 1, maxZ - 1);
+	return true;
+}
+
+// Each grid vertex takes one heightmap sample, which lies in exactly one tile, as the shared edge is left to the tile before
+void Renderer::MapTerrainTiles(const Helpers::TerrainBuilder& builder)
+{
+	const Helpers::TiledHeightmapHeader& header{ m_terrainPager.GetHeader() };
+	builder.TiledSampleIndices(header, m_terrainSampleX, m_terrainSampleZ);
+
+	const auto mapAxis = [&](const std::vector<int>& samples, uint32_t numTiles, std::vector<glm::ivec2>& tileVerts)
+	{
+		tileVerts.assign(numTiles, glm::ivec2(0));
+		for (size_t vert = 0; vert < samples.size(); vert++)
+		{
+			const uint32_t tile{ std::min((uint32_t)samples[vert] / header.tileSize, numTiles - 1) };
+			if (tileVerts[tile].x == tileVerts[tile].y)
+				tileVerts[tile] = glm::ivec2((int)vert, (int)vert + 1);
+			else
+				tileVerts[tile].y = (int)vert + 1;
+		}
+	};
+	mapAxis(m_terrainSampleX, header.numTilesX, m_terrainTileVertsX);
+	mapAxis(m_terrainSampleZ, header.numTilesZ, m_terrainTileVertsZ);
+
+	m_terrainTilesApplied.assign((size_t)header.numTilesX * header.numTilesZ, false);
+	m_terrainTilesAppliedCount = 0;
+}
+
+// Tiles are written once, so one evicted and paged in again does not undo an edit made since
+void Renderer::UpdateTerrainPaging(const glm::vec3& cameraPos)
+{
+	if (!m_terrainPager.IsStarted())
+		return;
+	m_terrainPager.Update(cameraPos);
+
+	const Helpers::TiledHeightmapHeader& header{ m_terrainPager.GetHeader() };
+	const size_t samplesPerSide{ m_terrainPager.TileSamplesPerSide() };
+	bool anyWritten{ false };
+	std::vector<uint16_t> quantisedHeights;
+	for (const glm::ivec2& arrived : m_terrainPager.ArrivedTiles())
+	{
+		const size_t tileIndex{ (size_t)arrived.x * header.numTilesZ + arrived.y };
+		const Helpers::TerrainTile* tile{ m_terrainPager.FindTile(arrived.x, arrived.y) };
+		if (m_terrainTilesApplied[tileIndex] || !tile)
+			continue;
+		m_terrainTilesApplied[tileIndex] = true;
+		m_terrainTilesAppliedCount++;
+
+		// The texture is quantised over the file's own range, so samples go in unchanged
+		const glm::ivec2 vertsX{ m_terrainTileVertsX[arrived.x] };
+		const glm::ivec2 vertsZ{ m_terrainTileVertsZ[arrived.y] };
+		const int width{ vertsX.y - vertsX.x };
+		const int height{ vertsZ.y - vertsZ.x };
+		if (width <= 0 || height <= 0)
+			continue;
+		quantisedHeights.resize((size_t)width * height);
+		for (int x = 0; x < width; x++)
+		{
+			const size_t localX{ (size_t)m_terrainSampleX[vertsX.x + x] - (size_t)arrived.x * header.tileSize };
+			for (int z = 0; z < height; z++)
+			{
+				const size_t localZ{ (size_t)m_terrainSampleZ[vertsZ.x + z] - (size_t)arrived.y * header.tileSize };
+				quantisedHeights[(size_t)x * height + z] = tile->samples[localX * samplesPerSide + localZ];
+			}
+		}
+		anyWritten |= WriteTerrainHeights(vertsX.x, vertsZ.x, width, height, quantisedHeights.data());
+	}
+
+	// Anything stood on the ground follows it, once however many tiles came in
+	if (anyWritten)
+	{
+		PlaceJeep();
+		if (m_crowdBuilt > 0)
+			BuildCrowd(m_crowdBuilt);
+	}
+}
+
+// Flattens a square of terrain around where the view meets the ground to the height at its centre
+void Renderer::FlattenGroundInView()
+{
+	if (m_groundHitDistance < 0)
+		return;
+
+	const float cellSize{ m_terrainQuadtree.CellSize() };
+	const int centreX{ (int)std::round(m_groundHitPoint.x / cellSize) };
+	const int centreZ{ (int)std::round(m_groundHitPoint.z / cellSize) };
+	const float level{ (m_terrainQuery.GetHeight(m_groundHitPoint.x, m_groundHitPoint.z) - m_terrainHeightOffset) / m_terrainHeightRange };
+	const std::vector<uint16_t> quantisedHeights((size_t)KFlattenCells * KFlattenCells,
+		(uint16_t)std::round(glm::clamp(level, 0.0f, 1.0f) * 65535.0f));
+	UpdateTerrainHeights(centreX - KFlattenCells / 2, centreZ - KFlattenCells / 2, KFlattenCells, KFlattenCells, quantisedHeights.data());
+}
@@ -5,6 +5,22 @@
 #include "Helper.h"
 #include "Mesh.h"
 #include "Camera.h"
+#include "TerrainBuilder.h"
+#include "TerrainQuadtree.h"
+#include "TerrainBenchmark.h"
+#include "TerrainQuery.h"
+#include "TerrainPager.h"
+#include "IndexOptimiser.h"
+#include "MeshSimplifier.h"
+#include "Animation.h"
+#include "Skinning.h"
+#include "GeometryArena.h"
+#include "TextureCache.h"
+#include "InstanceBuffer.h"
+#include "InstancedModel.h"
+
+#include <future>
+#include <memory>
 
 class Renderer
 {
@@ -13,35 +29,218 @@ private:
 	GLuint m_program{ 0 };
 	GLuint SkyProgram{ 0 };
 	GLuint CubeProgram{ 0 };
+	GLuint TerrainProgram{ 0 };
+	GLuint m_skinnedProgram{ 0 };
 	// Vertex Array Object to wrap all render settings
 	GLuint m_VAO{ 0 };
 	GLuint SkyVAO{ 0 };
-	GLuint JeepVAO{ 0 };
 	GLuint CubeVAO{ 0 };
 	// Number of elments to use when rendering
 	GLuint m_numElements{ 0 };
-	GLuint JeepNumElements{ 0 };
 	GLuint CubeNumElements{ 0 };
-	GLuint Terraintex;
-	GLuint Jeeptex;
 	GLuint SkyBoxTex;
+	GLuint TerrainHeightTex{ 0 };
 	bool m_wireframe{ false };
 
+	// Every 2D texture comes from here so is loaded once however many users it has
+	// Declared before the handles so it outlives them
+	Helpers::TextureCache m_textureCache;
+	Helpers::TextureHandle m_terrainTexture;
+	Helpers::TextureHandle m_jeepTexture;
+
+
+
+
+	// Terrain grid resolution and size in world units, the grid must be a power of two number of patches across
+	static constexpr int KTerrainCells{ 512 };
+	static constexpr int KTerrainPatchCells{ 32 };
+	static constexpr float KTerrainSize{ 800.0f };
+
+	// Seed of the generated terrain used when the heightmap will not load
+	static constexpr uint32_t KTerrainNoiseSeed{ 1 };
+
+	// Heights are read from a tiled, memory mapped copy of the heightmap image, remade whenever the image changes
+	// The copy is made from the image decoded at no more than KMaxHeightmapSamples a side
+	static constexpr const char* KHeightmapFilename{ "Data\\Heightmaps\\Heightmap.jpg" };
+	static constexpr const char* KTiledHeightmapFilename{ "Data\\Heightmaps\\Heightmap.thm" };
+	static constexpr int KTerrainTileSize{ 64 };
+	static constexpr int KMaxHeightmapSamples{ 4096 };
+
+	// The grid starts from the copy's overview, then the pager brings in the tiles around the camera on its workers and
+	// each tile's grid vertices are written into the height texture, ground queries and quadtree the first time it arrives
+	static constexpr size_t KTerrainPagerBudget{ 32 * 1024 * 1024 };
+	static constexpr float KTerrainLoadRadius{ 300.0f };
+	static constexpr int KTerrainPagerWorkers{ 2 };
+	Helpers::TerrainPager m_terrainPager;
+
+	// The grid vertices each tile covers along x and along z, as first and one past the last
+	std::vector<glm::ivec2> m_terrainTileVertsX;
+	std::vector<glm::ivec2> m_terrainTileVertsZ;
+	std::vector<int> m_terrainSampleX;
+	std::vector<int> m_terrainSampleZ;
+	std::vector<bool> m_terrainTilesApplied;
+	int m_terrainTilesAppliedCount{ 0 };
+
+	Helpers::TerrainQuadtree m_terrainQuadtree;
+	Helpers::TerrainQuery m_terrainQuery;
+	std::vector<float> m_terrainLodRanges;
+	std::vector<Helpers::TerrainSelection> m_terrainSelection;
+	float m_terrainPixelError{ 4.0f };
+	bool m_terrainFrustumCulling{ true };
+	bool m_terrainFromNoise{ false };
+	int m_terrainQuadrantsDrawn{ 0 };
+
+	// When set the heights live in an R16 texture and one flat patch is displaced in the vertex shader,
+	// otherwise every node's patch is baked on the CPU
+	bool m_terrainGpuDisplacement{ true };
+	float m_terrainHeightOffset{ 0 };
+	float m_terrainHeightRange{ 1.0f };
+
+	// Jeep sits on the ground at this spot, tilted to the slope
+	static constexpr float KJeepX{ 0.0f };
+	static constexpr float KJeepZ{ 0.0f };
+	static constexpr const char* KJeepFilename{ "Data\\Models\\Jeep\\Jeep.obj" };
+	glm::mat4 m_jeepTransform{ 1 };
+
+	// Distance along the view to the ground, negative if looking at the sky, and where it was hit
+	float m_groundHitDistance{ -1.0f };
+	glm::vec3 m_groundHitPoint{ 0 };
+
+	// Width in grid vertices of the square flattened from the GUI
+	static constexpr int KFlattenCells{ 16 };
+
+	// The Jeep loads on a worker thread then its mesh are uploaded a few at a time over the following frames
+	// No more than this many bytes of buffer data are uploaded a frame, though at least one mesh always is
+	static constexpr size_t KUploadBytesPerFrame{ 4 * 1024 * 1024 };
+	std::unique_ptr<Helpers::ModelLoader> m_jeepLoader;
+	std::future<bool> m_jeepLoading;
+	size_t m_jeepMeshesUploaded{ 0 };
+
+	// Starting size of the shared vertex and index buffers, small as they are sized to the Jeep once it has loaded
+	static constexpr size_t KArenaVertices{ 4096 };
+	static constexpr size_t KArenaIndices{ 16384 };
+	Helpers::GeometryArena m_meshArena;
+	Helpers::GeometryArena m_skinnedMeshArena;
+
+	// One Jeep mesh in an arena, its elements followed by each level of detail's
+	struct JeepMesh
+	{
+		Helpers::ArenaAllocation allocation;
+		bool skinned{ false };
+
+		// Diffuse texture of the mesh's material, or the Jeep's own if it has none
+		Helpers::TextureHandle texture;
+
+		// Levels of detail, most detailed first, with elements relative to the allocation's first index
+		std::vector<GLuint> lodFirst;
+		std::vector<GLuint> lodCount;
+		std::vector<float> lodErrors;
 
+		// Clusters of the full detail level, culled against the frustum and by facing before drawing
+		std::vector<Helpers::MeshCluster> clusters;
 
+		// Full detail triangles for picking, kept from the loaded mesh
+		Helpers::MeshBvh bvh;
+	};
+	std::vector<JeepMesh> m_jeepMeshes;
 
-	std::vector<glm::vec3> Corners;
+	// The level drawn for each mesh is the coarsest whose error is under m_meshPixelError pixels on screen
+	float m_meshPixelError{ 1.0f };
+	bool m_jeepClusterCulling{ true };
+
+	// Ranges to draw of each mesh and the arrays for the multi draw of each arena and texture, rebuilt each frame
+	std::vector<std::vector<Helpers::ClusterDrawRange>> m_jeepMeshRanges;
+	std::vector<GLuint> m_jeepBatchTextures;
+	std::vector<GLsizei> m_jeepDrawCounts;
+	std::vector<void*> m_jeepDrawOffsets;
+	std::vector<GLint> m_jeepDrawBaseVertices;
+	int m_jeepClustersDrawn{ 0 };
+	int m_jeepTrianglesDrawn{ 0 };
+	int m_jeepDrawRanges{ 0 };
+	int m_jeepDrawCalls{ 0 };
+
+	// The Jeep's one identity instance, read by the multi draw through the static arena's vertex array
+	Helpers::InstanceBuffer m_jeepInstances;
+
+	// A crowd of copies of the Jeep's static mesh with world transforms, registered once the Jeep is uploaded
+	// Skinned mesh are left out as they would need a pose per instance
+	static constexpr int KMaxCrowd{ 100000 };
+	Helpers::InstancedModel m_jeepCrowd;
+	int m_crowdSize{ 0 };
+	int m_crowdBuilt{ 0 };
+	int m_crowdDrawCalls{ 0 };
+
+	// Milliseconds to draw a crowd of each size as instances and as a draw per copy
+	struct InstancingBenchmark
+	{
+		int instances{ 0 };
+		double instancedMs{ 0 };
+		double separateMs{ 0 };
+	};
+	std::vector<InstancingBenchmark> m_instancingBenchmarks;
+	bool m_runInstancingBenchmark{ false };
+
+	// Bounds of the whole Jeep in its model space, for culling it outright, choosing its level of detail and picking
+	Helpers::MeshBounds m_jeepBounds;
+	bool m_jeepVisible{ true };
+	float m_jeepHitDistance{ -1.0f };
+	double m_jeepPickMicroseconds{ 0 };
+
+	// Pose of the Jeep's hierarchy, only used when its mesh have bones, skinned on the GPU
+	// The bones of every mesh are in one list, each mesh's bone indices offset to its part
+	Helpers::AnimationClip m_jeepAnimation;
+	Helpers::AnimationInstance m_jeepPose;
+	std::vector<Helpers::MeshBone> m_jeepBones;
+	std::vector<glm::mat4> m_jeepSkinMatrices;
+	Helpers::BoneMatrixBuffer m_jeepBoneMatrices;
+	float m_animationTime{ 0 };
+
+	// How long each stage of loading the Jeep took
+	Helpers::ImportReport m_jeepImportReport;
+
+	// Vertex cache figures of each Jeep mesh before and after reordering, copied from the loader once it is done
+	std::vector<Helpers::IndexOptimisationReport> m_meshIndexReports;
+
+	// Results of the last terrain normals benchmark run from the GUI
+	std::vector<Helpers::TerrainNormalsBenchmark> m_normalsBenchmarks;
 	std::vector<glm::vec3> TerrainVerts;
-	std::vector<glm::vec3> Normals;
 	std::vector<glm::vec3> CubeNormals;
-	std::vector<glm::vec2> UV;
-	std::vector<GLint> elements;
 	std::vector<GLint> Cube_Elements;
 
 
 	bool CreateProgram();
 	bool CreateSkyProgram();
 	bool CreateCubeProgram();
+	bool CreateTerrainProgram();
+	bool CreateSkinnedProgram();
+
+	// Picks up the Jeep once it has loaded and uploads as much of it as the frame's budget allows
+	void UploadPendingModels();
+	void UploadJeepMesh(size_t meshIndex);
+
+	// Works out which grid vertices each tile of the paged heightmap covers
+	void MapTerrainTiles(const Helpers::TerrainBuilder& builder);
+
+	// Takes in the tiles the pager has finished and writes their heights into the grid, once per tile
+	void UpdateTerrainPaging(const glm::vec3& cameraPos);
+
+	// Writes a block of heights to the texture and the CPU copies, clipped to the grid, false if none of it was on the grid
+	bool WriteTerrainHeights(int x, int z, int width, int height, const uint16_t* quantisedHeights);
+
+	// Stands the Jeep on the ground at its spot, tilted to the slope
+	void PlaceJeep();
+
+	// Flattens the terrain around where the view meets the ground, to show off UpdateTerrainHeights
+	void FlattenGroundInView();
+
+	// Registers the Jeep's static mesh as the crowd's model once they are all in the arena
+	void RegisterCrowdModel();
+
+	// Lays out count Jeeps on a grid on the terrain around the first, each turned and tinted differently
+	void BuildCrowd(int count);
+
+	// Draws crowds of 1 to 100k Jeeps each way, finishing the GPU around each so the times include its work
+	void BenchmarkInstancing(const glm::mat4& combined_xform, const glm::vec3& viewer, float pixelsPerUnit);
 public:
 	Renderer();
 	~Renderer();
@@ -54,5 +253,11 @@ public:
 
 	// Render the scene
 	void Render(const Helpers::Camera& camera, float deltaTime);
+
+	// Replaces a width x height block of terrain heights starting at grid vertex (x, z), GPU displacement mode only
+	// Heights are quantised the same way as at load, rows along x as in the terrain grid
+	// Any part off the edge of the grid is ignored
+	// The ground queries, patch bounds and level errors are refreshed too, and the Jeep and its crowd re-stood
+	void UpdateTerrainHeights(int x, int z, int width, int height, const uint16_t* quantisedHeights);
 };
 
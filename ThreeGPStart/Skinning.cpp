@@ -0,0 +1,147 @@
+#include "Skinning.h"
+#include "Mesh.h"
+#include "Parallel.h"
+
+#include <emmintrin.h>
+
+namespace Helpers
+{
+	// Skinning a vertex is cheap so small meshes stay on one thread
+	static constexpr size_t KMinVerticesPerThread{ 4096 };
+
+	void ComputeSkinMatrices(const std::vector<MeshBone>& bones, const std::vector<glm::mat4>& worldTransforms,
+		std::vector<glm::mat4>& skinMatrices)
+	{
+		// Bones of one mesh share its node so its inverse is only worked out when the node changes
+		skinMatrices.resize(bones.size());
+		unsigned int inverseNode{ ~0u };
+		glm::mat4 meshInverse{ 1 };
+		for (size_t b = 0; b < bones.size(); b++)
+		{
+			const MeshBone& bone{ bones[b] };
+			if (bone.node >= worldTransforms.size() || bone.meshNode >= worldTransforms.size())
+			{
+				skinMatrices[b] = glm::mat4(1);
+				continue;
+			}
+			if (bone.meshNode != inverseNode)
+			{
+				inverseNode = bone.meshNode;
+				meshInverse = glm::inverse(worldTransforms[bone.meshNode]);
+			}
+			skinMatrices[b] = meshInverse * worldTransforms[bone.node] * bone.offset;
+		}
+	}
+
+	// Blends the columns of the influencing matrices then transforms by the result, one column per register
+	void SkinMesh(const Mesh& mesh, const std::vector<glm::mat4>& skinMatrices,
+		std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals)
+	{
+		const size_t numVertices{ mesh.vertices.size() };
+		const bool hasNormals{ mesh.normals.size() == numVertices };
+		positions.resize(numVertices);
+		normals.resize(hasNormals ? numVertices : 0);
+
+		if (mesh.boneIndices.size() != numVertices || skinMatrices.size() < mesh.bones.size())
+		{
+			positions = mesh.vertices;
+			if (hasNormals)
+				normals = mesh.normals;
+			return;
+		}
+
+		ParallelFor(numVertices, [&](size_t begin, size_t end)
+		{
+			alignas(16) float result[4];
+			for (size_t v = begin; v < end; v++)
+			{
+				const glm::uvec4& indices{ mesh.boneIndices[v] };
+				const glm::vec4& weights{ mesh.boneWeights[v] };
+
+				__m128 column[4]{ _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+				float totalWeight{ 0 };
+				for (int i = 0; i < KMaxBoneInfluences; i++)
+				{
+					if (weights[i] <= 0)
+						continue;
+					totalWeight += weights[i];
+
+					const float* matrix{ glm::value_ptr(skinMatrices[indices[i]]) };
+					const __m128 weight{ _mm_set1_ps(weights[i]) };
+					for (int c = 0; c < 4; c++)
+						column[c] = _mm_add_ps(column[c], _mm_mul_ps(_mm_loadu_ps(matrix + c * 4), weight));
+				}
+
+				if (totalWeight <= 0)
+				{
+					positions[v] = mesh.vertices[v];
+					if (hasNormals)
+						normals[v] = mesh.normals[v];
+					continue;
+				}
+
+				const glm::vec3& position{ mesh.vertices[v] };
+				__m128 skinned{ _mm_add_ps(_mm_mul_ps(column[0], _mm_set1_ps(position.x)), column[3]) };
+				skinned = _mm_add_ps(skinned, _mm_mul_ps(column[1], _mm_set1_ps(position.y)));
+				skinned = _mm_add_ps(skinned, _mm_mul_ps(column[2], _mm_set1_ps(position.z)));
+				_mm_store_ps(result, skinned);
+				positions[v] = glm::vec3(result[0], result[1], result[2]);
+
+				// Bones are assumed to scale uniformly so the normal only needs renormalising
+				if (hasNormals)
+				{
+					const glm::vec3& normal{ mesh.normals[v] };
+					skinned = _mm_mul_ps(column[0], _mm_set1_ps(normal.x));
+					skinned = _mm_add_ps(skinned, _mm_mul_ps(column[1], _mm_set1_ps(normal.y)));
+					skinned = _mm_add_ps(skinned, _mm_mul_ps(column[2], _mm_set1_ps(normal.z)));
+					_mm_store_ps(result, skinned);
+					const glm::vec3 skinnedNormal{ result[0], result[1], result[2] };
+					const float length{ glm::length(skinnedNormal) };
+					normals[v] = length > 0 ? skinnedNormal / length : normal;
+				}
+			}
+		}, KMinVerticesPerThread);
+	}
+
+	BoneMatrixBuffer::~BoneMatrixBuffer()
+	{
+		glDeleteTextures(1, &m_texture);
+		glDeleteBuffers(1, &m_buffer);
+	}
+
+	// Only reallocates when there are more matrices than ever before
+	void BoneMatrixBuffer::Update(const std::vector<glm::mat4>& skinMatrices)
+	{
+		if (skinMatrices.empty())
+			return;
+
+		if (!m_buffer)
+		{
+			glGenBuffers(1, &m_buffer);
+			glGenTextures(1, &m_texture);
+		}
+
+		glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+		if (skinMatrices.size() > m_capacity)
+		{
+			m_capacity = skinMatrices.size();
+			glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4) * m_capacity, skinMatrices.data(), GL_DYNAMIC_DRAW);
+
+			glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+		else
+		{
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(glm::mat4) * skinMatrices.size(), skinMatrices.data());
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void BoneMatrixBuffer::Bind(GLuint textureUnit) const
+	{
+		glActiveTexture(GL_TEXTURE0 + textureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+}
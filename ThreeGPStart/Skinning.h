@@ -0,0 +1,42 @@
+#pragma once
+// Skeletal skinning of meshes with bones, on the CPU here or in the vertex shader with a bone matrix buffer
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	struct Mesh;
+	struct MeshBone;
+
+	// Matrices taking each bone's vertices from the bind pose to the pose, skinMatrices[b] is for bones[b]
+	// Results are relative to the mesh's node, so the bind pose gives identity however the hierarchy above it is transformed
+	// worldTransforms are every node's model space transform, e.g. from an AnimationInstance
+	void ComputeSkinMatrices(const std::vector<MeshBone>& bones, const std::vector<glm::mat4>& worldTransforms,
+		std::vector<glm::mat4>& skinMatrices);
+
+	// Skins the mesh's positions, and normals if it has any, into model space using SSE, split over the thread pool
+	// For headless use or anything that needs the posed vertices back. Vertices with no weights keep the bind pose.
+	void SkinMesh(const Mesh& mesh, const std::vector<glm::mat4>& skinMatrices,
+		std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals);
+
+	// Skin matrices on the GPU, read by the vertex shader through a samplerBuffer four texels per matrix
+	// Updating it each frame is all animation needs, the mesh's own buffers never change
+	class BoneMatrixBuffer
+	{
+	private:
+		GLuint m_buffer{ 0 };
+		GLuint m_texture{ 0 };
+		size_t m_capacity{ 0 };
+	public:
+		BoneMatrixBuffer() = default;
+		~BoneMatrixBuffer();
+		BoneMatrixBuffer(const BoneMatrixBuffer&) = delete;
+		BoneMatrixBuffer& operator=(const BoneMatrixBuffer&) = delete;
+
+		// Copies the matrices up, growing the buffer if needed
+		void Update(const std::vector<glm::mat4>& skinMatrices);
+
+		// Binds the buffer texture to the given texture unit
+		void Bind(GLuint textureUnit) const;
+	};
+}
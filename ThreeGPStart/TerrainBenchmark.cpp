@@ -0,0 +1,48 @@
+#include "TerrainBenchmark.h"
+#include "TerrainBuilder.h"
+
+#include <chrono>
+
+namespace Helpers
+{
+	// Milliseconds func takes at best over repeats runs
+	template<typename Func>
+	static double BestTimeMs(int repeats, Func&& func)
+	{
+		double best{ std::numeric_limits<double>::max() };
+		for (int i = 0; i < std::max(1, repeats); i++)
+		{
+			const auto start{ std::chrono::steady_clock::now() };
+			func();
+			const std::chrono::duration<double, std::milli> taken{ std::chrono::steady_clock::now() - start };
+			best = std::min(best, taken.count());
+		}
+		return best;
+	}
+
+	TerrainNormalsBenchmark BenchmarkTerrainNormals(int gridCells, int repeats)
+	{
+		TerrainNormalsBenchmark result;
+		result.gridCells = gridCells;
+
+		// The work done does not depend on the heights, but noise keeps the normals realistic
+		TerrainBuilder builder(gridCells, gridCells, 1.0f);
+		builder.GenerateNoise(NoiseTerrainSettings());
+
+		TerrainMesh mesh;
+		builder.Build(mesh);
+
+		result.scatterMs = BestTimeMs(repeats, [&]()
+		{
+			std::fill(mesh.normals.begin(), mesh.normals.end(), glm::vec3(0));
+			TerrainBuilder::AccumulateFaceNormals(mesh);
+		});
+
+		std::vector<glm::vec3> normals;
+		result.gatherMs = BestTimeMs(repeats, [&]() { builder.ComputeNormals(normals); });
+
+		std::cout << "Terrain normals " << gridCells << "x" << gridCells << ": scatter " << result.scatterMs
+			<< " ms, gather " << result.gatherMs << " ms" << std::endl;
+		return result;
+	}
+}
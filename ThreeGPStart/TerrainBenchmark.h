@@ -0,0 +1,19 @@
+#pragma once
+// Timings of the terrain builders, run on demand from the GUI
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	// Milliseconds taken to build the normals of a gridCells x gridCells terrain each way
+	struct TerrainNormalsBenchmark
+	{
+		int gridCells{ 0 };
+		double scatterMs{ 0 };
+		double gatherMs{ 0 };
+	};
+
+	// Times the per triangle scatter against the central difference gather on a noise heightfield
+	// Each method is run repeats times and the fastest kept
+	TerrainNormalsBenchmark BenchmarkTerrainNormals(int gridCells, int repeats = 3);
+}
@@ -0,0 +1,271 @@
+#include "TerrainBuilder.h"
+#include "Parallel.h"
+#include "TiledHeightmap.h"
+
+#include <emmintrin.h>
+
+namespace Helpers
+{
+	// Rows smaller than this are not worth a thread of their own
+	static constexpr size_t KMinRowsPerThread{ 16 };
+
+	TerrainBuilder::TerrainBuilder(int numCellsX, int numCellsZ, float cellSize) :
+		m_numCellsX(numCellsX), m_numCellsZ(numCellsZ), m_cellSize(cellSize)
+	{
+		m_heights.assign((size_t)NumVertsX() * NumVertsZ(), 0.0f);
+	}
+
+	// Sets every vertex height to the red channel of an RGBA image, nearest texel
+	void TerrainBuilder::SampleHeightmap(const BYTE* rgbaData, int width, int height)
+	{
+		const size_t numVertsX{ (size_t)NumVertsX() };
+		const size_t numVertsZ{ (size_t)NumVertsZ() };
+
+		if (!rgbaData || width <= 0 || height <= 0)
+		{
+			m_heights.assign(numVertsX * numVertsZ, 0.0f);
+			return;
+		}
+
+		const float vertXToImage{ width / (float)numVertsX };
+		const float vertZToImage{ height / (float)numVertsZ };
+
+		ParallelFor(numVertsX, [&](size_t begin, size_t end)
+		{
+			for (size_t x = begin; x < end; x++)
+			{
+				const size_t imageX{ std::min((size_t)(vertXToImage * x), (size_t)width - 1) };
+				float* row{ &m_heights[x * numVertsZ] };
+				for (size_t z = 0; z < numVertsZ; z++)
+				{
+					const size_t imageZ{ std::min((size_t)(vertZToImage * z), (size_t)height - 1) };
+					row[z] = rgbaData[(imageX + imageZ * width) * 4];
+				}
+			}
+		}, KMinRowsPerThread);
+	}
+
+	// Same nearest sample mapping as SampleHeightmap
+	void TerrainBuilder::TiledSampleIndices(const TiledHeightmapHeader& header, std::vector<int>& sampleX, std::vector<int>& sampleZ) const
+	{
+		const float vertXToSample{ header.width / (float)NumVertsX() };
+		const float vertZToSample{ header.height / (float)NumVertsZ() };
+
+		sampleX.resize((size_t)NumVertsX());
+		for (size_t x = 0; x < sampleX.size(); x++)
+			sampleX[x] = std::min((int)(vertXToSample * x), (int)header.width - 1);
+		sampleZ.resize((size_t)NumVertsZ());
+		for (size_t z = 0; z < sampleZ.size(); z++)
+			sampleZ[z] = std::min((int)(vertZToSample * z), (int)header.height - 1);
+	}
+
+	// Reads through the file mapping
+	void TerrainBuilder::SampleTiledHeightmap(const TiledHeightmap& heightmap)
+	{
+		std::vector<int> sampleX, sampleZ;
+		TiledSampleIndices(heightmap.GetHeader(), sampleX, sampleZ);
+
+		const size_t numVertsZ{ (size_t)NumVertsZ() };
+		ParallelFor(sampleX.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t x = begin; x < end; x++)
+			{
+				float* row{ &m_heights[x * numVertsZ] };
+				for (size_t z = 0; z < numVertsZ; z++)
+					row[z] = heightmap.GetHeight(sampleX[x], sampleZ[z]);
+			}
+		}, KMinRowsPerThread);
+	}
+
+	void TerrainBuilder::SampleTiledOverview(const TiledHeightmap& heightmap)
+	{
+		std::vector<int> sampleX, sampleZ;
+		TiledSampleIndices(heightmap.GetHeader(), sampleX, sampleZ);
+
+		const size_t numVertsZ{ (size_t)NumVertsZ() };
+		ParallelFor(sampleX.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t x = begin; x < end; x++)
+			{
+				float* row{ &m_heights[x * numVertsZ] };
+				for (size_t z = 0; z < numVertsZ; z++)
+					row[z] = heightmap.GetOverviewHeight((float)sampleX[x], (float)sampleZ[z]);
+			}
+		}, KMinRowsPerThread);
+	}
+
+	// Sets every vertex height from seeded fractal noise
+	void TerrainBuilder::GenerateNoise(const NoiseTerrainSettings& settings)
+	{
+		GenerateNoiseHeights(settings, NumVertsX(), NumVertsZ(), m_heights);
+	}
+
+	// Heights scaled to the full 16 bit range
+	void TerrainBuilder::GetQuantisedHeights(std::vector<uint16_t>& quantised, float& minHeight, float& heightRange) const
+	{
+		const auto minMax{ std::minmax_element(m_heights.begin(), m_heights.end()) };
+		minHeight = *minMax.first;
+		heightRange = std::max(*minMax.second - minHeight, 1e-6f);
+		QuantiseHeights(quantised, minHeight, heightRange);
+	}
+
+	void TerrainBuilder::QuantiseHeights(std::vector<uint16_t>& quantised, float minHeight, float heightRange) const
+	{
+		const float scale{ 65535.0f / std::max(heightRange, 1e-6f) };
+		quantised.resize(m_heights.size());
+		ParallelFor(m_heights.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				quantised[i] = (uint16_t)(std::clamp((m_heights[i] - minHeight) * scale, 0.0f, 65535.0f) + 0.5f);
+		}, 4096);
+	}
+
+	// Fills positions, uvs, normals and the diamond pattern elements
+	void TerrainBuilder::Build(TerrainMesh& mesh) const
+	{
+		ComputeNormals(mesh.normals);
+
+		const size_t numVertsX{ (size_t)NumVertsX() };
+		const size_t numVertsZ{ (size_t)NumVertsZ() };
+		const size_t numCellsX{ (size_t)m_numCellsX };
+		const size_t numCellsZ{ (size_t)m_numCellsZ };
+
+		// Everything is sized up front so each row writes to its own slice
+		mesh.positions.resize(numVertsX * numVertsZ);
+		mesh.uvCoords.resize(numVertsX * numVertsZ);
+		mesh.elements.resize(numCellsX * numCellsZ * 6);
+
+		ParallelFor(numVertsX, [&](size_t begin, size_t end)
+		{
+			for (size_t x = begin; x < end; x++)
+			{
+				for (size_t z = 0; z < numVertsZ; z++)
+				{
+					const size_t vertex{ x * numVertsZ + z };
+					mesh.positions[vertex] = glm::vec3(x * m_cellSize, m_heights[vertex], z * m_cellSize);
+					mesh.uvCoords[vertex] = glm::vec2(z / (float)numCellsZ, x / (float)numCellsX);
+				}
+
+				if (x == numCellsX)
+					continue;
+
+				// Alternate the split direction of neighbouring cells to give the diamond pattern
+				GLuint* cellElements{ &mesh.elements[x * numCellsZ * 6] };
+				for (size_t z = 0; z < numCellsZ; z++)
+				{
+					const GLuint startVertex{ (GLuint)(x * numVertsZ + z) };
+					const GLuint nextRow{ startVertex + (GLuint)numVertsZ };
+					if (((x + z) & 1) == 0)
+					{
+						//first triangle
+						cellElements[0] = startVertex;
+						cellElements[1] = startVertex + 1;
+						cellElements[2] = nextRow;
+						//second triangle
+						cellElements[3] = startVertex + 1;
+						cellElements[4] = nextRow + 1;
+						cellElements[5] = nextRow;
+					}
+					else
+					{
+						//first triangle
+						cellElements[0] = startVertex;
+						cellElements[1] = nextRow + 1;
+						cellElements[2] = nextRow;
+						//second triangle
+						cellElements[3] = startVertex + 1;
+						cellElements[4] = nextRow + 1;
+						cellElements[5] = startVertex;
+					}
+					cellElements += 6;
+				}
+			}
+		}, KMinRowsPerThread);
+	}
+
+	// Normal of one vertex, clamping the neighbours at the grid edges
+	static glm::vec3 CentralDifferenceNormal(const std::vector<float>& heights, size_t numVertsX, size_t numVertsZ,
+		float cellSize, size_t x, size_t z)
+	{
+		const size_t x0{ x == 0 ? x : x - 1 };
+		const size_t x1{ x == numVertsX - 1 ? x : x + 1 };
+		const size_t z0{ z == 0 ? z : z - 1 };
+		const size_t z1{ z == numVertsZ - 1 ? z : z + 1 };
+
+		const float dhdx{ (heights[x1 * numVertsZ + z] - heights[x0 * numVertsZ + z]) / ((x1 - x0) * cellSize) };
+		const float dhdz{ (heights[x * numVertsZ + z1] - heights[x * numVertsZ + z0]) / ((z1 - z0) * cellSize) };
+		return glm::normalize(glm::vec3(-dhdx, 1.0f, -dhdz));
+	}
+
+	// Gathers each normal from its neighbours' heights, so unlike the scatter over triangles every write is independent
+	void TerrainBuilder::ComputeNormals(std::vector<glm::vec3>& normals) const
+	{
+		const size_t numVertsX{ (size_t)NumVertsX() };
+		const size_t numVertsZ{ (size_t)NumVertsZ() };
+		normals.resize(numVertsX * numVertsZ);
+
+		// (-dh/dx, 1, -dh/dz) scaled by twice the cell size to save a divide per vertex
+		const __m128 twoCells{ _mm_set1_ps(2.0f * m_cellSize) };
+		const __m128 signMask{ _mm_set1_ps(-0.0f) };
+
+		ParallelFor(numVertsX, [&](size_t begin, size_t end)
+		{
+			alignas(16) float nx[4];
+			alignas(16) float ny[4];
+			alignas(16) float nz[4];
+
+			for (size_t x = begin; x < end; x++)
+			{
+				glm::vec3* row{ &normals[x * numVertsZ] };
+
+				// Edge rows and columns have one sided differences, they are left to the scalar loop below
+				size_t z{ 1 };
+				if (x > 0 && x < numVertsX - 1)
+				{
+					const float* prevRow{ &m_heights[(x - 1) * numVertsZ] };
+					const float* thisRow{ &m_heights[x * numVertsZ] };
+					const float* nextRow{ &m_heights[(x + 1) * numVertsZ] };
+
+					for (; z + 4 < numVertsZ; z += 4)
+					{
+						const __m128 dx{ _mm_sub_ps(_mm_loadu_ps(nextRow + z), _mm_loadu_ps(prevRow + z)) };
+						const __m128 dz{ _mm_sub_ps(_mm_loadu_ps(thisRow + z + 1), _mm_loadu_ps(thisRow + z - 1)) };
+
+						const __m128 lengthSq{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), _mm_mul_ps(twoCells, twoCells)) };
+						const __m128 invLength{ _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSq)) };
+
+						_mm_store_ps(nx, _mm_mul_ps(_mm_xor_ps(dx, signMask), invLength));
+						_mm_store_ps(ny, _mm_mul_ps(twoCells, invLength));
+						_mm_store_ps(nz, _mm_mul_ps(_mm_xor_ps(dz, signMask), invLength));
+						for (int i = 0; i < 4; i++)
+							row[z + i] = glm::vec3(nx[i], ny[i], nz[i]);
+					}
+				}
+
+				row[0] = CentralDifferenceNormal(m_heights, numVertsX, numVertsZ, m_cellSize, x, 0);
+				for (; z < numVertsZ; z++)
+					row[z] = CentralDifferenceNormal(m_heights, numVertsX, numVertsZ, m_cellSize, x, z);
+			}
+		}, KMinRowsPerThread);
+	}
+
+	// Accumulates each triangle's normal into its three vertices
+	void TerrainBuilder::AccumulateFaceNormals(TerrainMesh& mesh)
+	{
+		for (size_t i = 0; i < mesh.elements.size(); i += 3)
+		{
+			glm::vec3 v0{ mesh.positions[mesh.elements[i]] };
+			glm::vec3 v1{ mesh.positions[mesh.elements[i + 1]] };
+			glm::vec3 v2{ mesh.positions[mesh.elements[i + 2]] };
+
+			glm::vec3 side1 = v1 - v0;
+			glm::vec3 side2 = v2 - v0;
+
+			glm::vec3 triangleNormal = glm::normalize(glm::cross(side1, side2));
+
+			mesh.normals[mesh.elements[i]] += triangleNormal;
+			mesh.normals[mesh.elements[i + 1]] += triangleNormal;
+			mesh.normals[mesh.elements[i + 2]] += triangleNormal;
+		}
+	}
+}
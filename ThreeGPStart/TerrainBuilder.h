@@ -0,0 +1,80 @@
+#pragma once
+// Builds the terrain grid mesh from a height source
+
+#include "ExternalLibraryHeaders.h"
+#include "NoiseTerrain.h"
+
+#include <cstdint>
+
+namespace Helpers
+{
+	class TiledHeightmap;
+	struct TiledHeightmapHeader;
+
+	// CPU side terrain geometry ready for upload
+	// Vertices are stored in rows along x, so vertex (x, z) is at index x * numVertsZ + z
+	struct TerrainMesh
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> uvCoords;
+		std::vector<glm::vec3> normals;
+		std::vector<GLuint> elements;
+	};
+
+	// Creates a regular grid of numCellsX by numCellsZ cells, each cellSize wide
+	// Heights are held one per vertex so other systems can share them
+	class TerrainBuilder
+	{
+	private:
+		int m_numCellsX{ 0 };
+		int m_numCellsZ{ 0 };
+		float m_cellSize{ 1.0f };
+
+		// One height per vertex, same layout as the mesh vertices
+		std::vector<float> m_heights;
+	public:
+		TerrainBuilder(int numCellsX, int numCellsZ, float cellSize);
+
+		int NumCellsX() const { return m_numCellsX; }
+		int NumCellsZ() const { return m_numCellsZ; }
+		int NumVertsX() const { return m_numCellsX + 1; }
+		int NumVertsZ() const { return m_numCellsZ + 1; }
+		float CellSize() const { return m_cellSize; }
+
+		// Sets every vertex height to the red channel of an RGBA image (as given by ImageLoader)
+		// Pass nullptr to get a flat grid
+		void SampleHeightmap(const BYTE* rgbaData, int width, int height);
+
+		// The sample of a tiled heightmap each column of vertices along x, and each along z, takes its height from
+		void TiledSampleIndices(const TiledHeightmapHeader& header, std::vector<int>& sampleX, std::vector<int>& sampleZ) const;
+
+		// Sets every vertex height to the nearest sample of a tiled heightmap, only the samples used are read
+		void SampleTiledHeightmap(const TiledHeightmap& heightmap);
+
+		// Sets every vertex height from the tiled heightmap's overview, at the same positions as SampleTiledHeightmap
+		// Only the overview is read, the tiles can then replace it as they are paged in
+		void SampleTiledOverview(const TiledHeightmap& heightmap);
+
+		// Sets every vertex height from seeded fractal noise, for terrains of any size without an image
+		void GenerateNoise(const NoiseTerrainSettings& settings);
+
+		// Per vertex heights in mesh vertex order
+		const std::vector<float>& GetHeights() const { return m_heights; }
+
+		// Heights scaled to the full 16 bit range, a height is minHeight + quantised / 65535 * heightRange
+		void GetQuantisedHeights(std::vector<uint16_t>& quantised, float& minHeight, float& heightRange) const;
+
+		// Heights scaled over a range given rather than their own, clamped to it
+		void QuantiseHeights(std::vector<uint16_t>& quantised, float minHeight, float heightRange) const;
+
+		// Fills positions, uvs, normals and the diamond pattern elements. Rows are built in parallel.
+		void Build(TerrainMesh& mesh) const;
+
+		// Unit normals from the central difference of each vertex's neighbouring heights, one sided at the edges
+		// Each vertex only reads heights so rows run in parallel, four vertices at a time with SSE
+		void ComputeNormals(std::vector<glm::vec3>& normals) const;
+
+		// Accumulates each triangle's normal into its three vertices, unnormalised. Slow, kept for comparison.
+		static void AccumulateFaceNormals(TerrainMesh& mesh);
+	};
+}
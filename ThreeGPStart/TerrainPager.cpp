@@ -0,0 +1,212 @@
+#include "TerrainPager.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Helpers
+{
+	// Opens the tiled file and starts the workers
+	bool TerrainPager::Start(const std::string& filepath, const std::string& sourcePath, size_t memoryBudget, float loadRadius,
+		int numWorkers)
+	{
+		Stop();
+
+		if (!m_source.Open(filepath, sourcePath))
+			return false;
+
+		m_memoryBudget = memoryBudget;
+		m_loadRadius = loadRadius;
+		m_stopping = false;
+
+		for (int i = 0; i < std::max(1, numWorkers); i++)
+			m_workers.emplace_back(&TerrainPager::WorkerLoop, this);
+
+		return true;
+	}
+
+	// Stops the workers and drops every tile
+	void TerrainPager::Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_requestMutex);
+			m_stopping = true;
+			m_requests.clear();
+		}
+		m_requestReady.notify_all();
+
+		for (std::thread& worker : m_workers)
+			worker.join();
+		m_workers.clear();
+
+		m_completed.clear();
+		m_resident.clear();
+		m_lru.clear();
+		m_inFlight.clear();
+		m_arrived.clear();
+	}
+
+	// Workers copy tiles out of the mapping, so any disk reads happen here rather than on the render thread
+	void TerrainPager::WorkerLoop()
+	{
+		const size_t samplesPerTile{ m_source.TileSamplesPerSide() * m_source.TileSamplesPerSide() };
+
+		for (;;)
+		{
+			uint64_t key;
+			{
+				std::unique_lock<std::mutex> lock(m_requestMutex);
+				m_requestReady.wait(lock, [this]() { return m_stopping || !m_requests.empty(); });
+				if (m_stopping)
+					return;
+
+				key = m_requests.front();
+				m_requests.pop_front();
+			}
+
+			std::unique_ptr<TerrainTile> tile{ std::make_unique<TerrainTile>() };
+			tile->tileX = (int)(key >> 32);
+			tile->tileZ = (int)(uint32_t)key;
+
+			const uint16_t* samples{ m_source.GetTileSamples(tile->tileX, tile->tileZ) };
+			tile->samples.assign(samples, samples + samplesPerTile);
+
+			std::lock_guard<std::mutex> lock(m_completeMutex);
+			m_completed.push_back(std::move(tile));
+		}
+	}
+
+	void TerrainPager::Touch(ResidentTile& resident, uint64_t key)
+	{
+		m_lru.erase(resident.lruPosition);
+		m_lru.push_front(key);
+		resident.lruPosition = m_lru.begin();
+	}
+
+	void TerrainPager::EvictToFit(size_t incomingBytes)
+	{
+		while (!m_lru.empty() && ResidentBytes() + incomingBytes > m_memoryBudget)
+		{
+			m_resident.erase(m_lru.back());
+			m_lru.pop_back();
+		}
+	}
+
+	// Takes in finished tiles and requests the ones now wanted, nearest first
+	void TerrainPager::Update(const glm::vec3& cameraPos)
+	{
+		m_arrived.clear();
+		if (m_workers.empty())
+			return;
+
+		// Swap in whatever the workers have finished
+		std::vector<std::unique_ptr<TerrainTile>> completed;
+		{
+			std::lock_guard<std::mutex> lock(m_completeMutex);
+			completed.swap(m_completed);
+		}
+
+		const size_t tileBytes{ m_source.TileBytes() };
+		for (std::unique_ptr<TerrainTile>& tile : completed)
+		{
+			const uint64_t key{ TileKey(tile->tileX, tile->tileZ) };
+			m_inFlight.erase(key);
+			if (m_resident.count(key))
+				continue;
+
+			EvictToFit(tileBytes);
+			m_lru.push_front(key);
+			m_arrived.emplace_back(tile->tileX, tile->tileZ);
+			m_resident[key] = ResidentTile{ std::move(tile), m_lru.begin() };
+		}
+
+		// Work out which tiles are in range, nearest first
+		const TiledHeightmapHeader& header{ m_source.GetHeader() };
+		const float tileWorldSize{ header.tileSize * header.sampleSpacing };
+		const int minTileX{ std::max(0, (int)std::floor((cameraPos.x - m_loadRadius) / tileWorldSize)) };
+		const int maxTileX{ std::min((int)header.numTilesX - 1, (int)std::floor((cameraPos.x + m_loadRadius) / tileWorldSize)) };
+		const int minTileZ{ std::max(0, (int)std::floor((cameraPos.z - m_loadRadius) / tileWorldSize)) };
+		const int maxTileZ{ std::min((int)header.numTilesZ - 1, (int)std::floor((cameraPos.z + m_loadRadius) / tileWorldSize)) };
+
+		std::vector<std::pair<float, uint64_t>> wanted;
+		for (int tileX = minTileX; tileX <= maxTileX; tileX++)
+		{
+			for (int tileZ = minTileZ; tileZ <= maxTileZ; tileZ++)
+			{
+				const glm::vec2 tileMin{ tileX * tileWorldSize, tileZ * tileWorldSize };
+				const glm::vec2 closest{ glm::clamp(glm::vec2(cameraPos.x, cameraPos.z), tileMin, tileMin + tileWorldSize) };
+				const float distance{ glm::distance(closest, glm::vec2(cameraPos.x, cameraPos.z)) };
+				if (distance <= m_loadRadius)
+					wanted.emplace_back(distance, TileKey(tileX, tileZ));
+			}
+		}
+		std::sort(wanted.begin(), wanted.end());
+
+		// Never want more than fits in the budget or the nearest tiles would evict each other
+		const size_t maxTiles{ std::max<size_t>(1, m_memoryBudget / tileBytes) };
+		if (wanted.size() > maxTiles)
+			wanted.resize(maxTiles);
+
+		// Furthest first so the nearest wanted tiles end up most recently used
+		for (auto it = wanted.rbegin(); it != wanted.rend(); ++it)
+		{
+			auto resident{ m_resident.find(it->second) };
+			if (resident != m_resident.end())
+				Touch(resident->second, it->second);
+		}
+
+		// Replace the queue, anything still waiting from last frame that is no longer wanted is dropped
+		{
+			std::lock_guard<std::mutex> lock(m_requestMutex);
+			for (uint64_t key : m_requests)
+				m_inFlight.erase(key);
+			m_requests.clear();
+
+			for (const auto& entry : wanted)
+			{
+				if (m_resident.count(entry.second) || m_inFlight.count(entry.second))
+					continue;
+				m_requests.push_back(entry.second);
+				m_inFlight.insert(entry.second);
+			}
+		}
+		m_requestReady.notify_all();
+	}
+
+	// The tile if it is in memory, otherwise nullptr
+	const TerrainTile* TerrainPager::FindTile(int tileX, int tileZ) const
+	{
+		auto resident{ m_resident.find(TileKey(tileX, tileZ)) };
+		return resident == m_resident.end() ? nullptr : resident->second.tile.get();
+	}
+
+	// Bilinear height at a world position, false if the tile is not in memory
+	bool TerrainPager::GetHeight(float worldX, float worldZ, float& height) const
+	{
+		const TiledHeightmapHeader& header{ m_source.GetHeader() };
+		const float sampleX{ glm::clamp(worldX / header.sampleSpacing, 0.0f, (float)(header.width - 1)) };
+		const float sampleZ{ glm::clamp(worldZ / header.sampleSpacing, 0.0f, (float)(header.height - 1)) };
+
+		const int tileX{ std::min((int)(sampleX / header.tileSize), (int)header.numTilesX - 1) };
+		const int tileZ{ std::min((int)(sampleZ / header.tileSize), (int)header.numTilesZ - 1) };
+		const TerrainTile* tile{ FindTile(tileX, tileZ) };
+		if (!tile)
+			return false;
+
+		// The shared edge means the four samples are always inside this one tile
+		const float localX{ sampleX - tileX * (float)header.tileSize };
+		const float localZ{ sampleZ - tileZ * (float)header.tileSize };
+		const int x0{ std::min((int)localX, (int)header.tileSize - 1) };
+		const int z0{ std::min((int)localZ, (int)header.tileSize - 1) };
+		const float u{ localX - x0 };
+		const float v{ localZ - z0 };
+
+		const size_t samplesPerSide{ m_source.TileSamplesPerSide() };
+		const uint16_t* row0{ &tile->samples[(size_t)x0 * samplesPerSide] };
+		const uint16_t* row1{ row0 + samplesPerSide };
+		const float h0{ row0[z0] + (row0[z0 + 1] - (float)row0[z0]) * v };
+		const float h1{ row1[z0] + (row1[z0 + 1] - (float)row1[z0]) * v };
+
+		height = (h0 + (h1 - h0) * u) * header.heightScale;
+		return true;
+	}
+}
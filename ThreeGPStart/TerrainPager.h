@@ -0,0 +1,94 @@
+#pragma once
+// Background pager that streams the tiles of a tiled heightmap around the camera
+
+#include "ExternalLibraryHeaders.h"
+#include "TiledHeightmap.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Helpers
+{
+	// A tile copied into memory by the pager
+	struct TerrainTile
+	{
+		int tileX{ 0 };
+		int tileZ{ 0 };
+		std::vector<uint16_t> samples;
+	};
+
+	// Keeps the tiles around the camera in memory. Loading happens on worker threads, Update only swaps
+	// finished tiles in and queues new requests so the frame never waits on the disk.
+	// Tiles are evicted least recently used first to stay within the memory budget.
+	class TerrainPager
+	{
+	private:
+		TiledHeightmap m_source;
+		size_t m_memoryBudget{ 0 };
+		float m_loadRadius{ 0 };
+
+		// Shared with the workers
+		std::vector<std::thread> m_workers;
+		std::mutex m_requestMutex;
+		std::condition_variable m_requestReady;
+		std::deque<uint64_t> m_requests;
+		bool m_stopping{ false };
+
+		std::mutex m_completeMutex;
+		std::vector<std::unique_ptr<TerrainTile>> m_completed;
+
+		// Only touched by the thread calling Update
+		struct ResidentTile
+		{
+			std::unique_ptr<TerrainTile> tile;
+			std::list<uint64_t>::iterator lruPosition;
+		};
+		std::unordered_map<uint64_t, ResidentTile> m_resident;
+		std::list<uint64_t> m_lru;
+		std::unordered_set<uint64_t> m_inFlight;
+		std::vector<glm::ivec2> m_arrived;
+
+		static uint64_t TileKey(int tileX, int tileZ) { return ((uint64_t)(uint32_t)tileX << 32) | (uint32_t)tileZ; }
+
+		void WorkerLoop();
+		void Touch(ResidentTile& resident, uint64_t key);
+		void EvictToFit(size_t incomingBytes);
+	public:
+		TerrainPager() = default;
+		~TerrainPager() { Stop(); }
+		TerrainPager(const TerrainPager&) = delete;
+		TerrainPager& operator=(const TerrainPager&) = delete;
+
+		// Opens the tiled file, which must still match sourcePath if given, and starts the workers. Returns false on error.
+		bool Start(const std::string& filepath, const std::string& sourcePath, size_t memoryBudget, float loadRadius, int numWorkers = 2);
+
+		// Stops the workers and drops every tile
+		void Stop();
+
+		bool IsStarted() const { return !m_workers.empty(); }
+
+		// Call once per frame. Takes in finished tiles and requests the ones now wanted, nearest first.
+		void Update(const glm::vec3& cameraPos);
+
+		// Tiles taken in by the last Update, some may already have been evicted again
+		const std::vector<glm::ivec2>& ArrivedTiles() const { return m_arrived; }
+
+		// The tile if it is in memory, otherwise nullptr
+		const TerrainTile* FindTile(int tileX, int tileZ) const;
+
+		// Bilinear height at a world position, false if the tile is not in memory
+		bool GetHeight(float worldX, float worldZ, float& height) const;
+
+		const TiledHeightmapHeader& GetHeader() const { return m_source.GetHeader(); }
+		size_t TileSamplesPerSide() const { return m_source.TileSamplesPerSide(); }
+		size_t NumResidentTiles() const { return m_resident.size(); }
+		size_t ResidentBytes() const { return m_resident.size() * m_source.TileBytes(); }
+		size_t NumPendingTiles() const { return m_inFlight.size(); }
+	};
+}
@@ -0,0 +1,626 @@
+#include "TerrainQuadtree.h"
+#include "TerrainBuilder.h"
+#include "Parallel.h"
+
+#include <array>
+#include <cmath>
+
+namespace Helpers
+{
+	// Height of the terrain at grid vertex (x, z) when triangulated with cells spacing vertices wide
+	// Matches the diamond pattern used by TerrainBuilder, so this is exactly what a coarser patch draws
+	static float CoarseHeight(const std::vector<float>& heights, int numVertsZ, int gridCells, int spacing, int x, int z)
+	{
+		const int lastCell{ gridCells / spacing - 1 };
+		const int cellX{ std::min(x / spacing, lastCell) };
+		const int cellZ{ std::min(z / spacing, lastCell) };
+		const float u{ (x - cellX * spacing) / (float)spacing };
+		const float v{ (z - cellZ * spacing) / (float)spacing };
+
+		const size_t start{ (size_t)cellX * spacing * numVertsZ + (size_t)cellZ * spacing };
+		const size_t nextRow{ start + (size_t)spacing * numVertsZ };
+		const float h00{ heights[start] };
+		const float h01{ heights[start + spacing] };
+		const float h10{ heights[nextRow] };
+		const float h11{ heights[nextRow + spacing] };
+
+		if (((cellX + cellZ) & 1) == 0)
+		{
+			// Split along the 01 - 10 diagonal
+			if (u + v <= 1.0f)
+				return h00 + v * (h01 - h00) + u * (h10 - h00);
+			return h11 + (1.0f - v) * (h10 - h11) + (1.0f - u) * (h01 - h11);
+		}
+
+		// Split along the 00 - 11 diagonal
+		if (u >= v)
+			return h00 + u * (h10 - h00) + v * (h11 - h10);
+		return h00 + v * (h01 - h00) + u * (h11 - h01);
+	}
+
+	// Packs a unit vector into two snorm16s by projecting onto an octahedron and folding the lower half over
+	static void EncodeOctahedral(const glm::vec3& normal, int16_t encoded[2])
+	{
+		glm::vec2 p{ glm::vec2(normal.x, normal.y) / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z)) };
+		if (normal.z < 0)
+		{
+			const glm::vec2 sign{ p.x >= 0 ? 1.0f : -1.0f, p.y >= 0 ? 1.0f : -1.0f };
+			p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign;
+		}
+		encoded[0] = (int16_t)std::round(glm::clamp(p.x, -1.0f, 1.0f) * 32767.0f);
+		encoded[1] = (int16_t)std::round(glm::clamp(p.y, -1.0f, 1.0f) * 32767.0f);
+	}
+
+	// True if the triangles have the same vertices with the same winding
+	static bool SameTriangle(GLushort a, GLushort b, GLushort c, const std::array<GLushort, 3>& t)
+	{
+		return (a == t[0] && b == t[1] && c == t[2]) || (a == t[1] && b == t[2] && c == t[0]) || (a == t[2] && b == t[0] && c == t[1]);
+	}
+
+	// Appends triangles, each sharing an edge with the one before, as a single strip
+	// Where a triangle does not follow on naturally a vertex is repeated to swap the strip's edge, which only adds
+	// degenerate triangles. Starts after a restart index if the output already has elements.
+	static void AppendTriangleStrip(const std::vector<std::array<GLushort, 3>>& triangles, std::vector<GLushort>& strip)
+	{
+		if (triangles.empty())
+			return;
+
+		if (!strip.empty() && strip.back() != TerrainQuadtree::KPrimitiveRestartIndex)
+			strip.push_back(TerrainQuadtree::KPrimitiveRestartIndex);
+
+		strip.insert(strip.end(), triangles[0].begin(), triangles[0].end());
+		size_t runStart{ strip.size() - 3 };
+
+		for (size_t t = 1; t < triangles.size(); t++)
+		{
+			const std::array<GLushort, 3>& triangle{ triangles[t] };
+			const GLushort u{ strip[strip.size() - 2] };
+			const GLushort v{ strip[strip.size() - 1] };
+
+			// Checks whether appending these vertices draws this triangle and otherwise only degenerates
+			// Odd triangles in a strip have their first two vertices swapped to keep the winding
+			auto tryAppend = [&](std::initializer_list<GLushort> extra)
+			{
+				std::vector<GLushort> tail{ u, v };
+				tail.insert(tail.end(), extra);
+				size_t parity{ (strip.size() - runStart) & 1 };
+				bool drawn{ false };
+				for (size_t i = 2; i < tail.size(); i++, parity ^= 1)
+				{
+					const GLushort a{ parity ? tail[i - 1] : tail[i - 2] };
+					const GLushort b{ parity ? tail[i - 2] : tail[i - 1] };
+					const GLushort c{ tail[i] };
+					if (a == b || b == c || a == c)
+						continue;
+					if (drawn || !SameTriangle(a, b, c, triangle))
+						return false;
+					drawn = true;
+				}
+				if (drawn)
+					strip.insert(strip.end(), extra);
+				return drawn;
+			};
+
+			bool appended{ false };
+			for (GLushort w : triangle)
+			{
+				if ((appended = tryAppend({ w })))
+					break;
+			}
+
+			const GLushort swaps[5]{ u, v, triangle[0], triangle[1], triangle[2] };
+			for (size_t i = 0; i < 5 && !appended; i++)
+			{
+				for (GLushort w : triangle)
+				{
+					if ((appended = tryAppend({ swaps[i], w })))
+						break;
+				}
+			}
+
+			// Not connected after all, start a new strip
+			if (!appended)
+			{
+				strip.push_back(TerrainQuadtree::KPrimitiveRestartIndex);
+				strip.insert(strip.end(), triangle.begin(), triangle.end());
+				runStart = strip.size() - 3;
+			}
+		}
+	}
+
+	// Squared distance from a point to an axis aligned box
+	static float DistanceSquaredToBox(const glm::vec3& point, const glm::vec3& boxMin, const glm::vec3& boxMax)
+	{
+		const glm::vec3 closest{ glm::clamp(point, boxMin, boxMax) };
+		const glm::vec3 delta{ point - closest };
+		return glm::dot(delta, delta);
+	}
+
+	int TerrainQuadtree::CreateNode(int minX, int minZ, int size, int level)
+	{
+		const int index{ (int)m_nodes.size() };
+		m_nodes.emplace_back();
+		m_nodes[index].minX = minX;
+		m_nodes[index].minZ = minZ;
+		m_nodes[index].size = size;
+		m_nodes[index].level = level;
+		m_nodes[index].baseVertex = index * (m_patchCells + 1) * (m_patchCells + 1);
+
+		if (level > 0)
+		{
+			const int half{ size / 2 };
+			for (int q = 0; q < 4; q++)
+			{
+				const int child{ CreateNode(minX + (q >> 1) * half, minZ + (q & 1) * half, half, level - 1) };
+				m_nodes[index].children[q] = child;
+			}
+		}
+
+		return index;
+	}
+
+	// Builds the tree, bounds and error metrics from the builder's heights
+	bool TerrainQuadtree::Create(const TerrainBuilder& builder, int patchCells)
+	{
+		const int gridCells{ builder.NumCellsX() };
+		if (builder.NumCellsZ() != gridCells || patchCells < 2 || (patchCells & 1) || gridCells % patchCells != 0)
+		{
+			std::cout << "TerrainQuadtree: grid must be square and a multiple of an even patch size" << std::endl;
+			return false;
+		}
+
+		const int numPatches{ gridCells / patchCells };
+		if ((numPatches & (numPatches - 1)) != 0)
+		{
+			std::cout << "TerrainQuadtree: grid must be a power of two number of patches across" << std::endl;
+			return false;
+		}
+
+		// Baked vertices hold their grid position in 16 bits
+		if (gridCells > 65535)
+		{
+			std::cout << "TerrainQuadtree: grid is too large for 16 bit vertex positions" << std::endl;
+			return false;
+		}
+
+		m_patchCells = patchCells;
+		m_gridCells = gridCells;
+		m_cellSize = builder.CellSize();
+
+		int numLevels{ 1 };
+		while ((patchCells << (numLevels - 1)) < gridCells)
+			numLevels++;
+
+		const std::vector<float>& heights{ builder.GetHeights() };
+		const int numVertsZ{ builder.NumVertsZ() };
+
+		m_nodes.clear();
+		CreateNode(0, 0, gridCells, numLevels - 1);
+
+		// Leaf bounds come from the full resolution heights, parents are the union of their children
+		ParallelFor(m_nodes.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t n = begin; n < end; n++)
+			{
+				Node& node{ m_nodes[n] };
+				if (node.level != 0)
+					continue;
+
+				float minHeight{ heights[(size_t)node.minX * numVertsZ + node.minZ] };
+				float maxHeight{ minHeight };
+				for (int x = node.minX; x <= node.minX + node.size; x++)
+				{
+					for (int z = node.minZ; z <= node.minZ + node.size; z++)
+					{
+						const float h{ heights[(size_t)x * numVertsZ + z] };
+						minHeight = std::min(minHeight, h);
+						maxHeight = std::max(maxHeight, h);
+					}
+				}
+				node.minHeight = minHeight;
+				node.maxHeight = maxHeight;
+			}
+		});
+
+		for (size_t n = m_nodes.size(); n-- > 0;)
+		{
+			Node& node{ m_nodes[n] };
+			if (node.level == 0)
+				continue;
+
+			node.minHeight = m_nodes[node.children[0]].minHeight;
+			node.maxHeight = m_nodes[node.children[0]].maxHeight;
+			for (int q = 1; q < 4; q++)
+			{
+				node.minHeight = std::min(node.minHeight, m_nodes[node.children[q]].minHeight);
+				node.maxHeight = std::max(node.maxHeight, m_nodes[node.children[q]].maxHeight);
+			}
+		}
+
+		// A level's error is the previous level's error plus how far the vertices it drops are from its surface
+		m_levelErrors.assign(numLevels, 0.0f);
+		for (int level = 1; level < numLevels; level++)
+		{
+			const int spacing{ 1 << level };
+			const int finerSpacing{ spacing / 2 };
+			const int numRows{ gridCells / finerSpacing + 1 };
+
+			std::vector<float> rowErrors(numRows, 0.0f);
+			ParallelFor((size_t)numRows, [&](size_t begin, size_t end)
+			{
+				for (size_t row = begin; row < end; row++)
+				{
+					const int x{ (int)row * finerSpacing };
+					float worst{ 0 };
+					for (int z = 0; z <= gridCells; z += finerSpacing)
+					{
+						const float coarse{ CoarseHeight(heights, numVertsZ, gridCells, spacing, x, z) };
+						worst = std::max(worst, std::abs(heights[(size_t)x * numVertsZ + z] - coarse));
+					}
+					rowErrors[row] = worst;
+				}
+			});
+
+			float delta{ 0 };
+			for (float e : rowErrors)
+				delta = std::max(delta, e);
+			m_levelErrors[level] = m_levelErrors[level - 1] + delta;
+		}
+
+		// One patch's triangles in the diamond pattern, a strip per row of each quadrant
+		const int vertsPerSide{ patchCells + 1 };
+		const int half{ patchCells / 2 };
+		if (vertsPerSide * vertsPerSide >= KPrimitiveRestartIndex)
+		{
+			std::cout << "TerrainQuadtree: patch is too large for 16 bit indices" << std::endl;
+			return false;
+		}
+
+		std::vector<GLushort> patchStrips;
+		std::vector<std::array<GLushort, 3>> rowTriangles;
+		for (int q = 0; q < 4; q++)
+		{
+			m_quadrantFirst[q] = (GLuint)patchStrips.size();
+			for (int x = (q >> 1) * half; x < (q >> 1) * half + half; x++)
+			{
+				rowTriangles.clear();
+				for (int z = (q & 1) * half; z < (q & 1) * half + half; z++)
+				{
+					const GLushort startVertex{ (GLushort)(x * vertsPerSide + z) };
+					const GLushort nextRow{ (GLushort)(startVertex + vertsPerSide) };
+					if (((x + z) & 1) == 0)
+					{
+						rowTriangles.push_back({ startVertex, (GLushort)(startVertex + 1), nextRow });
+						rowTriangles.push_back({ (GLushort)(startVertex + 1), (GLushort)(nextRow + 1), nextRow });
+					}
+					else
+					{
+						rowTriangles.push_back({ startVertex, (GLushort)(nextRow + 1), nextRow });
+						rowTriangles.push_back({ (GLushort)(startVertex + 1), (GLushort)(nextRow + 1), startVertex });
+					}
+				}
+				AppendTriangleStrip(rowTriangles, patchStrips);
+			}
+
+			// Ends the quadrant so each can be drawn on its own
+			patchStrips.push_back(KPrimitiveRestartIndex);
+		}
+		m_quadrantFirst[4] = (GLuint)patchStrips.size();
+
+		// Variants with the odd vertices of coarser neighbouring edges folded onto their even neighbours
+		// Folding only creates degenerate triangles, so every variant has the same length and quadrant layout
+		m_patchElements.resize(patchStrips.size() * KNumStitchVariants);
+		for (unsigned int variant = 0; variant < KNumStitchVariants; variant++)
+		{
+			GLushort* elements{ &m_patchElements[variant * patchStrips.size()] };
+			for (size_t e = 0; e < patchStrips.size(); e++)
+			{
+				if (patchStrips[e] == KPrimitiveRestartIndex)
+				{
+					elements[e] = KPrimitiveRestartIndex;
+					continue;
+				}
+
+				int x{ patchStrips[e] / vertsPerSide };
+				int z{ patchStrips[e] % vertsPerSide };
+				if ((z & 1) && (((variant & KStitchMinX) && x == 0) || ((variant & KStitchMaxX) && x == patchCells)))
+					z--;
+				if ((x & 1) && (((variant & KStitchMinZ) && z == 0) || ((variant & KStitchMaxZ) && z == patchCells)))
+					x--;
+				elements[e] = (GLushort)(x * vertsPerSide + z);
+			}
+		}
+
+		return true;
+	}
+
+	// Refreshes bounds over an edited block and grows the level errors to cover it
+	void TerrainQuadtree::UpdateHeights(const std::vector<float>& heights, int minX, int minZ, int maxX, int maxZ)
+	{
+		minX = std::max(minX, 0);
+		minZ = std::max(minZ, 0);
+		maxX = std::min(maxX, m_gridCells);
+		maxZ = std::min(maxZ, m_gridCells);
+		if (m_nodes.empty() || minX > maxX || minZ > maxZ)
+			return;
+
+		const int numVertsZ{ m_gridCells + 1 };
+
+		// Children come after their parents, so going backwards refreshes them first
+		for (size_t n = m_nodes.size(); n-- > 0;)
+		{
+			Node& node{ m_nodes[n] };
+			if (node.minX > maxX || node.minX + node.size < minX || node.minZ > maxZ || node.minZ + node.size < minZ)
+				continue;
+
+			if (node.level == 0)
+			{
+				node.minHeight = node.maxHeight = heights[(size_t)node.minX * numVertsZ + node.minZ];
+				for (int x = node.minX; x <= node.minX + node.size; x++)
+				{
+					for (int z = node.minZ; z <= node.minZ + node.size; z++)
+					{
+						const float h{ heights[(size_t)x * numVertsZ + z] };
+						node.minHeight = std::min(node.minHeight, h);
+						node.maxHeight = std::max(node.maxHeight, h);
+					}
+				}
+				continue;
+			}
+
+			node.minHeight = m_nodes[node.children[0]].minHeight;
+			node.maxHeight = m_nodes[node.children[0]].maxHeight;
+			for (int q = 1; q < 4; q++)
+			{
+				node.minHeight = std::min(node.minHeight, m_nodes[node.children[q]].minHeight);
+				node.maxHeight = std::max(node.maxHeight, m_nodes[node.children[q]].maxHeight);
+			}
+		}
+
+		// Same measure as Create, over the coarse cells with an edited vertex on or inside them
+		float previousError{ 0 };
+		for (int level = 1; level < NumLevels(); level++)
+		{
+			const int spacing{ 1 << level };
+			const int finerSpacing{ spacing / 2 };
+			const int lastCell{ m_gridCells / spacing - 1 };
+			const int startX{ std::max(minX - 1, 0) / spacing * spacing };
+			const int startZ{ std::max(minZ - 1, 0) / spacing * spacing };
+			const int endX{ (std::min(maxX / spacing, lastCell) + 1) * spacing };
+			const int endZ{ (std::min(maxZ / spacing, lastCell) + 1) * spacing };
+
+			float delta{ m_levelErrors[level] - previousError };
+			for (int x = startX; x <= endX; x += finerSpacing)
+			{
+				for (int z = startZ; z <= endZ; z += finerSpacing)
+				{
+					const float coarse{ CoarseHeight(heights, numVertsZ, m_gridCells, spacing, x, z) };
+					delta = std::max(delta, std::abs(heights[(size_t)x * numVertsZ + z] - coarse));
+				}
+			}
+			previousError = m_levelErrors[level];
+			m_levelErrors[level] = m_levelErrors[level - 1] + delta;
+		}
+	}
+
+	// Bakes every node's patch, each vertex also storing its height on the next coarser level
+	void TerrainQuadtree::BakeVertices(const TerrainBuilder& builder, const std::vector<glm::vec3>& normals)
+	{
+		const std::vector<float>& heights{ builder.GetHeights() };
+		const int numVertsZ{ builder.NumVertsZ() };
+		const int gridCells{ m_gridCells };
+		const int patchCells{ m_patchCells };
+		const int numLevels{ NumLevels() };
+
+		// Coarse heights are blends of grid heights so they quantise over the same range
+		std::vector<uint16_t> quantised;
+		builder.GetQuantisedHeights(quantised, m_heightOffset, m_heightRange);
+		const float quantiseScale{ 65535.0f / m_heightRange };
+
+		const int vertsPerSide{ patchCells + 1 };
+		m_vertices.resize(m_nodes.size() * vertsPerSide * vertsPerSide);
+		ParallelFor(m_nodes.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t n = begin; n < end; n++)
+			{
+				const Node& node{ m_nodes[n] };
+				const int spacing{ 1 << node.level };
+				const bool isRoot{ node.level == numLevels - 1 };
+
+				TerrainPatchVertex* vertex{ &m_vertices[node.baseVertex] };
+				for (int i = 0; i < vertsPerSide; i++)
+				{
+					const int x{ node.minX + i * spacing };
+					for (int j = 0; j < vertsPerSide; j++)
+					{
+						const int z{ node.minZ + j * spacing };
+						const size_t gridIndex{ (size_t)x * numVertsZ + z };
+
+						vertex->gridX = (uint16_t)x;
+						vertex->gridZ = (uint16_t)z;
+						vertex->height = quantised[gridIndex];
+						vertex->morphHeight = isRoot ? quantised[gridIndex] : (uint16_t)glm::clamp(
+							(CoarseHeight(heights, numVertsZ, gridCells, spacing * 2, x, z) - m_heightOffset) * quantiseScale + 0.5f, 0.0f, 65535.0f);
+						EncodeOctahedral(normals[gridIndex], vertex->normal);
+						vertex++;
+					}
+				}
+			}
+		}, 4);
+	}
+
+	// Distance at which each level hands over to the next coarser one
+	void TerrainQuadtree::ComputeLodRanges(float pixelError, float viewportHeight, float fovY, std::vector<float>& ranges) const
+	{
+		// Converts a world space error at distance 1 into pixels
+		const float pixelsPerUnit{ viewportHeight / (2.0f * std::tan(fovY * 0.5f)) };
+		const float leafSize{ m_patchCells * m_cellSize };
+
+		ranges.resize(m_levelErrors.size());
+		for (size_t level = 0; level < ranges.size(); level++)
+		{
+			// Never hand over before the next level's error is below the pixel threshold
+			float range{ 0 };
+			if (level + 1 < m_levelErrors.size())
+				range = m_levelErrors[level + 1] * pixelsPerUnit / std::max(pixelError, 0.01f);
+
+			// Each range must at least double so neighbouring nodes are never more than one level apart
+			const float minRange{ level == 0 ? leafSize * 2.0f : ranges[level - 1] * 2.0f };
+			ranges[level] = std::max(range, minRange);
+		}
+	}
+
+	// World space bounds of a node, or of one of its quadrants if quadrant is 0 to 3
+	void TerrainQuadtree::NodeBounds(const Node& node, int quadrant, glm::vec3& boxMin, glm::vec3& boxMax) const
+	{
+		int minX{ node.minX };
+		int minZ{ node.minZ };
+		int size{ node.size };
+		if (quadrant >= 0)
+		{
+			size /= 2;
+			minX += (quadrant >> 1) * size;
+			minZ += (quadrant & 1) * size;
+		}
+		boxMin = glm::vec3(minX * m_cellSize, node.minHeight, minZ * m_cellSize);
+		boxMax = glm::vec3((minX + size) * m_cellSize, node.maxHeight, (minZ + size) * m_cellSize);
+	}
+
+	// Quadrants of the node that are in view, all of them without a frustum
+	unsigned int TerrainQuadtree::VisibleQuadrants(const Node& node, unsigned int quadrantMask, const Frustum* frustum) const
+	{
+		if (!frustum)
+			return quadrantMask;
+
+		for (int q = 0; q < 4; q++)
+		{
+			glm::vec3 boxMin, boxMax;
+			NodeBounds(node, q, boxMin, boxMax);
+			if ((quadrantMask & (1u << q)) && frustum->ClassifyBox(boxMin, boxMax) == Frustum::Result::Outside)
+				quadrantMask &= ~(1u << q);
+		}
+		return quadrantMask;
+	}
+
+	bool TerrainQuadtree::SelectNode(int nodeIndex, const glm::vec3& cameraPos, const std::vector<float>& ranges,
+		const Frustum* frustum, std::vector<TerrainSelection>& selection) const
+	{
+		const Node& node{ m_nodes[nodeIndex] };
+		glm::vec3 boxMin, boxMax;
+		NodeBounds(node, -1, boxMin, boxMax);
+		const float distanceSquared{ DistanceSquaredToBox(cameraPos, boxMin, boxMax) };
+
+		// Out of this level's range so the parent covers the area
+		if (distanceSquared > ranges[node.level] * ranges[node.level])
+			return false;
+
+		// Covered, by nothing, when out of view. Once a node is wholly in view its children must be too.
+		if (frustum)
+		{
+			const Frustum::Result visibility{ frustum->ClassifyBox(boxMin, boxMax) };
+			if (visibility == Frustum::Result::Outside)
+				return true;
+			if (visibility == Frustum::Result::Inside)
+				frustum = nullptr;
+		}
+
+		// Most detailed level, or nothing in here needs more detail
+		if (node.level == 0 || distanceSquared > ranges[node.level - 1] * ranges[node.level - 1])
+		{
+			const unsigned int quadrantMask{ VisibleQuadrants(node, 0xF, frustum) };
+			if (quadrantMask)
+				selection.push_back(TerrainSelection{ (unsigned int)nodeIndex, (unsigned int)node.level, quadrantMask });
+			return true;
+		}
+
+		// Children that are out of their range are drawn as a quadrant of this node instead
+		unsigned int quadrantMask{ 0 };
+		for (int q = 0; q < 4; q++)
+		{
+			if (!SelectNode(node.children[q], cameraPos, ranges, frustum, selection))
+				quadrantMask |= 1u << q;
+		}
+
+		quadrantMask = VisibleQuadrants(node, quadrantMask, frustum);
+		if (quadrantMask)
+			selection.push_back(TerrainSelection{ (unsigned int)nodeIndex, (unsigned int)node.level, quadrantMask });
+
+		return true;
+	}
+
+	// Picks which nodes, and which quadrants of them, to draw for this camera position
+	void TerrainQuadtree::Select(const glm::vec3& cameraPos, const std::vector<float>& ranges, std::vector<TerrainSelection>& selection,
+		const Frustum* frustum) const
+	{
+		selection.clear();
+		if (m_nodes.empty())
+			return;
+
+		// The root is drawn whole however far away the camera is, less any quadrants out of view
+		if (!SelectNode(0, cameraPos, ranges, frustum, selection))
+		{
+			const unsigned int quadrantMask{ VisibleQuadrants(m_nodes[0], 0xF, frustum) };
+			if (quadrantMask)
+				selection.push_back(TerrainSelection{ 0, (unsigned int)m_nodes[0].level, quadrantMask });
+		}
+
+		// Level drawn over each square of the smallest quadrant size, so edges next to coarser levels can be stitched
+		const int unitCells{ m_patchCells / 2 };
+		const int unitsPerSide{ m_gridCells / unitCells };
+		std::vector<int> unitLevels((size_t)unitsPerSide * unitsPerSide, -1);
+		for (const TerrainSelection& selected : selection)
+		{
+			const Node& node{ m_nodes[selected.node] };
+			const int quadrantUnits{ node.size / 2 / unitCells };
+			for (int q = 0; q < 4; q++)
+			{
+				if (!(selected.quadrantMask & (1u << q)))
+					continue;
+				const int unitX{ node.minX / unitCells + (q >> 1) * quadrantUnits };
+				const int unitZ{ node.minZ / unitCells + (q & 1) * quadrantUnits };
+				for (int x = unitX; x < unitX + quadrantUnits; x++)
+					std::fill_n(&unitLevels[(size_t)x * unitsPerSide + unitZ], quadrantUnits, node.level);
+			}
+		}
+
+		auto coarserAt = [&](int x, int z, int level)
+		{
+			return x >= 0 && z >= 0 && x < unitsPerSide && z < unitsPerSide && unitLevels[(size_t)x * unitsPerSide + z] > level;
+		};
+
+		for (TerrainSelection& selected : selection)
+		{
+			const Node& node{ m_nodes[selected.node] };
+			const int quadrantUnits{ node.size / 2 / unitCells };
+			for (int q = 0; q < 4; q++)
+			{
+				selected.stitchMasks[q] = 0;
+				if (!(selected.quadrantMask & (1u << q)))
+					continue;
+
+				// Only the quadrant's sides on the patch's outer edge can be stitched
+				const int unitX{ node.minX / unitCells + (q >> 1) * quadrantUnits };
+				const int unitZ{ node.minZ / unitCells + (q & 1) * quadrantUnits };
+				for (int i = 0; i < quadrantUnits; i++)
+				{
+					if ((q >> 1) == 0 && coarserAt(unitX - 1, unitZ + i, node.level))
+						selected.stitchMasks[q] |= KStitchMinX;
+					if ((q >> 1) == 1 && coarserAt(unitX + quadrantUnits, unitZ + i, node.level))
+						selected.stitchMasks[q] |= KStitchMaxX;
+					if ((q & 1) == 0 && coarserAt(unitX + i, unitZ - 1, node.level))
+						selected.stitchMasks[q] |= KStitchMinZ;
+					if ((q & 1) == 1 && coarserAt(unitX + i, unitZ + quadrantUnits, node.level))
+						selected.stitchMasks[q] |= KStitchMaxZ;
+				}
+			}
+		}
+	}
+
+	// Distance range over which a level morphs towards the next, for the shader
+	glm::vec2 TerrainQuadtree::MorphRange(const std::vector<float>& ranges, int level)
+	{
+		const float previous{ level > 0 ? ranges[level - 1] : 0.0f };
+		const float end{ ranges[level] };
+		return glm::vec2(previous + (end - previous) * KMorphStartRatio, end);
+	}
+}
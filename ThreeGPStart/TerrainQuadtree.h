@@ -0,0 +1,147 @@
+#pragma once
+// Chunked quadtree level of detail for the terrain, CDLOD style
+
+#include "ExternalLibraryHeaders.h"
+#include "Frustum.h"
+
+#include <cstdint>
+
+namespace Helpers
+{
+	class TerrainBuilder;
+
+	// Vertex of a baked quadtree patch, 12 bytes
+	// Position is the grid vertex, heights are quantised over the terrain's height range and the normal is octahedral
+	// encoded. morphHeight is where this vertex sits on the next coarser level, the shader blends towards it to hide seams.
+	struct TerrainPatchVertex
+	{
+		uint16_t gridX;
+		uint16_t gridZ;
+		uint16_t height;
+		uint16_t morphHeight;
+		int16_t normal[2];
+	};
+	static_assert(sizeof(TerrainPatchVertex) == 12, "TerrainPatchVertex should pack to 12 bytes");
+
+	// A node picked for drawing this frame. quadrantMask has bit q set for each quadrant of the patch to draw.
+	// stitchMasks[q] is the stitch variant quadrant q should be drawn with, see TerrainQuadtree::KStitchMinX
+	struct TerrainSelection
+	{
+		unsigned int node;
+		unsigned int level;
+		unsigned int quadrantMask;
+		unsigned int stitchMasks[4]{ 0, 0, 0, 0 };
+	};
+
+	// Splits the terrain grid into a quadtree of square patches. Every node, whatever its level, is drawn with the
+	// same patchCells x patchCells grid, so coarser levels cover more ground with the same triangle count.
+	class TerrainQuadtree
+	{
+	public:
+		// Ratio of a level's range at which its vertices start morphing towards the next level
+		static constexpr float KMorphStartRatio{ 0.66f };
+
+		// Patch elements are 16 bit triangle strips, rows separated by this index
+		static constexpr GLushort KPrimitiveRestartIndex{ 0xFFFF };
+
+		// Edges of a patch next to a coarser level, each combination has its own precomputed stitched elements
+		static constexpr unsigned int KStitchMinX{ 1 };
+		static constexpr unsigned int KStitchMaxX{ 2 };
+		static constexpr unsigned int KStitchMinZ{ 4 };
+		static constexpr unsigned int KStitchMaxZ{ 8 };
+		static constexpr unsigned int KNumStitchVariants{ 16 };
+
+		struct Node
+		{
+			// Area covered in terrain grid cells
+			int minX{ 0 };
+			int minZ{ 0 };
+			int size{ 0 };
+
+			// 0 is the most detailed level
+			int level{ 0 };
+
+			float minHeight{ 0 };
+			float maxHeight{ 0 };
+
+			// Child node indices, -1 for leaves. Quadrant q covers x half (q >> 1) and z half (q & 1)
+			int children[4]{ -1, -1, -1, -1 };
+
+			// First vertex of this node's patch in the baked vertex array
+			GLint baseVertex{ 0 };
+		};
+	private:
+		int m_patchCells{ 0 };
+		int m_gridCells{ 0 };
+		float m_cellSize{ 1.0f };
+
+		// Parent before child, root is node 0
+		std::vector<Node> m_nodes;
+
+		// Worst height error of each level against the full resolution grid
+		std::vector<float> m_levelErrors;
+
+		std::vector<TerrainPatchVertex> m_vertices;
+		float m_heightOffset{ 0 };
+		float m_heightRange{ 1.0f };
+		std::vector<GLushort> m_patchElements;
+
+		// Where each quadrant starts within a variant, [4] is the length of a whole variant
+		GLuint m_quadrantFirst[5]{ 0, 0, 0, 0, 0 };
+
+		int CreateNode(int minX, int minZ, int size, int level);
+		void NodeBounds(const Node& node, int quadrant, glm::vec3& boxMin, glm::vec3& boxMax) const;
+		unsigned int VisibleQuadrants(const Node& node, unsigned int quadrantMask, const Frustum* frustum) const;
+		bool SelectNode(int nodeIndex, const glm::vec3& cameraPos, const std::vector<float>& ranges,
+			const Frustum* frustum, std::vector<TerrainSelection>& selection) const;
+	public:
+		// Builds the tree, bounds and error metrics from the builder's heights
+		// The grid must be square with a power of two multiple of patchCells cells along each side
+		bool Create(const TerrainBuilder& builder, int patchCells);
+
+		// Refreshes the nodes' height bounds and the level errors after the grid vertices from (minX, minZ) to
+		// (maxX, maxZ) inclusive have changed. heights is the whole grid, laid out as TerrainBuilder::GetHeights.
+		// Level errors only ever grow here, so an edit that smooths the terrain keeps the old, more cautious ranges.
+		void UpdateHeights(const std::vector<float>& heights, int minX, int minZ, int maxX, int maxZ);
+
+		// Bakes every node's patch on the CPU, only needed when the heights are not displaced on the GPU
+		void BakeVertices(const TerrainBuilder& builder, const std::vector<glm::vec3>& normals);
+
+		int NumLevels() const { return (int)m_levelErrors.size(); }
+		int PatchCells() const { return m_patchCells; }
+		int GridCells() const { return m_gridCells; }
+		float CellSize() const { return m_cellSize; }
+		float WorldSize() const { return m_gridCells * m_cellSize; }
+
+		const std::vector<Node>& GetNodes() const { return m_nodes; }
+
+		// All baked patches, node n starts at GetNodes()[n].baseVertex. Empty until BakeVertices is called.
+		const std::vector<TerrainPatchVertex>& GetVertices() const { return m_vertices; }
+
+		// A baked height h decodes to HeightOffset() + h / 65535 * HeightRange()
+		float HeightOffset() const { return m_heightOffset; }
+		float HeightRange() const { return m_heightRange; }
+
+		// Triangle strips of one patch laid out a quadrant at a time, then repeated for each stitch variant
+		const std::vector<GLushort>& GetPatchElements() const { return m_patchElements; }
+
+		// First element of quadrant q in the given stitch variant, and how many elements it has
+		// Quadrant 0 with four quadrants' worth of elements draws the whole patch
+		GLuint QuadrantFirst(unsigned int variant, int q) const { return variant * m_quadrantFirst[4] + m_quadrantFirst[q]; }
+		GLuint QuadrantCount(int q) const { return m_quadrantFirst[q + 1] - m_quadrantFirst[q]; }
+		GLuint VariantCount() const { return m_quadrantFirst[4]; }
+
+		// Distance at which each level hands over to the next coarser one
+		// Chosen so no level is used closer than its height error projects to more than pixelError pixels
+		void ComputeLodRanges(float pixelError, float viewportHeight, float fovY, std::vector<float>& ranges) const;
+
+		// Picks which nodes, and which quadrants of them, to draw for this camera position
+		// Nodes and quadrants whose min max height box is outside the frustum, if given, are left out
+		// Also works out which quadrant edges border a coarser level and need stitching
+		void Select(const glm::vec3& cameraPos, const std::vector<float>& ranges, std::vector<TerrainSelection>& selection,
+			const Frustum* frustum = nullptr) const;
+
+		// Distance range over which a level morphs towards the next, for the shader
+		static glm::vec2 MorphRange(const std::vector<float>& ranges, int level);
+	};
+}
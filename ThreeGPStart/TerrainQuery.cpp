@@ -0,0 +1,344 @@
+#include "TerrainQuery.h"
+#include "TerrainBuilder.h"
+#include "Parallel.h"
+
+#include <cmath>
+
+namespace Helpers
+{
+	// Batches smaller than this are not worth a thread of their own
+	static constexpr size_t KMinPointsPerThread{ 1024 };
+
+	// Blocks are padded vertically by this so flat blocks are not missed to rounding
+	static constexpr float KBlockHeightPadding{ 1e-3f };
+
+	// Entry and exit distances of a ray through an axis aligned box, false if it misses
+	// A ray parallel to an axis never crosses that axis' slab, so only has to start inside it
+	static bool RayBox(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& invDirection, const glm::vec3& boxMin,
+		const glm::vec3& boxMax, float& tEnter, float& tExit)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (std::abs(direction[axis]) < 1e-20f)
+			{
+				if (origin[axis] < boxMin[axis] || origin[axis] > boxMax[axis])
+					return false;
+				continue;
+			}
+
+			const float t0{ (boxMin[axis] - origin[axis]) * invDirection[axis] };
+			const float t1{ (boxMax[axis] - origin[axis]) * invDirection[axis] };
+			tEnter = std::max(tEnter, std::min(t0, t1));
+			tExit = std::min(tExit, std::max(t0, t1));
+		}
+		return tEnter <= tExit;
+	}
+
+	// Copies the heights and builds the min max pyramid
+	void TerrainQuery::Create(const TerrainBuilder& builder)
+	{
+		m_numCellsX = builder.NumCellsX();
+		m_numCellsZ = builder.NumCellsZ();
+		m_cellSize = builder.CellSize();
+		m_heights = builder.GetHeights();
+
+		m_pyramid.clear();
+		m_pyramid.emplace_back();
+		HeightPyramidLevel& cells{ m_pyramid.back() };
+		cells.width = m_numCellsX;
+		cells.depth = m_numCellsZ;
+		cells.minMax.resize((size_t)m_numCellsX * m_numCellsZ);
+		ParallelFor((size_t)m_numCellsX, [&](size_t begin, size_t end)
+		{
+			for (int x = (int)begin; x < (int)end; x++)
+			{
+				for (int z = 0; z < m_numCellsZ; z++)
+				{
+					const float h00{ Height(x, z) }, h01{ Height(x, z + 1) }, h10{ Height(x + 1, z) }, h11{ Height(x + 1, z + 1) };
+					cells.minMax[(size_t)x * m_numCellsZ + z] = glm::vec2(std::min(std::min(h00, h01), std::min(h10, h11)),
+						std::max(std::max(h00, h01), std::max(h10, h11)));
+				}
+			}
+		}, 16);
+
+		// Halve until one block covers everything, odd sizes round up
+		while (m_pyramid.back().width > 1 || m_pyramid.back().depth > 1)
+		{
+			const HeightPyramidLevel& finer{ m_pyramid.back() };
+			HeightPyramidLevel coarser;
+			coarser.width = (finer.width + 1) / 2;
+			coarser.depth = (finer.depth + 1) / 2;
+			coarser.minMax.resize((size_t)coarser.width * coarser.depth);
+			for (int x = 0; x < coarser.width; x++)
+			{
+				for (int z = 0; z < coarser.depth; z++)
+				{
+					glm::vec2 bounds{ std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+					for (int child = 0; child < 4; child++)
+					{
+						const int childX{ x * 2 + (child >> 1) };
+						const int childZ{ z * 2 + (child & 1) };
+						if (childX >= finer.width || childZ >= finer.depth)
+							continue;
+						const glm::vec2& childBounds{ finer.minMax[(size_t)childX * finer.depth + childZ] };
+						bounds = glm::vec2(std::min(bounds.x, childBounds.x), std::max(bounds.y, childBounds.y));
+					}
+					coarser.minMax[(size_t)x * coarser.depth + z] = bounds;
+				}
+			}
+			m_pyramid.push_back(std::move(coarser));
+		}
+	}
+
+	// Replaces a block of heights and refreshes the pyramid blocks over it
+	void TerrainQuery::SetHeights(int x, int z, int width, int depth, const float* heights)
+	{
+		const int minX{ std::max(x, 0) }, maxX{ std::min(x + width, m_numCellsX + 1) };
+		const int minZ{ std::max(z, 0) }, maxZ{ std::min(z + depth, m_numCellsZ + 1) };
+		if (m_heights.empty() || minX >= maxX || minZ >= maxZ)
+			return;
+
+		for (int gx = minX; gx < maxX; gx++)
+		{
+			for (int gz = minZ; gz < maxZ; gz++)
+				m_heights[(size_t)gx * (m_numCellsZ + 1) + gz] = heights[(size_t)(gx - x) * depth + (gz - z)];
+		}
+
+		// Cells touching an edited vertex, then the blocks above them a level at a time
+		int cellMinX{ std::max(minX - 1, 0) }, cellMaxX{ std::min(maxX, m_numCellsX) };
+		int cellMinZ{ std::max(minZ - 1, 0) }, cellMaxZ{ std::min(maxZ, m_numCellsZ) };
+		HeightPyramidLevel& cells{ m_pyramid[0] };
+		for (int cx = cellMinX; cx < cellMaxX; cx++)
+		{
+			for (int cz = cellMinZ; cz < cellMaxZ; cz++)
+			{
+				const float h00{ Height(cx, cz) }, h01{ Height(cx, cz + 1) }, h10{ Height(cx + 1, cz) }, h11{ Height(cx + 1, cz + 1) };
+				cells.minMax[(size_t)cx * m_numCellsZ + cz] = glm::vec2(std::min(std::min(h00, h01), std::min(h10, h11)),
+					std::max(std::max(h00, h01), std::max(h10, h11)));
+			}
+		}
+
+		for (size_t level = 1; level < m_pyramid.size(); level++)
+		{
+			const HeightPyramidLevel& finer{ m_pyramid[level - 1] };
+			HeightPyramidLevel& coarser{ m_pyramid[level] };
+			cellMinX /= 2;
+			cellMinZ /= 2;
+			cellMaxX = (cellMaxX + 1) / 2;
+			cellMaxZ = (cellMaxZ + 1) / 2;
+			for (int cx = cellMinX; cx < cellMaxX; cx++)
+			{
+				for (int cz = cellMinZ; cz < cellMaxZ; cz++)
+				{
+					glm::vec2 bounds{ std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+					for (int child = 0; child < 4; child++)
+					{
+						const int childX{ cx * 2 + (child >> 1) };
+						const int childZ{ cz * 2 + (child & 1) };
+						if (childX >= finer.width || childZ >= finer.depth)
+							continue;
+						const glm::vec2& childBounds{ finer.minMax[(size_t)childX * finer.depth + childZ] };
+						bounds = glm::vec2(std::min(bounds.x, childBounds.x), std::max(bounds.y, childBounds.y));
+					}
+					coarser.minMax[(size_t)cx * coarser.depth + cz] = bounds;
+				}
+			}
+		}
+	}
+
+	// Bilinearly interpolated height at world (x, z)
+	float TerrainQuery::GetHeight(float x, float z) const
+	{
+		if (m_heights.empty())
+			return 0;
+
+		const float gridX{ glm::clamp(x / m_cellSize, 0.0f, (float)m_numCellsX) };
+		const float gridZ{ glm::clamp(z / m_cellSize, 0.0f, (float)m_numCellsZ) };
+		const int cellX{ std::min((int)gridX, m_numCellsX - 1) };
+		const int cellZ{ std::min((int)gridZ, m_numCellsZ - 1) };
+		const float u{ gridX - cellX };
+		const float v{ gridZ - cellZ };
+
+		const float h0{ glm::mix(Height(cellX, cellZ), Height(cellX, cellZ + 1), v) };
+		const float h1{ glm::mix(Height(cellX + 1, cellZ), Height(cellX + 1, cellZ + 1), v) };
+		return glm::mix(h0, h1, u);
+	}
+
+	// Unit normal of the bilinear surface at world (x, z)
+	glm::vec3 TerrainQuery::GetNormal(float x, float z) const
+	{
+		if (m_heights.empty())
+			return glm::vec3(0, 1, 0);
+
+		const float gridX{ glm::clamp(x / m_cellSize, 0.0f, (float)m_numCellsX) };
+		const float gridZ{ glm::clamp(z / m_cellSize, 0.0f, (float)m_numCellsZ) };
+		const int cellX{ std::min((int)gridX, m_numCellsX - 1) };
+		const int cellZ{ std::min((int)gridZ, m_numCellsZ - 1) };
+		const float u{ gridX - cellX };
+		const float v{ gridZ - cellZ };
+
+		const float h00{ Height(cellX, cellZ) }, h01{ Height(cellX, cellZ + 1) };
+		const float h10{ Height(cellX + 1, cellZ) }, h11{ Height(cellX + 1, cellZ + 1) };
+		const float dhdx{ glm::mix(h10 - h00, h11 - h01, v) / m_cellSize };
+		const float dhdz{ glm::mix(h01 - h00, h11 - h10, u) / m_cellSize };
+		return glm::normalize(glm::vec3(-dhdx, 1.0f, -dhdz));
+	}
+
+	void TerrainQuery::GetHeights(const glm::vec2* points, size_t count, float* heights) const
+	{
+		ParallelFor(count, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				heights[i] = GetHeight(points[i].x, points[i].y);
+		}, KMinPointsPerThread);
+	}
+
+	void TerrainQuery::GetNormals(const glm::vec2* points, size_t count, glm::vec3* normals) const
+	{
+		ParallelFor(count, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				normals[i] = GetNormal(points[i].x, points[i].y);
+		}, KMinPointsPerThread);
+	}
+
+	// Solves for where the ray's height meets the cell's bilinear height, which is a quadratic in t
+	bool TerrainQuery::RaycastCell(int cellX, int cellZ, const glm::vec3& origin, const glm::vec3& direction,
+		float tEnter, float tExit, float& hitDistance) const
+	{
+		const float h00{ Height(cellX, cellZ) }, h01{ Height(cellX, cellZ + 1) };
+		const float h10{ Height(cellX + 1, cellZ) }, h11{ Height(cellX + 1, cellZ + 1) };
+
+		// h(u, v) = a + b u + c v + d u v with u and v linear in t
+		const float a{ h00 }, b{ h10 - h00 }, c{ h01 - h00 }, d{ h00 - h10 - h01 + h11 };
+		const float u0{ origin.x / m_cellSize - cellX }, du{ direction.x / m_cellSize };
+		const float v0{ origin.z / m_cellSize - cellZ }, dv{ direction.z / m_cellSize };
+
+		// Ray height minus surface height, A t^2 + B t + C
+		const float A{ -d * du * dv };
+		const float B{ direction.y - b * du - c * dv - d * (u0 * dv + v0 * du) };
+		const float C{ origin.y - a - b * u0 - c * v0 - d * u0 * v0 };
+
+		// Already under the surface where the ray comes in, which only happens through the terrain's sides
+		if ((A * tEnter + B) * tEnter + C <= 0)
+		{
+			hitDistance = tEnter;
+			return true;
+		}
+
+		float roots[2];
+		int numRoots{ 0 };
+		if (std::abs(A) < 1e-9f)
+		{
+			if (std::abs(B) > 1e-12f)
+				roots[numRoots++] = -C / B;
+		}
+		else
+		{
+			const float discriminant{ B * B - 4 * A * C };
+			if (discriminant < 0)
+				return false;
+			const float root{ std::sqrt(discriminant) };
+			roots[0] = (-B - root) / (2 * A);
+			roots[1] = (-B + root) / (2 * A);
+			if (roots[0] > roots[1])
+				std::swap(roots[0], roots[1]);
+			numRoots = 2;
+		}
+
+		for (int i = 0; i < numRoots; i++)
+		{
+			if (roots[i] >= tEnter && roots[i] <= tExit)
+			{
+				hitDistance = roots[i];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Walks the height pyramid front to back, only descending into blocks the ray passes below the top of
+	bool TerrainQuery::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& hitDistance) const
+	{
+		if (m_heights.empty() || direction == glm::vec3(0))
+			return false;
+
+		// Starting under the ground is an immediate hit
+		const glm::vec2 terrainMax{ m_numCellsX * m_cellSize, m_numCellsZ * m_cellSize };
+		if (origin.x >= 0 && origin.z >= 0 && origin.x <= terrainMax.x && origin.z <= terrainMax.y && origin.y <= GetHeight(origin.x, origin.z))
+		{
+			hitDistance = 0;
+			return true;
+		}
+
+		// Axes the ray does not move along are left at zero, RayBox skips them
+		glm::vec3 invDirection{ 0 };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (std::abs(direction[axis]) >= 1e-20f)
+				invDirection[axis] = 1.0f / direction[axis];
+		}
+
+		struct Block
+		{
+			int level;
+			int x;
+			int z;
+			float tEnter;
+			float tExit;
+		};
+
+		// The terrain is solid underneath, so every block reaches down to the lowest point to catch rays through the sides
+		const float floorHeight{ m_pyramid.back().minMax[0].x - KBlockHeightPadding };
+
+		// Block size in cells is 1 << level, the top level is a single block
+		auto blockBounds = [&](const Block& block, float& tEnter, float& tExit)
+		{
+			const HeightPyramidLevel& level{ m_pyramid[block.level] };
+			const glm::vec2& heights{ level.minMax[(size_t)block.x * level.depth + block.z] };
+			const float blockSize{ (float)(1 << block.level) * m_cellSize };
+			const glm::vec3 boxMin{ block.x * blockSize, floorHeight, block.z * blockSize };
+			const glm::vec3 boxMax{ std::min((block.x + 1) * blockSize, terrainMax.x), heights.y + KBlockHeightPadding,
+				std::min((block.z + 1) * blockSize, terrainMax.y) };
+			tEnter = 0;
+			tExit = maxDistance;
+			return RayBox(origin, direction, invDirection, boxMin, boxMax, tEnter, tExit);
+		};
+
+		std::vector<Block> stack;
+		Block root{ (int)m_pyramid.size() - 1, 0, 0, 0, 0 };
+		if (!blockBounds(root, root.tEnter, root.tExit))
+			return false;
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			const Block block{ stack.back() };
+			stack.pop_back();
+
+			if (block.level == 0)
+			{
+				if (RaycastCell(block.x, block.z, origin, direction, block.tEnter, block.tExit, hitDistance))
+					return true;
+				continue;
+			}
+
+			// Push the children the ray enters, furthest first so the nearest is popped next
+			Block children[4];
+			int numChildren{ 0 };
+			const HeightPyramidLevel& finer{ m_pyramid[block.level - 1] };
+			for (int child = 0; child < 4; child++)
+			{
+				Block candidate{ block.level - 1, block.x * 2 + (child >> 1), block.z * 2 + (child & 1), 0, 0 };
+				if (candidate.x >= finer.width || candidate.z >= finer.depth)
+					continue;
+				if (blockBounds(candidate, candidate.tEnter, candidate.tExit))
+					children[numChildren++] = candidate;
+			}
+			std::sort(children, children + numChildren, [](const Block& a, const Block& b) { return a.tEnter > b.tEnter; });
+			stack.insert(stack.end(), children, children + numChildren);
+		}
+
+		return false;
+	}
+}
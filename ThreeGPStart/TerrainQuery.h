@@ -0,0 +1,60 @@
+#pragma once
+// Height, normal and ray queries against the terrain heightfield
+
+#include "ExternalLibraryHeaders.h"
+
+namespace Helpers
+{
+	class TerrainBuilder;
+
+	// Answers ground queries from a copy of the terrain heights, laid out as TerrainBuilder's vertices
+	// Positions outside the terrain are clamped to its edge
+	class TerrainQuery
+	{
+	private:
+		int m_numCellsX{ 0 };
+		int m_numCellsZ{ 0 };
+		float m_cellSize{ 1.0f };
+		std::vector<float> m_heights;
+
+		// Min and max height over blocks of cells, level 0 is one cell per entry and each level halves the last
+		// Lets the raycast skip whole blocks the ray passes over
+		struct HeightPyramidLevel
+		{
+			int width{ 0 };
+			int depth{ 0 };
+			std::vector<glm::vec2> minMax;
+		};
+		std::vector<HeightPyramidLevel> m_pyramid;
+
+		float Height(int x, int z) const { return m_heights[(size_t)x * (m_numCellsZ + 1) + z]; }
+		bool RaycastCell(int cellX, int cellZ, const glm::vec3& origin, const glm::vec3& direction,
+			float tEnter, float tExit, float& hitDistance) const;
+	public:
+		// Copies the heights and builds the min max pyramid
+		void Create(const TerrainBuilder& builder);
+
+		// Replaces a width x depth block of heights starting at grid vertex (x, z), rows along x, and refreshes the
+		// pyramid blocks over it. The block is clipped to the grid.
+		void SetHeights(int x, int z, int width, int depth, const float* heights);
+
+		bool IsEmpty() const { return m_heights.empty(); }
+
+		// Grid vertex heights, laid out as TerrainBuilder::GetHeights
+		const std::vector<float>& GetHeights() const { return m_heights; }
+
+		// Bilinearly interpolated height at world (x, z)
+		float GetHeight(float x, float z) const;
+
+		// Unit normal of the bilinear surface at world (x, z)
+		glm::vec3 GetNormal(float x, float z) const;
+
+		// Batch versions taking world (x, z) points, large batches are split across threads
+		void GetHeights(const glm::vec2* points, size_t count, float* heights) const;
+		void GetNormals(const glm::vec2* points, size_t count, glm::vec3* normals) const;
+
+		// Nearest hit of a ray with the bilinear surface within maxDistance, direction need not be normalised
+		// hitDistance is in units of direction's length. Returns false on a miss.
+		bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& hitDistance) const;
+	};
+}
@@ -0,0 +1,136 @@
+#include "TextureCache.h"
+#include "ImageLoader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+
+namespace Helpers
+{
+	TextureHandle::TextureHandle(const TextureHandle& other) : m_cache(other.m_cache), m_texture(other.m_texture)
+	{
+		if (m_texture)
+			m_cache->AddReference(m_texture);
+	}
+
+	TextureHandle& TextureHandle::operator=(const TextureHandle& other)
+	{
+		if (this != &other)
+		{
+			// Take the new reference first in case both are the same texture
+			if (other.m_texture)
+				other.m_cache->AddReference(other.m_texture);
+			Reset();
+			m_cache = other.m_cache;
+			m_texture = other.m_texture;
+		}
+		return *this;
+	}
+
+	TextureHandle::TextureHandle(TextureHandle&& other) noexcept : m_cache(other.m_cache), m_texture(other.m_texture)
+	{
+		other.m_cache = nullptr;
+		other.m_texture = 0;
+	}
+
+	TextureHandle& TextureHandle::operator=(TextureHandle&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			m_cache = other.m_cache;
+			m_texture = other.m_texture;
+			other.m_cache = nullptr;
+			other.m_texture = 0;
+		}
+		return *this;
+	}
+
+	void TextureHandle::Reset()
+	{
+		if (m_texture)
+			m_cache->Release(m_texture);
+		m_cache = nullptr;
+		m_texture = 0;
+	}
+
+	TextureCache::~TextureCache()
+	{
+		for (const auto& entry : m_entries)
+			glDeleteTextures(1, &entry.first);
+	}
+
+	std::string TextureCache::ResolvePath(const std::string& modelPath, const std::string& texturePath)
+	{
+		const std::filesystem::path texture{ texturePath };
+		if (texture.is_absolute())
+			return texture.lexically_normal().string();
+		return (std::filesystem::path(modelPath).parent_path() / texture).lexically_normal().string();
+	}
+
+	// Windows paths ignore case and either slash, so the key does too
+	static std::string PathKey(const std::string& filepath)
+	{
+		std::string key{ std::filesystem::path(filepath).lexically_normal().generic_string() };
+		std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return key;
+	}
+
+	TextureHandle TextureCache::Acquire(const std::string& filepath)
+	{
+		const std::string key{ PathKey(filepath) };
+		const auto found{ m_byPath.find(key) };
+		if (found != m_byPath.end())
+		{
+			AddReference(found->second);
+			return TextureHandle(this, found->second);
+		}
+
+		ImageLoader image;
+		if (!image.Load(filepath))
+		{
+			std::cout << "Could not load texture: " << filepath << std::endl;
+			return TextureHandle();
+		}
+		m_numDecodes++;
+
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.Width(), image.Height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, image.GetData());
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// The mipmap chain adds about a third
+		Entry entry;
+		entry.key = key;
+		entry.references = 1;
+		entry.bytes = (size_t)image.Width() * image.Height() * 4 * 4 / 3;
+		m_totalBytes += entry.bytes;
+
+		m_byPath.emplace(key, texture);
+		m_entries.emplace(texture, std::move(entry));
+		return TextureHandle(this, texture);
+	}
+
+	void TextureCache::AddReference(GLuint texture)
+	{
+		m_entries[texture].references++;
+	}
+
+	void TextureCache::Release(GLuint texture)
+	{
+		const auto found{ m_entries.find(texture) };
+		if (found == m_entries.end() || --found->second.references > 0)
+			return;
+
+		glDeleteTextures(1, &texture);
+		m_totalBytes -= found->second.bytes;
+		m_byPath.erase(found->second.key);
+		m_entries.erase(found);
+	}
+}
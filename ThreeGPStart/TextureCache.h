@@ -0,0 +1,73 @@
+#pragma once
+// Shares textures between everything using the same image so each is decoded and uploaded once
+
+#include "ExternalLibraryHeaders.h"
+
+#include <unordered_map>
+
+namespace Helpers
+{
+	class TextureCache;
+
+	// Counted reference to a texture in a TextureCache, the texture is deleted when the last one goes
+	// The cache must outlive its handles
+	class TextureHandle
+	{
+	private:
+		TextureCache* m_cache{ nullptr };
+		GLuint m_texture{ 0 };
+	public:
+		TextureHandle() = default;
+		TextureHandle(TextureCache* cache, GLuint texture) : m_cache(cache), m_texture(texture) {}
+		~TextureHandle() { Reset(); }
+
+		TextureHandle(const TextureHandle& other);
+		TextureHandle& operator=(const TextureHandle& other);
+		TextureHandle(TextureHandle&& other) noexcept;
+		TextureHandle& operator=(TextureHandle&& other) noexcept;
+
+		// Drops this reference
+		void Reset();
+
+		GLuint Get() const { return m_texture; }
+		explicit operator bool() const { return m_texture != 0; }
+		bool operator==(const TextureHandle& other) const { return m_texture == other.m_texture; }
+	};
+
+	// 2D textures keyed by their normalised path, mipmapped and repeating
+	class TextureCache
+	{
+	private:
+		struct Entry
+		{
+			std::string key;
+			unsigned int references{ 0 };
+			size_t bytes{ 0 };
+		};
+		std::unordered_map<std::string, GLuint> m_byPath;
+		std::unordered_map<GLuint, Entry> m_entries;
+
+		size_t m_totalBytes{ 0 };
+		size_t m_numDecodes{ 0 };
+
+		friend class TextureHandle;
+		void AddReference(GLuint texture);
+		void Release(GLuint texture);
+	public:
+		TextureCache() = default;
+		~TextureCache();
+		TextureCache(const TextureCache&) = delete;
+		TextureCache& operator=(const TextureCache&) = delete;
+
+		// Path of a texture named by a material, which is relative to the model file unless absolute
+		static std::string ResolvePath(const std::string& modelPath, const std::string& texturePath);
+
+		// Texture of the image, loaded the first time it is asked for. Empty handle if it cannot be loaded.
+		TextureHandle Acquire(const std::string& filepath);
+
+		// Textures alive, their estimated video memory including mipmaps, and images decoded over the cache's life
+		size_t NumTextures() const { return m_entries.size(); }
+		size_t TotalBytes() const { return m_totalBytes; }
+		size_t NumDecodes() const { return m_numDecodes; }
+	};
+}
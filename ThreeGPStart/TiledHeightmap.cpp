@@ -0,0 +1,209 @@
+#include "TiledHeightmap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace Helpers
+{
+	// Size and last write time of a file, false if it cannot be read
+	static bool SourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& writeTime)
+	{
+		std::error_code error;
+		size = (uint64_t)std::filesystem::file_size(sourcePath, error);
+		if (error)
+			return false;
+		writeTime = (int64_t)std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+		return !error;
+	}
+
+	// Converts 8 bit samples into a tiled heightmap file
+	bool WriteTiledHeightmap(const std::string& filepath, const std::string& sourcePath, const BYTE* samples, int width,
+		int height, size_t rowPitch, int tileSize, float sampleSpacing, float maxHeight)
+	{
+		if (!samples || width < 2 || height < 2 || tileSize < 1)
+			return false;
+
+		std::ofstream file(filepath, std::ios::binary);
+		if (!file)
+		{
+			std::cout << "Could not create tiled heightmap: " << filepath << std::endl;
+			return false;
+		}
+
+		TiledHeightmapHeader header;
+		header.width = width;
+		header.height = height;
+		header.tileSize = tileSize;
+		header.numTilesX = (width - 1 + tileSize - 1) / tileSize;
+		header.numTilesZ = (height - 1 + tileSize - 1) / tileSize;
+		header.sampleSpacing = sampleSpacing;
+		header.heightScale = maxHeight / 65535.0f;
+		SourceStamp(sourcePath, header.sourceSize, header.sourceWriteTime);
+		file.write((const char*)&header, sizeof(header));
+
+		// Image x runs along the terrain's x and image rows along its z
+		auto sample = [&](size_t x, size_t z) { return (uint16_t)(samples[z * rowPitch + x] * 257); };
+
+		std::vector<uint16_t> overview(((size_t)header.numTilesX + 1) * ((size_t)header.numTilesZ + 1));
+		for (uint32_t cornerX = 0; cornerX <= header.numTilesX; cornerX++)
+		{
+			const size_t imageX{ (size_t)std::min<int>(cornerX * tileSize, width - 1) };
+			for (uint32_t cornerZ = 0; cornerZ <= header.numTilesZ; cornerZ++)
+				overview[(size_t)cornerX * (header.numTilesZ + 1) + cornerZ] = sample(imageX, (size_t)std::min<int>(cornerZ * tileSize, height - 1));
+		}
+		file.write((const char*)overview.data(), overview.size() * sizeof(uint16_t));
+
+		// One tile at a time so huge images never need a second full size copy
+		const int samplesPerSide{ tileSize + 1 };
+		std::vector<uint16_t> tile((size_t)samplesPerSide * samplesPerSide);
+		for (uint32_t tileX = 0; tileX < header.numTilesX; tileX++)
+		{
+			for (uint32_t tileZ = 0; tileZ < header.numTilesZ; tileZ++)
+			{
+				for (int x = 0; x < samplesPerSide; x++)
+				{
+					const size_t imageX{ (size_t)std::min<int>(tileX * tileSize + x, width - 1) };
+					for (int z = 0; z < samplesPerSide; z++)
+						tile[(size_t)x * samplesPerSide + z] = sample(imageX, (size_t)std::min<int>(tileZ * tileSize + z, height - 1));
+				}
+				file.write((const char*)tile.data(), tile.size() * sizeof(uint16_t));
+			}
+		}
+
+		return (bool)file;
+	}
+
+	// Decodes as grey so the image takes a byte per sample, then cut down to size if the decoder could not do it
+	bool ConvertHeightmapImage(const std::string& filepath, const std::string& sourcePath, int maxSamples, int tileSize,
+		float worldSize, float maxHeight)
+	{
+		FREE_IMAGE_FORMAT format{ FreeImage_GetFileType(sourcePath.c_str(), 0) };
+		if (format == FIF_UNKNOWN)
+			format = FreeImage_GetFIFFromFilename(sourcePath.c_str());
+		if (format == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(format))
+		{
+			std::cout << "Heightmap image cannot be read: " << sourcePath << std::endl;
+			return false;
+		}
+
+		// A size in the top 16 bits has the JPEG decoder scale down by up to 8 as it decodes, rather than after
+		const int flags{ format == FIF_JPEG ? (JPEG_GREYSCALE | (std::clamp(maxSamples, 1, 0xffff) << 16)) : 0 };
+		FIBITMAP* bitmap{ FreeImage_Load(format, sourcePath.c_str(), flags) };
+		if (!bitmap)
+		{
+			std::cout << "Could not load heightmap image: " << sourcePath << std::endl;
+			return false;
+		}
+		FIBITMAP* grey{ FreeImage_ConvertToGreyscale(bitmap) };
+		FreeImage_Unload(bitmap);
+		if (!grey)
+			return false;
+
+		const int largest{ (int)std::max(FreeImage_GetWidth(grey), FreeImage_GetHeight(grey)) };
+		if (largest > maxSamples)
+		{
+			const float scale{ maxSamples / (float)largest };
+			FIBITMAP* smaller{ FreeImage_Rescale(grey, std::max(2, (int)(FreeImage_GetWidth(grey) * scale)),
+				std::max(2, (int)(FreeImage_GetHeight(grey) * scale)), FILTER_BOX) };
+			FreeImage_Unload(grey);
+			grey = smaller;
+			if (!grey)
+				return false;
+		}
+
+		const int width{ (int)FreeImage_GetWidth(grey) };
+		const int height{ (int)FreeImage_GetHeight(grey) };
+		const bool written{ WriteTiledHeightmap(filepath, sourcePath, FreeImage_GetBits(grey), width, height, FreeImage_GetPitch(grey),
+			tileSize, worldSize / (width - 1), maxHeight) };
+		FreeImage_Unload(grey);
+		return written;
+	}
+
+	// Maps the file and checks the header, returns false on error
+	bool TiledHeightmap::Open(const std::string& filepath, const std::string& sourcePath)
+	{
+		if (!m_file.Open(filepath, true))
+			return false;
+
+		if (m_file.Size() < sizeof(TiledHeightmapHeader))
+		{
+			m_file.Close();
+			return false;
+		}
+
+		memcpy(&m_header, m_file.GetData(), sizeof(m_header));
+
+		const TiledHeightmapHeader expected;
+		const size_t expectedSize{ sizeof(TiledHeightmapHeader) + OverviewBytes() + (size_t)m_header.numTilesX * m_header.numTilesZ * TileBytes() };
+		if (memcmp(m_header.magic, expected.magic, sizeof(expected.magic)) != 0 || m_header.version != expected.version ||
+			m_header.tileSize == 0 || m_file.Size() < expectedSize)
+		{
+			std::cout << "Not a valid tiled heightmap: " << filepath << std::endl;
+			m_file.Close();
+			return false;
+		}
+
+		// Made from an older version of the image, or from another image altogether
+		uint64_t sourceSize{ 0 };
+		int64_t sourceWriteTime{ 0 };
+		if (!sourcePath.empty() && SourceStamp(sourcePath, sourceSize, sourceWriteTime) &&
+			(m_header.sourceSize != sourceSize || m_header.sourceWriteTime != sourceWriteTime))
+		{
+			std::cout << "Tiled heightmap is out of date: " << filepath << std::endl;
+			m_file.Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	// Points straight into the mapping, touching it may read from disk
+	const uint16_t* TiledHeightmap::GetTileSamples(int tileX, int tileZ) const
+	{
+		const size_t tileIndex{ (size_t)tileX * m_header.numTilesZ + tileZ };
+		return (const uint16_t*)(m_file.GetData() + sizeof(TiledHeightmapHeader) + OverviewBytes() + tileIndex * TileBytes());
+	}
+
+	// World height of a sample, read through the mapping
+	float TiledHeightmap::GetHeight(int x, int z) const
+	{
+		x = std::clamp(x, 0, (int)m_header.width - 1);
+		z = std::clamp(z, 0, (int)m_header.height - 1);
+
+		// The shared edge means the last sample of a tile is also in it, so only the last tile needs clamping
+		const int tileX{ std::min(x / (int)m_header.tileSize, (int)m_header.numTilesX - 1) };
+		const int tileZ{ std::min(z / (int)m_header.tileSize, (int)m_header.numTilesZ - 1) };
+		const size_t localX{ (size_t)x - (size_t)tileX * m_header.tileSize };
+		const size_t localZ{ (size_t)z - (size_t)tileZ * m_header.tileSize };
+		return GetTileSamples(tileX, tileZ)[localX * TileSamplesPerSide() + localZ] * m_header.heightScale;
+	}
+
+	// Corner i sits at sample i * tileSize, except the last which is clamped to the edge of the map
+	float TiledHeightmap::GetOverviewHeight(float x, float z) const
+	{
+		const uint16_t* overview{ (const uint16_t*)(m_file.GetData() + sizeof(TiledHeightmapHeader)) };
+		const float tileSize{ (float)m_header.tileSize };
+
+		auto corners = [&](float position, uint32_t numTiles, uint32_t numSamples, int& corner, float& t)
+		{
+			position = std::clamp(position, 0.0f, (float)(numSamples - 1));
+			corner = std::min((int)(position / tileSize), (int)numTiles - 1);
+			const float start{ corner * tileSize };
+			const float end{ std::min((corner + 1) * tileSize, (float)(numSamples - 1)) };
+			t = end > start ? (position - start) / (end - start) : 0.0f;
+		};
+		int cornerX, cornerZ;
+		float u, v;
+		corners(x, m_header.numTilesX, m_header.width, cornerX, u);
+		corners(z, m_header.numTilesZ, m_header.height, cornerZ, v);
+
+		const size_t samplesZ{ OverviewSamplesZ() };
+		const uint16_t* row0{ overview + (size_t)cornerX * samplesZ };
+		const uint16_t* row1{ row0 + samplesZ };
+		const float h0{ row0[cornerZ] + (row0[cornerZ + 1] - (float)row0[cornerZ]) * v };
+		const float h1{ row1[cornerZ] + (row1[cornerZ + 1] - (float)row1[cornerZ]) * v };
+		return (h0 + (h1 - h0) * u) * m_header.heightScale;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+// Tiled heightmap file format, memory mapped so only the samples read come off the disk
+
+#include "ExternalLibraryHeaders.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+
+namespace Helpers
+{
+	// Start of a tiled heightmap file, followed by the overview and then the tiles
+	// The overview is the sample at every tile corner, (numTilesX + 1) x (numTilesZ + 1) of them laid out x major,
+	// enough to stand a coarse terrain up before any tile is read.
+	// Each tile holds (tileSize + 1) squared 16 bit samples, sharing its last row and column with its neighbours,
+	// laid out x major like the terrain grid. Tiles are stored x major too.
+	// sourceSize and sourceWriteTime record the image it was made from, so a changed image is noticed.
+	struct TiledHeightmapHeader
+	{
+		char magic[4]{ 'T', 'H', 'M', 'P' };
+		uint32_t version{ 3 };
+		uint32_t width{ 0 };
+		uint32_t height{ 0 };
+		uint32_t tileSize{ 0 };
+		uint32_t numTilesX{ 0 };
+		uint32_t numTilesZ{ 0 };
+		float sampleSpacing{ 1.0f };
+		float heightScale{ 1.0f };
+		uint32_t reserved{ 0 };
+		uint64_t sourceSize{ 0 };
+		int64_t sourceWriteTime{ 0 };
+	};
+
+	// Converts 8 bit samples, rowPitch bytes apart, from the image at sourcePath into a tiled heightmap file
+	// sampleSpacing is the world distance between samples and maxHeight the world height of a full sample
+	bool WriteTiledHeightmap(const std::string& filepath, const std::string& sourcePath, const BYTE* samples, int width,
+		int height, size_t rowPitch, int tileSize, float sampleSpacing, float maxHeight);
+
+	// Decodes the image at sourcePath as grey and writes it as a tiled heightmap spanning worldSize, returns false on error
+	// The image is cut to at most maxSamples a side as it is decoded, JPEGs by the decoder's own scaling, so a huge
+	// image is never held at full size
+	bool ConvertHeightmapImage(const std::string& filepath, const std::string& sourcePath, int maxSamples, int tileSize,
+		float worldSize, float maxHeight);
+
+	// Memory mapped view of a tiled heightmap file
+	class TiledHeightmap
+	{
+	private:
+		MappedFile m_file;
+		TiledHeightmapHeader m_header;
+
+		size_t OverviewBytes() const { return OverviewSamplesX() * OverviewSamplesZ() * sizeof(uint16_t); }
+	public:
+		// Maps the file and checks the header, returns false on error
+		// If sourcePath names a file that exists, the tiles must have been made from it as it is now
+		bool Open(const std::string& filepath, const std::string& sourcePath = std::string());
+
+		bool IsOpen() const { return m_file.IsOpen(); }
+
+		const TiledHeightmapHeader& GetHeader() const { return m_header; }
+
+		// Samples per tile side, including the shared edge
+		size_t TileSamplesPerSide() const { return (size_t)m_header.tileSize + 1; }
+		size_t TileBytes() const { return TileSamplesPerSide() * TileSamplesPerSide() * sizeof(uint16_t); }
+
+		// Overview samples along each side, one per tile corner
+		size_t OverviewSamplesX() const { return (size_t)m_header.numTilesX + 1; }
+		size_t OverviewSamplesZ() const { return (size_t)m_header.numTilesZ + 1; }
+
+		// Points straight into the mapping, touching it may read from disk
+		const uint16_t* GetTileSamples(int tileX, int tileZ) const;
+
+		// World height of sample (x, z), clamped to the map. Safe to call from several threads at once.
+		float GetHeight(int x, int z) const;
+
+		// World height at sample (x, z) blended from the overview alone, so only ever reads the overview
+		float GetOverviewHeight(float x, float z) const;
+	};
+}